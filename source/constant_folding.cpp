@@ -10,6 +10,16 @@ namespace reshadefx
 {
 	using namespace nodes;
 
+	/// <summary>
+	/// The values an operation on literals produces. They are collected here first, since the operands are still read from while the values are computed, and the result is stored in one of them.
+	/// </summary>
+	union folding_result
+	{
+		int value_int[literal_expression_node::max_values];
+		unsigned int value_uint[literal_expression_node::max_values];
+		float value_float[literal_expression_node::max_values];
+	};
+
 	void scalar_literal_cast(const literal_expression_node *from, size_t i, int &to)
 	{
 		switch (from->type.basetype)
@@ -17,10 +27,10 @@ namespace reshadefx
 			case type_node::datatype_bool:
 			case type_node::datatype_int:
 			case type_node::datatype_uint:
-				to = from->value_int[i];
+				to = from->value_int()[i];
 				break;
 			case type_node::datatype_float:
-				to = static_cast<int>(from->value_float[i]);
+				to = static_cast<int>(from->value_float()[i]);
 				break;
 			default:
 				to = 0;
@@ -34,10 +44,10 @@ namespace reshadefx
 			case type_node::datatype_bool:
 			case type_node::datatype_int:
 			case type_node::datatype_uint:
-				to = from->value_uint[i];
+				to = from->value_uint()[i];
 				break;
 			case type_node::datatype_float:
-				to = static_cast<unsigned int>(from->value_float[i]);
+				to = static_cast<unsigned int>(from->value_float()[i]);
 				break;
 			default:
 				to = 0;
@@ -50,13 +60,13 @@ namespace reshadefx
 		{
 			case type_node::datatype_bool:
 			case type_node::datatype_int:
-				to = static_cast<float>(from->value_int[i]);
+				to = static_cast<float>(from->value_int()[i]);
 				break;
 			case type_node::datatype_uint:
-				to = static_cast<float>(from->value_uint[i]);
+				to = static_cast<float>(from->value_uint()[i]);
 				break;
 			case type_node::datatype_float:
-				to = from->value_float[i];
+				to = from->value_float()[i];
 				break;
 			default:
 				to = 0;
@@ -69,16 +79,16 @@ namespace reshadefx
 		{
 			case type_node::datatype_bool:
 			case type_node::datatype_int:
-				scalar_literal_cast(from, j, to->value_int[k]);
+				scalar_literal_cast(from, j, to->value_int()[k]);
 				break;
 			case type_node::datatype_uint:
-				scalar_literal_cast(from, j, to->value_uint[k]);
+				scalar_literal_cast(from, j, to->value_uint()[k]);
 				break;
 			case type_node::datatype_float:
-				scalar_literal_cast(from, j, to->value_float[k]);
+				scalar_literal_cast(from, j, to->value_float()[k]);
 				break;
 			default:
-				memcpy(to->value_uint, from->value_uint, sizeof(from->value_uint));
+				to->value_uint()[k] = from->value_uint()[j];
 				break;
 		}
 	}
@@ -94,27 +104,28 @@ namespace reshadefx
 					switch (expression->type.basetype) \
 					{ \
 						case type_node::datatype_bool: case type_node::datatype_int: case type_node::datatype_uint: \
-							operand->value_int[i] = static_cast<int>(op(operand->value_int[i])); break; \
+							operand->value_int()[i] = static_cast<int>(op(operand->value_int()[i])); break; \
 						case type_node::datatype_float: \
-							operand->value_float[i] = static_cast<float>(op(operand->value_int[i])); break; \
+							operand->value_float()[i] = static_cast<float>(op(operand->value_int()[i])); break; \
 					} \
 					break; \
 				case type_node::datatype_float: \
 					switch (expression->type.basetype) \
 					{ \
 						case type_node::datatype_bool: case type_node::datatype_int: case type_node::datatype_uint: \
-							operand->value_int[i] = static_cast<int>(op(operand->value_float[i])); break; \
+							operand->value_int()[i] = static_cast<int>(op(operand->value_float()[i])); break; \
 						case type_node::datatype_float: \
-							operand->value_float[i] = static_cast<float>(op(operand->value_float[i])); break; \
+							operand->value_float()[i] = static_cast<float>(op(operand->value_float()[i])); break; \
 					} \
 					break; \
 			} \
 		operand->type = expression->type; \
+		ast.reserve_literal_values(operand); \
 		expression = operand; \
 	}
 #define DOFOLDING2(op) \
 	{ \
-		literal_expression_node result; \
+		folding_result result = {}; \
 		for (unsigned int i = 0; i < expression->type.rows * expression->type.cols; ++i) \
 			switch (left->type.basetype) \
 			{ \
@@ -122,70 +133,75 @@ namespace reshadefx
 					switch (right->type.basetype) \
 					{ \
 						case type_node::datatype_bool: case type_node::datatype_int: case type_node::datatype_uint: \
-							result.value_int[i] = left->value_int[left_scalar ? 0 : i] op right->value_int[right_scalar ? 0 : i]; \
+							result.value_int[i] = left->value_int()[left_scalar ? 0 : i] op right->value_int()[right_scalar ? 0 : i]; \
 							break; \
 						case type_node::datatype_float: \
-							result.value_float[i] = static_cast<float>(left->value_int[!left_scalar * i]) op right->value_float[!right_scalar * i]; \
+							result.value_float[i] = static_cast<float>(left->value_int()[!left_scalar * i]) op right->value_float()[!right_scalar * i]; \
 							break; \
 					} \
 					break; \
 				case type_node::datatype_float: \
-					result.value_float[i] = (right->type.basetype == type_node::datatype_float) ? (left->value_float[!left_scalar * i] op right->value_float[!right_scalar * i]) : (left->value_float[!left_scalar * i] op static_cast<float>(right->value_int[!right_scalar * i])); \
+					result.value_float[i] = (right->type.basetype == type_node::datatype_float) ? (left->value_float()[!left_scalar * i] op right->value_float()[!right_scalar * i]) : (left->value_float()[!left_scalar * i] op static_cast<float>(right->value_int()[!right_scalar * i])); \
 					break; \
 			} \
 		left->type = expression->type; \
-		memcpy(left->value_uint, result.value_uint, sizeof(result.value_uint)); \
+		ast.reserve_literal_values(left); \
+		std::copy_n(result.value_uint, expression->type.rows * expression->type.cols, left->value_uint()); \
 		expression = left; \
 	}
 #define DOFOLDING2_INT(op) \
 	{ \
-		literal_expression_node result; \
+		folding_result result = {}; \
 		for (unsigned int i = 0; i < expression->type.rows * expression->type.cols; ++i) \
 		{ \
-			result.value_int[i] = left->value_int[!left_scalar * i] op right->value_int[!right_scalar * i]; \
+			result.value_int[i] = left->value_int()[!left_scalar * i] op right->value_int()[!right_scalar * i]; \
 		} \
 		left->type = expression->type; \
-		memcpy(left->value_uint, result.value_uint, sizeof(result.value_uint)); \
+		ast.reserve_literal_values(left); \
+		std::copy_n(result.value_uint, expression->type.rows * expression->type.cols, left->value_uint()); \
 		expression = left; \
 	}
 #define DOFOLDING2_BOOL(op) \
 	{ \
-		literal_expression_node result; \
+		folding_result result = {}; \
 		for (unsigned int i = 0; i < expression->type.rows * expression->type.cols; ++i) \
 			switch (left->type.basetype) \
 			{ \
 				case type_node::datatype_bool: case type_node::datatype_int: case type_node::datatype_uint: \
-					result.value_int[i] = (right->type.basetype == type_node::datatype_float) ? (static_cast<float>(left->value_int[!left_scalar * i]) op right->value_float[!right_scalar * i]) : (left->value_int[!left_scalar * i] op right->value_int[!right_scalar * i]); \
+					result.value_int[i] = (right->type.basetype == type_node::datatype_float) ? (static_cast<float>(left->value_int()[!left_scalar * i]) op right->value_float()[!right_scalar * i]) : (left->value_int()[!left_scalar * i] op right->value_int()[!right_scalar * i]); \
 					break; \
 				case type_node::datatype_float: \
-					result.value_int[i] = (right->type.basetype == type_node::datatype_float) ? (left->value_float[!left_scalar * i] op static_cast<float>(right->value_int[!right_scalar * i])) : (left->value_float[!left_scalar * i] op right->value_float[!right_scalar * i]); \
+					result.value_int[i] = (right->type.basetype == type_node::datatype_float) ? (left->value_float()[!left_scalar * i] op static_cast<float>(right->value_int()[!right_scalar * i])) : (left->value_float()[!left_scalar * i] op right->value_float()[!right_scalar * i]); \
 					break; \
 			} \
 		left->type = expression->type; \
 		left->type.basetype = type_node::datatype_bool; \
-		memcpy(left->value_uint, result.value_uint, sizeof(result.value_uint)); \
+		ast.reserve_literal_values(left); \
+		std::copy_n(result.value_uint, expression->type.rows * expression->type.cols, left->value_uint()); \
 		expression = left; \
 	}
 #define DOFOLDING2_FLOAT(op) \
 	{ \
-		literal_expression_node result; \
+		folding_result result = {}; \
 		for (unsigned int i = 0; i < expression->type.rows * expression->type.cols; ++i) \
 			switch (left->type.basetype) \
 			{ \
 				case type_node::datatype_bool:  case type_node::datatype_int: case type_node::datatype_uint: \
-					result.value_float[i] = (right->type.basetype == type_node::datatype_float) ? (static_cast<float>(left->value_int[!left_scalar * i]) op right->value_float[!right_scalar * i]) : (left->value_int[left_scalar ? 0 : i] op right->value_int[right_scalar ? 0 : i]); \
+					result.value_float[i] = (right->type.basetype == type_node::datatype_float) ? (static_cast<float>(left->value_int()[!left_scalar * i]) op right->value_float()[!right_scalar * i]) : (left->value_int()[left_scalar ? 0 : i] op right->value_int()[right_scalar ? 0 : i]); \
 					break; \
 				case type_node::datatype_float: \
-					result.value_float[i] = (right->type.basetype == type_node::datatype_float) ? (left->value_float[!left_scalar * i] op right->value_float[!right_scalar * i]) : (left->value_float[!left_scalar * i] op static_cast<float>(right->value_int[!right_scalar * i])); \
+					result.value_float[i] = (right->type.basetype == type_node::datatype_float) ? (left->value_float()[!left_scalar * i] op right->value_float()[!right_scalar * i]) : (left->value_float()[!left_scalar * i] op static_cast<float>(right->value_int()[!right_scalar * i])); \
 					break; \
 			} \
 		left->type = expression->type; \
 		left->type.basetype = type_node::datatype_float; \
-		memcpy(left->value_uint, result.value_uint, sizeof(result.value_uint)); \
+		ast.reserve_literal_values(left); \
+		std::copy_n(result.value_uint, expression->type.rows * expression->type.cols, left->value_uint()); \
 		expression = left; \
 	}
 #define DOFOLDING2_FUNCTION(op) \
 	{ \
+		folding_result result = {}; \
 		for (unsigned int i = 0; i < expression->type.rows * expression->type.cols; ++i) \
 			switch (left->type.basetype) \
 			{ \
@@ -193,18 +209,20 @@ namespace reshadefx
 					switch (right->type.basetype) \
 					{ \
 						case type_node::datatype_bool: case type_node::datatype_int: case type_node::datatype_uint: \
-							left->value_int[i] = static_cast<int>(op(left->value_int[i], right->value_int[i])); \
+							result.value_int[i] = static_cast<int>(op(left->value_int()[!left_scalar * i], right->value_int()[!right_scalar * i])); \
 							break; \
 						case type_node::datatype_float: \
-							left->value_float[i] = static_cast<float>(op(static_cast<float>(left->value_int[i]), right->value_float[i])); \
+							result.value_float[i] = static_cast<float>(op(static_cast<float>(left->value_int()[!left_scalar * i]), right->value_float()[!right_scalar * i])); \
 							break; \
 					} \
 					break; \
 				case type_node::datatype_float: \
-					left->value_float[i] = (right->type.basetype == type_node::datatype_float) ? (static_cast<float>(op(left->value_float[i], right->value_float[i]))) : (static_cast<float>(op(left->value_float[i], static_cast<float>(right->value_int[i])))); \
+					result.value_float[i] = (right->type.basetype == type_node::datatype_float) ? (static_cast<float>(op(left->value_float()[!left_scalar * i], right->value_float()[!right_scalar * i]))) : (static_cast<float>(op(left->value_float()[!left_scalar * i], static_cast<float>(right->value_int()[!right_scalar * i])))); \
 					break; \
 			} \
 		left->type = expression->type; \
+		ast.reserve_literal_values(left); \
+		std::copy_n(result.value_uint, expression->type.rows * expression->type.cols, left->value_uint()); \
 		expression = left; \
 	}
 
@@ -227,27 +245,30 @@ namespace reshadefx
 				case unary_expression_node::bitwise_not:
 					for (unsigned int i = 0; i < operand->type.rows * operand->type.cols; i++)
 					{
-						operand->value_int[i] = ~operand->value_int[i];
+						operand->value_int()[i] = ~operand->value_int()[i];
 					}
 					expression = operand;
 					break;
 				case unary_expression_node::logical_not:
 					for (unsigned int i = 0; i < operand->type.rows * operand->type.cols; i++)
 					{
-						operand->value_int[i] = (operand->type.basetype == type_node::datatype_float) ? !operand->value_float[i] : !operand->value_int[i];
+						operand->value_int()[i] = (operand->type.basetype == type_node::datatype_float) ? !operand->value_float()[i] : !operand->value_int()[i];
 					}
 					operand->type.basetype = type_node::datatype_bool;
 					expression = operand;
 					break;
 				case unary_expression_node::cast:
 				{
-					literal_expression_node old = *operand;
-					operand->type = expression->type;
-					expression = operand;
+					// Convert into a new literal, since the values cannot be converted in place without overwriting ones that were not read yet when the size of the type changes
+					const auto literal = ast.make_node<literal_expression_node>(operand->location);
+					literal->type = expression->type;
+					literal->value_string = operand->value_string;
+					ast.reserve_literal_values(literal);
+					expression = literal;
 
-					for (unsigned int i = 0, size = std::min(old.type.rows * old.type.cols, operand->type.rows * operand->type.cols); i < size; ++i)
+					for (unsigned int i = 0, size = std::min(operand->type.rows * operand->type.cols, literal->type.rows * literal->type.cols); i < size; ++i)
 					{
-						vector_literal_cast(&old, i, operand, i);
+						vector_literal_cast(operand, i, literal, i);
 					}
 					break;
 				}
@@ -279,7 +300,7 @@ namespace reshadefx
 					DOFOLDING2(*);
 					break;
 				case binary_expression_node::divide:
-					if (right->value_uint[0] == 0)
+					if (right->value_uint()[0] == 0)
 					{
 						return expression;
 					}
@@ -341,6 +362,8 @@ namespace reshadefx
 			const auto operand = static_cast<literal_expression_node *>(intrinsicexpression->arguments[0]);
 			const auto left = operand;
 			const auto right = static_cast<literal_expression_node *>(intrinsicexpression->arguments[1]);
+			const bool left_scalar = left != nullptr && left->type.rows * left->type.cols == 1;
+			const bool right_scalar = right != nullptr && right->type.rows * right->type.cols == 1;
 
 			switch (intrinsicexpression->op)
 			{
@@ -421,6 +444,7 @@ namespace reshadefx
 			unsigned int k = 0;
 			const auto literal = ast.make_node<literal_expression_node>(constructor->location);
 			literal->type = constructor->type;
+			ast.reserve_literal_values(literal);
 
 			for (auto argument : constructor->arguments)
 			{
@@ -443,6 +467,7 @@ namespace reshadefx
 
 			const auto literal = ast.make_node<literal_expression_node>(expression->location);
 			literal->type = expression->type;
+			ast.reserve_literal_values(literal);
 			expression = literal;
 
 			for (unsigned int i = 0, size = std::min(variable->initializer_expression->type.rows * variable->initializer_expression->type.cols, literal->type.rows * literal->type.cols); i < size; ++i)
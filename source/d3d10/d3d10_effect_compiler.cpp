@@ -5,6 +5,8 @@
 
 #include "d3d10_runtime.hpp"
 #include "d3d10_effect_compiler.hpp"
+#include "shader_cache.hpp"
+#include "effect_optimizer.hpp"
 #include <assert.h>
 #include <iomanip>
 #include <fstream>
@@ -20,6 +22,17 @@ namespace reshade::d3d10
 	{
 		return (size + 15) & ~15;
 	}
+	static bool is_backbuffer_texture(const declaration_node *node)
+	{
+		if (node->id != nodeid::variable_declaration)
+		{
+			return false;
+		}
+
+		const auto variable = static_cast<const variable_declaration_node *>(node);
+
+		return variable->type.is_texture() && (variable->semantic == "COLOR" || variable->semantic == "SV_TARGET");
+	}
 	static D3D10_BLEND literal_to_blend_func(unsigned int value)
 	{
 		switch (value)
@@ -201,7 +214,7 @@ namespace reshade::d3d10
 #if RESHADE_DUMP_NATIVE_SHADERS
 		if (_ast.techniques.size() == 0)
 			return;
-		_dump_filename = _ast.techniques[0]->location.source;
+		_dump_filename = std::string(_ast.techniques[0]->location.source);
 		_dump_filename = "ReShade-ShaderDump-" + _dump_filename.filename_without_extension().string() + ".hlsl";
 
 		std::ofstream(_dump_filename.string(), std::ios::trunc);
@@ -222,6 +235,10 @@ namespace reshade::d3d10
 			return false;
 		}
 
+		// Different compiler versions produce different code, so cached shaders are only valid for the exact library they were compiled with
+		const auto d3dcompiler_path = filesystem::get_module_path(_d3dcompiler_module);
+		_d3dcompiler_identity = d3dcompiler_path.string() + '|' + std::to_string(filesystem::last_write_time(d3dcompiler_path));
+
 		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
 
 		for (auto node : _ast.structs)
@@ -230,34 +247,45 @@ namespace reshade::d3d10
 		}
 		for (auto uniform : _ast.variables)
 		{
+			std::stringstream code;
+
 			if (uniform->type.is_texture())
 			{
-				visit_texture(uniform);
+				visit_texture(code, uniform);
 			}
 			else if (uniform->type.is_sampler())
 			{
-				visit_sampler(uniform);
+				visit_sampler(code, uniform);
 			}
 			else if (uniform->type.has_qualifier(type_node::qualifier_uniform))
 			{
 				visit_uniform(uniform);
+				continue;
 			}
 			else
 			{
-				visit(_global_code, uniform);
+				visit(code, uniform);
 
-				_global_code << ";\n";
+				code << ";\n";
 			}
+
+			_global_declarations.emplace_back(uniform, code.str());
 		}
 		for (auto function : _ast.functions)
 		{
-			visit(_global_code, function);
+			std::stringstream code;
+
+			visit(code, function);
+
+			_global_declarations.emplace_back(function, code.str());
 		}
 		for (auto technique : _ast.techniques)
 		{
 			visit_technique(technique);
 		}
 
+		compile_pending_shaders();
+
 		if (_constant_buffer_size != 0)
 		{
 			_constant_buffer_size = roundto16(_constant_buffer_size);
@@ -281,11 +309,11 @@ namespace reshade::d3d10
 	{
 		_success = false;
 
-		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): error: " + message + '\n';
+		_errors += std::string(location.source) + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): error: " + message + '\n';
 	}
 	void d3d10_effect_compiler::warning(const location &location, const std::string &message)
 	{
-		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
+		_errors += std::string(location.source) + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
 	}
 
 	void d3d10_effect_compiler::visit(std::stringstream &output, const statement_node *node)
@@ -460,16 +488,16 @@ namespace reshade::d3d10
 			switch (node->type.basetype)
 			{
 				case type_node::datatype_bool:
-					output << (node->value_int[i] ? "true" : "false");
+					output << (node->value_int()[i] ? "true" : "false");
 					break;
 				case type_node::datatype_int:
-					output << node->value_int[i];
+					output << node->value_int()[i];
 					break;
 				case type_node::datatype_uint:
-					output << node->value_uint[i];
+					output << node->value_uint()[i];
 					break;
 				case type_node::datatype_float:
-					output << std::setprecision(8) << std::fixed << node->value_float[i];
+					output << std::setprecision(8) << std::fixed << node->value_float()[i];
 					break;
 			}
 
@@ -934,7 +962,7 @@ namespace reshade::d3d10
 			case intrinsic_expression_node::texture_gather:
 				if (node->arguments[2]->id == nodeid::literal_expression && node->arguments[2]->type.is_integral())
 				{
-					const int component = static_cast<const literal_expression_node *>(node->arguments[2])->value_int[0];
+					const int component = static_cast<const literal_expression_node *>(node->arguments[2])->value_int()[0];
 
 					output << "__tex2Dgather" << component << '(';
 					visit(output, node->arguments[0]);
@@ -950,7 +978,7 @@ namespace reshade::d3d10
 			case intrinsic_expression_node::texture_gather_offset:
 				if (node->arguments[3]->id == nodeid::literal_expression && node->arguments[3]->type.is_integral())
 				{
-					const int component = static_cast<const literal_expression_node *>(node->arguments[3])->value_int[0];
+					const int component = static_cast<const literal_expression_node *>(node->arguments[3])->value_int()[0];
 
 					output << "__tex2Dgather" << component << "offset(";
 					visit(output, node->arguments[0]);
@@ -1500,7 +1528,7 @@ namespace reshade::d3d10
 		_is_in_function_block = false;
 	}
 
-	void d3d10_effect_compiler::visit_texture(const variable_declaration_node *node)
+	void d3d10_effect_compiler::visit_texture(std::stringstream &output, const variable_declaration_node *node)
 	{
 		size_t texture_register_index, texture_register_index_srgb;
 
@@ -1637,11 +1665,11 @@ namespace reshade::d3d10
 			_runtime->add_texture(std::move(obj));
 		}
 
-		_global_code << "Texture2D " <<
+		output << "Texture2D " <<
 			node->unique_name << " : register(t" << texture_register_index << "), __" <<
 			node->unique_name << "SRGB : register(t" << texture_register_index_srgb << ");\n";
 	}
-	void d3d10_effect_compiler::visit_sampler(const variable_declaration_node *node)
+	void d3d10_effect_compiler::visit_sampler(std::stringstream &output, const variable_declaration_node *node)
 	{
 		D3D10_SAMPLER_DESC desc = { };
 		desc.Filter = static_cast<D3D10_FILTER>(node->properties.filter);
@@ -1684,18 +1712,18 @@ namespace reshade::d3d10
 			it = _runtime->_effect_sampler_descs.emplace(desc_hash, _runtime->_effect_sampler_states.size() - 1).first;
 		}
 
-		_global_code << "static const __sampler2D " << node->unique_name << " = { ";
+		output << "static const __sampler2D " << node->unique_name << " = { ";
 
 		if (node->properties.srgb_texture)
 		{
-			_global_code << "__" << node->properties.texture->unique_name << "SRGB";
+			output << "__" << node->properties.texture->unique_name << "SRGB";
 		}
 		else
 		{
-			_global_code << node->properties.texture->unique_name;
+			output << node->properties.texture->unique_name;
 		}
 
-		_global_code << ", __SamplerState" << it->second << " };\n";
+		output << ", __SamplerState" << it->second << " };\n";
 	}
 	void d3d10_effect_compiler::visit_uniform(const variable_declaration_node *node)
 	{
@@ -1740,7 +1768,12 @@ namespace reshade::d3d10
 
 		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
 		{
-			CopyMemory(uniform_storage.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
+			const auto initializer = static_cast<const literal_expression_node *>(node->initializer_expression);
+			const size_t initializer_size = std::min<size_t>(obj.storage_size, initializer->type.rows * initializer->type.cols * 4);
+
+			// The literal only stores as many values as its type has components, so fill the rest with zeros
+			CopyMemory(uniform_storage.data() + obj.storage_offset, initializer->value_float(), initializer_size);
+			ZeroMemory(uniform_storage.data() + obj.storage_offset + initializer_size, obj.storage_size - initializer_size);
 		}
 		else
 		{
@@ -1851,6 +1884,8 @@ namespace reshade::d3d10
 			pass.render_target_resources[i] = texture_impl->srv[target_index];
 		}
 
+		pass.writes_backbuffer = pass.render_targets[0] == _runtime->_backbuffer_rtv[target_index];
+
 		if (pass.viewport.Width == 0 && pass.viewport.Height == 0)
 		{
 			pass.viewport.Width = _runtime->frame_width();
@@ -2001,6 +2036,24 @@ namespace reshade::d3d10
 
 		source += _global_code.str();
 
+		// Only emit what this entry point actually uses, instead of handing the compiler every function in the effect for every shader
+		std::unordered_set<const declaration_node *> reachable;
+		find_reachable_declarations(node, reachable);
+
+		for (const auto &declaration : _global_declarations)
+		{
+			if (reachable.count(declaration.first))
+			{
+				source += declaration.second;
+			}
+		}
+
+		// Record whether the pass samples the back buffer while the set is at hand, so that the runtime can skip copying it for all other passes
+		if (std::any_of(reachable.begin(), reachable.end(), is_backbuffer_texture))
+		{
+			pass.samples_backbuffer = true;
+		}
+
 #if RESHADE_DUMP_NATIVE_SHADERS
 		if (!_dumped_shaders.count(node->unique_name))
 		{
@@ -2015,8 +2068,12 @@ namespace reshade::d3d10
 		}
 #endif
 
+		// Compilation is deferred until all passes were generated, so that the shaders of the entire effect can be compiled in parallel
+		_pending_shaders.push_back({ node, shadertype, profile, std::move(source), { &pass } });
+	}
+	void d3d10_effect_compiler::compile_pending_shaders()
+	{
 		UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
-		com_ptr<ID3DBlob> compiled, errors;
 
 		if (_skip_shader_optimization)
 		{
@@ -2024,32 +2081,91 @@ namespace reshade::d3d10
 		}
 
 		const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
-		HRESULT hr = D3DCompile(source.c_str(), source.length(), nullptr, nullptr, nullptr, node->unique_name.c_str(), profile.c_str(), flags, 0, &compiled, &errors);
 
-		if (errors != nullptr)
-		{
-			_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
-		}
+		// Effects usually share one vertex shader between all their passes, so merge identical shaders first, or they would all be compiled at the same time before any of them made it into the cache
+		std::vector<pending_shader> unique_shaders;
 
-		if (FAILED(hr))
+		for (auto &shader : _pending_shaders)
 		{
-			error(node->location, "internal shader compilation failed");
-			return;
-		}
+			shader.cache_key = shader_cache::make_key(shader.source, shader.entry_point->unique_name, shader.profile, flags, _d3dcompiler_identity);
 
-		if (shadertype == "vs")
-		{
-			hr = _runtime->_device->CreateVertexShader(compiled->GetBufferPointer(), compiled->GetBufferSize(), &pass.vertex_shader);
-		}
-		else if (shadertype == "ps")
-		{
-			hr = _runtime->_device->CreatePixelShader(compiled->GetBufferPointer(), compiled->GetBufferSize(), &pass.pixel_shader);
+			if (const auto duplicate = std::find_if(unique_shaders.begin(), unique_shaders.end(), [&shader](const pending_shader &other) { return other.cache_key == shader.cache_key; });
+				duplicate != unique_shaders.end())
+			{
+				duplicate->passes.insert(duplicate->passes.end(), shader.passes.begin(), shader.passes.end());
+			}
+			else
+			{
+				unique_shaders.push_back(std::move(shader));
+			}
 		}
 
-		if (FAILED(hr))
+		_pending_shaders = std::move(unique_shaders);
+
+		// The compiler is thread-safe and by far the slowest part of loading an effect, so run it on the worker threads and only create the shader objects here afterwards
+		_runtime->worker_pool().parallel_for(_pending_shaders.size(), [this, flags, D3DCompile](size_t index) {
+			auto &shader = _pending_shaders[index];
+
+			shader.success = shader_cache::global().load_or_compile(shader.cache_key, shader.code, [&shader, flags, D3DCompile](std::vector<char> &data) {
+				com_ptr<ID3DBlob> code, errors;
+
+				const HRESULT hr = D3DCompile(shader.source.c_str(), shader.source.length(), nullptr, nullptr, nullptr, shader.entry_point->unique_name.c_str(), shader.profile.c_str(), flags, 0, &code, &errors);
+
+				if (errors != nullptr)
+				{
+					shader.errors.assign(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
+				}
+
+				if (FAILED(hr))
+				{
+					return false;
+				}
+
+				data.assign(static_cast<const char *>(code->GetBufferPointer()), static_cast<const char *>(code->GetBufferPointer()) + code->GetBufferSize());
+
+				return true;
+			});
+		});
+
+		for (auto &shader : _pending_shaders)
 		{
-			error(node->location, "'CreateShader' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
-			return;
+			_errors += shader.errors;
+
+			if (!shader.success)
+			{
+				error(shader.entry_point->location, "internal shader compilation failed");
+				continue;
+			}
+
+			HRESULT hr = S_OK;
+
+			const auto first_pass = shader.passes[0];
+
+			if (shader.shadertype == "vs")
+			{
+				hr = _runtime->_device->CreateVertexShader(shader.code.data(), shader.code.size(), &first_pass->vertex_shader);
+
+				for (size_t i = 1; i < shader.passes.size(); i++)
+				{
+					shader.passes[i]->vertex_shader = first_pass->vertex_shader;
+				}
+			}
+			else if (shader.shadertype == "ps")
+			{
+				hr = _runtime->_device->CreatePixelShader(shader.code.data(), shader.code.size(), &first_pass->pixel_shader);
+
+				for (size_t i = 1; i < shader.passes.size(); i++)
+				{
+					shader.passes[i]->pixel_shader = first_pass->pixel_shader;
+				}
+			}
+
+			if (FAILED(hr))
+			{
+				error(shader.entry_point->location, "'CreateShader' failed with error code " + std::to_string(static_cast<unsigned long>(hr)) + "!");
+			}
 		}
+
+		_pending_shaders.clear();
 	}
 }
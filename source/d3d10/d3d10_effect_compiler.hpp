@@ -57,21 +57,36 @@ namespace reshade::d3d10
 		void visit(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true);
 		void visit(std::stringstream &output, const reshadefx::nodes::function_declaration_node *node);
 
-		void visit_texture(const reshadefx::nodes::variable_declaration_node *node);
-		void visit_sampler(const reshadefx::nodes::variable_declaration_node *node);
+		void visit_texture(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node);
+		void visit_sampler(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node);
 		void visit_uniform(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_technique(const reshadefx::nodes::technique_declaration_node *node);
 		void visit_pass(const reshadefx::nodes::pass_declaration_node *node, d3d10_pass_data &pass);
 		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, d3d10_pass_data &pass);
+		void compile_pending_shaders();
+
+		struct pending_shader
+		{
+			const reshadefx::nodes::function_declaration_node *entry_point;
+			std::string shadertype, profile, source;
+			std::vector<d3d10_pass_data *> passes; // All passes using this shader, which is only compiled once for all of them
+			uint64_t cache_key = 0;
+			std::vector<char> code;
+			std::string errors;
+			bool success = false;
+		};
 
 		d3d10_runtime *_runtime;
 		bool _success = true;
 		const reshadefx::syntax_tree &_ast;
 		std::string &_errors;
 		std::stringstream _global_code, _global_uniforms;
+		std::vector<std::pair<const reshadefx::nodes::declaration_node *, std::string>> _global_declarations; // Code for each global variable and function, in order of declaration
 		bool _skip_shader_optimization, _is_in_parameter_block = false, _is_in_function_block = false;
 		size_t _uniform_storage_offset = 0, _constant_buffer_size = 0;
 		HMODULE _d3dcompiler_module = nullptr;
+		std::string _d3dcompiler_identity;
+		std::vector<pending_shader> _pending_shaders;
 #if RESHADE_DUMP_NATIVE_SHADERS
 		filesystem::path _dump_filename;
 		std::unordered_set<std::string> _dumped_shaders;
@@ -496,6 +496,25 @@ namespace reshade::d3d10
 		_effect_shader_resources[1] = _backbuffer_texture_srv[1];
 		_effect_shader_resources[2] = _depthstencil_texture_srv;
 	}
+	void d3d10_runtime::swap_effects()
+	{
+		runtime::swap_effects();
+
+		std::swap(_effect_sampler_states, _inactive_effects.sampler_states);
+		std::swap(_effect_sampler_descs, _inactive_effects.sampler_descs);
+		std::swap(_effect_shader_resources, _inactive_effects.shader_resources);
+		std::swap(_constant_buffers, _inactive_effects.constant_buffers);
+
+		// The depth buffer may have changed while these effects were inactive
+		if (_effect_shader_resources.size() > 2)
+		{
+			_effect_shader_resources[2] = _depthstencil_texture_srv;
+		}
+
+		for (const auto &technique : _techniques)
+			for (const auto &pass : technique.passes)
+				pass->as<d3d10_pass_data>()->shader_resources[2] = _depthstencil_texture_srv;
+	}
 	void d3d10_runtime::on_present()
 	{
 		if (!is_initialized())
@@ -557,6 +576,9 @@ namespace reshade::d3d10
 			_device->VSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D10SamplerState *const *>(_effect_sampler_states.data()));
 			_device->PSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D10SamplerState *const *>(_effect_sampler_states.data()));
 
+			// The copy of the back buffer shaders sample from still has the contents of the last frame
+			_is_backbuffer_copy_outdated = true;
+
 			on_present_effect();
 		}
 
@@ -823,26 +845,35 @@ namespace reshade::d3d10
 			const auto constant_buffer = _constant_buffers[technique.uniform_storage_index].get();
 
 			constant_buffer->GetDesc(&desc);
-			const HRESULT hr = constant_buffer->Map(D3D10_MAP_WRITE_DISCARD, 0, &data);
 
-			if (SUCCEEDED(hr))
-			{
-				CopyMemory(data, get_uniform_value_storage().data() + technique.uniform_storage_offset, desc.ByteWidth);
+			// The buffer is shared by all techniques in the effect and keeps its contents between frames, so it only has to be updated if any of its values changed
+			size_t modified_offset = technique.uniform_storage_offset, modified_size = desc.ByteWidth;
 
-				constant_buffer->Unmap();
-			}
-			else
+			if (consume_modified_uniform_range(modified_offset, modified_size))
 			{
-				LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
+				const HRESULT hr = constant_buffer->Map(D3D10_MAP_WRITE_DISCARD, 0, &data);
+
+				if (SUCCEEDED(hr))
+				{
+					CopyMemory(data, get_uniform_value_storage().data() + technique.uniform_storage_offset, desc.ByteWidth);
+
+					constant_buffer->Unmap();
+				}
+				else
+				{
+					LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
+
+					mark_uniform_storage_modified(modified_offset, modified_size);
+				}
 			}
 
 			_device->VSSetConstantBuffers(0, 1, &constant_buffer);
 			_device->PSSetConstantBuffers(0, 1, &constant_buffer);
 		}
 
-		for (const auto &pass_object : technique.passes)
+		for (const auto &scheduled : technique.schedule)
 		{
-			const d3d10_pass_data &pass = *pass_object->as<d3d10_pass_data>();
+			const d3d10_pass_data &pass = *technique.passes[scheduled.index]->as<d3d10_pass_data>();
 
 			// Setup states
 			_device->VSSetShader(pass.vertex_shader.get());
@@ -851,8 +882,13 @@ namespace reshade::d3d10
 			_device->OMSetBlendState(pass.blend_state.get(), nullptr, D3D10_DEFAULT_SAMPLE_MASK);
 			_device->OMSetDepthStencilState(pass.depth_stencil_state.get(), pass.stencil_reference);
 
-			// Save back buffer of previous pass
-			_device->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+			// Save back buffer of previous pass, but only if this pass samples it and it changed since the last copy
+			if (pass.samples_backbuffer && _is_backbuffer_copy_outdated)
+			{
+				_device->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+
+				_is_backbuffer_copy_outdated = false;
+			}
 
 			// Setup shader resources
 			_device->VSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), reinterpret_cast<ID3D10ShaderResourceView *const *>(pass.shader_resources.data()));
@@ -895,6 +931,11 @@ namespace reshade::d3d10
 			_vertices += 3;
 			_drawcalls += 1;
 
+			if (pass.writes_backbuffer)
+			{
+				_is_backbuffer_copy_outdated = true;
+			}
+
 			// Reset render targets
 			_device->OMSetRenderTargets(0, nullptr, nullptr);
 
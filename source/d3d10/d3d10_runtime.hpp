@@ -25,6 +25,7 @@ namespace reshade::d3d10
 		com_ptr<ID3D10DepthStencilState> depth_stencil_state;
 		UINT stencil_reference;
 		bool clear_render_targets;
+		bool samples_backbuffer = false, writes_backbuffer = false;
 		com_ptr<ID3D10RenderTargetView> render_targets[D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT];
 		com_ptr<ID3D10ShaderResourceView> render_target_resources[D3D10_SIMULTANEOUS_RENDER_TARGET_COUNT];
 		D3D10_VIEWPORT viewport;
@@ -46,6 +47,7 @@ namespace reshade::d3d10
 		bool on_init(const DXGI_SWAP_CHAIN_DESC &desc);
 		void on_reset();
 		void on_reset_effect() override;
+		void swap_effects() override;
 		void on_present();
 		void on_draw_call(UINT vertices);
 		void on_set_depthstencil_view(ID3D10DepthStencilView *&depthstencil);
@@ -72,6 +74,14 @@ namespace reshade::d3d10
 		std::vector<com_ptr<ID3D10Buffer>> _constant_buffers;
 
 	private:
+		struct
+		{
+			std::vector<com_ptr<ID3D10SamplerState>> sampler_states;
+			std::unordered_map<size_t, size_t> sampler_descs;
+			std::vector<com_ptr<ID3D10ShaderResourceView>> shader_resources;
+			std::vector<com_ptr<ID3D10Buffer>> constant_buffers;
+		} _inactive_effects;
+
 		struct depth_source_info
 		{
 			UINT width, height;
@@ -88,6 +98,7 @@ namespace reshade::d3d10
 		bool create_depthstencil_replacement(ID3D10DepthStencilView *depthstencil);
 
 		bool _is_multisampling_enabled = false;
+		bool _is_backbuffer_copy_outdated = true;
 		DXGI_FORMAT _backbuffer_format = DXGI_FORMAT_UNKNOWN;
 		d3d10_stateblock _stateblock;
 		com_ptr<ID3D10Texture2D> _backbuffer, _backbuffer_resolved;
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "effect_syntax_tree.hpp"
+#include "runtime_objects.hpp"
 #include <sstream>
 #include <unordered_set>
 
@@ -57,21 +58,42 @@ namespace reshade::d3d11
 		void visit(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node, bool with_type = true);
 		void visit(std::stringstream &output, const reshadefx::nodes::function_declaration_node *node);
 
-		void visit_texture(const reshadefx::nodes::variable_declaration_node *node);
-		void visit_sampler(const reshadefx::nodes::variable_declaration_node *node);
+		void visit_texture(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node);
+		void visit_sampler(std::stringstream &output, const reshadefx::nodes::variable_declaration_node *node);
 		void visit_uniform(const reshadefx::nodes::variable_declaration_node *node);
+		void layout_constant_buffers();
 		void visit_technique(const reshadefx::nodes::technique_declaration_node *node);
 		void visit_pass(const reshadefx::nodes::pass_declaration_node *node, d3d11_pass_data &pass);
 		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, const std::string &shadertype, d3d11_pass_data &pass);
+		void compile_pending_shaders();
+
+		struct pending_shader
+		{
+			const reshadefx::nodes::function_declaration_node *entry_point;
+			std::string shadertype, profile, source;
+			std::vector<d3d11_pass_data *> passes; // All passes using this shader, which is only compiled once for all of them
+			uint64_t cache_key = 0;
+			std::vector<char> code;
+			std::string errors;
+			bool success = false;
+		};
 
 		d3d11_runtime *_runtime;
 		bool _success = true;
 		const reshadefx::syntax_tree &_ast;
 		std::string &_errors;
-		std::stringstream _global_code, _global_uniforms;
+		// Uniforms bound to a source the runtime updates every frame are kept in a constant buffer of their own, so that the one with all other uniforms is only uploaded when a value is changed
+		enum constant_buffer_index { static_constants, dynamic_constants, constant_buffer_count };
+
+		std::stringstream _global_code, _global_uniforms[constant_buffer_count];
+		std::vector<std::pair<const reshadefx::nodes::declaration_node *, std::string>> _global_declarations; // Code for each global variable and function, in order of declaration
 		bool _skip_shader_optimization, _is_in_parameter_block = false, _is_in_function_block = false;
-		size_t _uniform_storage_offset = 0, _constant_buffer_size = 0;
+		size_t _constant_buffer_offset[constant_buffer_count] = { }, _constant_buffer_size[constant_buffer_count] = { };
+		std::vector<unsigned char> _constant_buffer_data[constant_buffer_count];
+		std::vector<std::pair<uniform, constant_buffer_index>> _uniforms; // Storage offsets are relative to the constant buffer until the size of all buffers is known
 		HMODULE _d3dcompiler_module = nullptr;
+		std::string _d3dcompiler_identity;
+		std::vector<pending_shader> _pending_shaders;
 #if RESHADE_DUMP_NATIVE_SHADERS
 		filesystem::path _dump_filename;
 		std::unordered_set<std::string> _dumped_shaders;
@@ -503,6 +503,25 @@ namespace reshade::d3d11
 		_effect_shader_resources[1] = _backbuffer_texture_srv[1];
 		_effect_shader_resources[2] = _depthstencil_texture_srv;
 	}
+	void d3d11_runtime::swap_effects()
+	{
+		runtime::swap_effects();
+
+		std::swap(_effect_sampler_states, _inactive_effects.sampler_states);
+		std::swap(_effect_sampler_descs, _inactive_effects.sampler_descs);
+		std::swap(_effect_shader_resources, _inactive_effects.shader_resources);
+		std::swap(_constant_buffers, _inactive_effects.constant_buffers);
+
+		// The depth buffer may have changed while these effects were inactive
+		if (_effect_shader_resources.size() > 2)
+		{
+			_effect_shader_resources[2] = _depthstencil_texture_srv;
+		}
+
+		for (const auto &technique : _techniques)
+			for (const auto &pass : technique.passes)
+				pass->as<d3d11_pass_data>()->shader_resources[2] = _depthstencil_texture_srv;
+	}
 	void d3d11_runtime::on_present(draw_call_tracker& tracker)
 	{
 		_vertices = tracker.vertices();
@@ -569,6 +588,9 @@ namespace reshade::d3d11
 			_immediate_context->VSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D11SamplerState *const *>(_effect_sampler_states.data()));
 			_immediate_context->PSSetSamplers(0, static_cast<UINT>(_effect_sampler_states.size()), reinterpret_cast<ID3D11SamplerState *const *>(_effect_sampler_states.data()));
 
+			// The copy of the back buffer shaders sample from still has the contents of the last frame
+			_is_backbuffer_copy_outdated = true;
+
 			on_present_effect();
 		}
 
@@ -731,64 +753,100 @@ namespace reshade::d3d11
 		bool is_default_depthstencil_cleared = false;
 
 		// Setup shader constants
-		if (technique.uniform_storage_index >= 0)
+		ID3D11Buffer *constant_buffers[2] = { };
+		const ptrdiff_t storage_indices[2] = { technique.uniform_storage_index, technique.dynamic_uniform_storage_index };
+		const ptrdiff_t storage_offsets[2] = { technique.uniform_storage_offset, technique.dynamic_uniform_storage_offset };
+
+		for (size_t i = 0; i < 2; i++)
 		{
-			const auto constant_buffer = _constant_buffers[technique.uniform_storage_index].get();
-			D3D11_MAPPED_SUBRESOURCE mapped;
+			if (storage_indices[i] < 0)
+			{
+				continue;
+			}
 
-			const HRESULT hr = _immediate_context->Map(constant_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+			const auto constant_buffer = constant_buffers[i] = _constant_buffers[storage_indices[i]].get();
+			D3D11_BUFFER_DESC desc;
+			constant_buffer->GetDesc(&desc);
 
-			if (SUCCEEDED(hr))
-			{
-				CopyMemory(mapped.pData, get_uniform_value_storage().data() + technique.uniform_storage_offset, mapped.RowPitch);
+			// The buffer is shared by all techniques in the effect and keeps its contents between frames, so it only has to be updated if any of its values changed
+			// Mapping with discard invalidates all of it, so the whole buffer is written even if only a part was modified
+			size_t modified_offset = storage_offsets[i], modified_size = desc.ByteWidth;
 
-				_immediate_context->Unmap(constant_buffer, 0);
-			}
-			else
+			if (consume_modified_uniform_range(modified_offset, modified_size))
 			{
-				LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
-			}
+				D3D11_MAPPED_SUBRESOURCE mapped;
+
+				const HRESULT hr = _immediate_context->Map(constant_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+
+				if (SUCCEEDED(hr))
+				{
+					CopyMemory(mapped.pData, get_uniform_value_storage().data() + storage_offsets[i], desc.ByteWidth);
+
+					_immediate_context->Unmap(constant_buffer, 0);
+				}
+				else
+				{
+					LOG(ERROR) << "Failed to map constant buffer! HRESULT is '" << std::hex << hr << std::dec << "'!";
 
-			_immediate_context->VSSetConstantBuffers(0, 1, &constant_buffer);
-			_immediate_context->PSSetConstantBuffers(0, 1, &constant_buffer);
+					mark_uniform_storage_modified(modified_offset, modified_size);
+				}
+			}
 		}
 
-		for (const auto &pass_object : technique.passes)
+		_immediate_context->VSSetConstantBuffers(0, 2, constant_buffers);
+		_immediate_context->PSSetConstantBuffers(0, 2, constant_buffers);
+
+		for (size_t schedule_index = 0; schedule_index < technique.schedule.size(); schedule_index++)
 		{
-			const d3d11_pass_data &pass = *pass_object->as<d3d11_pass_data>();
+			const auto &scheduled = technique.schedule[schedule_index];
+			const d3d11_pass_data &pass = *technique.passes[scheduled.index]->as<d3d11_pass_data>();
+
+			// The next pass renders to the same targets with the same states, so leave them bound and only update them after the last of those passes
+			const bool is_next_sharing_state = schedule_index + 1 < technique.schedule.size() && technique.schedule[schedule_index + 1].shares_state_with_previous;
 
 			// Setup states
 			_immediate_context->VSSetShader(pass.vertex_shader.get(), nullptr, 0);
 			_immediate_context->PSSetShader(pass.pixel_shader.get(), nullptr, 0);
 
-			_immediate_context->OMSetBlendState(pass.blend_state.get(), nullptr, D3D11_DEFAULT_SAMPLE_MASK);
-			_immediate_context->OMSetDepthStencilState(pass.depth_stencil_state.get(), pass.stencil_reference);
+			if (!scheduled.shares_state_with_previous)
+			{
+				_immediate_context->OMSetBlendState(pass.blend_state.get(), nullptr, D3D11_DEFAULT_SAMPLE_MASK);
+				_immediate_context->OMSetDepthStencilState(pass.depth_stencil_state.get(), pass.stencil_reference);
+			}
 
-			// Save back buffer of previous pass
-			_immediate_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+			// Save back buffer of previous pass, but only if this pass samples it and it changed since the last copy
+			if (pass.samples_backbuffer && _is_backbuffer_copy_outdated)
+			{
+				_immediate_context->CopyResource(_backbuffer_texture.get(), _backbuffer_resolved.get());
+
+				_is_backbuffer_copy_outdated = false;
+			}
 
 			// Setup shader resources
 			_immediate_context->VSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), reinterpret_cast<ID3D11ShaderResourceView *const *>(pass.shader_resources.data()));
 			_immediate_context->PSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), reinterpret_cast<ID3D11ShaderResourceView *const *>(pass.shader_resources.data()));
 
-			// Setup render targets
-			if (static_cast<UINT>(pass.viewport.Width) == _width && static_cast<UINT>(pass.viewport.Height) == _height)
+			// Setup render targets, unless they are still bound from the previous pass
+			if (!scheduled.shares_state_with_previous)
 			{
-				_immediate_context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, reinterpret_cast<ID3D11RenderTargetView *const *>(pass.render_targets), _default_depthstencil.get());
-
-				if (!is_default_depthstencil_cleared)
+				if (static_cast<UINT>(pass.viewport.Width) == _width && static_cast<UINT>(pass.viewport.Height) == _height)
 				{
-					is_default_depthstencil_cleared = true;
+					_immediate_context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, reinterpret_cast<ID3D11RenderTargetView *const *>(pass.render_targets), _default_depthstencil.get());
+
+					if (!is_default_depthstencil_cleared)
+					{
+						is_default_depthstencil_cleared = true;
 
-					_immediate_context->ClearDepthStencilView(_default_depthstencil.get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+						_immediate_context->ClearDepthStencilView(_default_depthstencil.get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+					}
+				}
+				else
+				{
+					_immediate_context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, reinterpret_cast<ID3D11RenderTargetView *const *>(pass.render_targets), nullptr);
 				}
-			}
-			else
-			{
-				_immediate_context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, reinterpret_cast<ID3D11RenderTargetView *const *>(pass.render_targets), nullptr);
-			}
 
-			_immediate_context->RSSetViewports(1, &pass.viewport);
+				_immediate_context->RSSetViewports(1, &pass.viewport);
+			}
 
 			if (pass.clear_render_targets)
 			{
@@ -808,14 +866,24 @@ namespace reshade::d3d11
 			_vertices += 3;
 			_drawcalls += 1;
 
-			// Reset render targets
-			_immediate_context->OMSetRenderTargets(0, nullptr, nullptr);
+			if (pass.writes_backbuffer)
+			{
+				_is_backbuffer_copy_outdated = true;
+			}
 
 			// Reset shader resources
 			ID3D11ShaderResourceView *null[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = { nullptr };
 			_immediate_context->VSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), null);
 			_immediate_context->PSSetShaderResources(0, static_cast<UINT>(pass.shader_resources.size()), null);
 
+			if (is_next_sharing_state)
+			{
+				continue;
+			}
+
+			// Reset render targets
+			_immediate_context->OMSetRenderTargets(0, nullptr, nullptr);
+
 			// Update shader resources
 			for (const auto &resource : pass.render_target_resources)
 			{
@@ -27,6 +27,7 @@ namespace reshade::d3d11
 		com_ptr<ID3D11DepthStencilState> depth_stencil_state;
 		UINT stencil_reference;
 		bool clear_render_targets;
+		bool samples_backbuffer = false, writes_backbuffer = false;
 		com_ptr<ID3D11RenderTargetView> render_targets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
 		com_ptr<ID3D11ShaderResourceView> render_target_resources[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
 		D3D11_VIEWPORT viewport;
@@ -48,6 +49,7 @@ namespace reshade::d3d11
 		bool on_init(const DXGI_SWAP_CHAIN_DESC &desc);
 		void on_reset();
 		void on_reset_effect() override;
+		void swap_effects() override;
 		void on_present(draw_call_tracker& tracker);
 		void capture_frame(uint8_t *buffer) const override;
 		bool load_effect(const reshadefx::syntax_tree &ast, std::string &errors) override;
@@ -70,6 +72,14 @@ namespace reshade::d3d11
 		std::vector<com_ptr<ID3D11Buffer>> _constant_buffers;
 
 	private:
+		struct
+		{
+			std::vector<com_ptr<ID3D11SamplerState>> sampler_states;
+			std::unordered_map<size_t, size_t> sampler_descs;
+			std::vector<com_ptr<ID3D11ShaderResourceView>> shader_resources;
+			std::vector<com_ptr<ID3D11Buffer>> constant_buffers;
+		} _inactive_effects;
+
 		bool init_backbuffer_texture();
 		bool init_default_depth_stencil();
 		bool init_fx_resources();
@@ -80,6 +90,7 @@ namespace reshade::d3d11
 		bool create_depthstencil_replacement(ID3D11DepthStencilView *depthstencil);
 
 		bool _is_multisampling_enabled = false;
+		bool _is_backbuffer_copy_outdated = true;
 		DXGI_FORMAT _backbuffer_format = DXGI_FORMAT_UNKNOWN;
 		d3d11_stateblock _stateblock;
 		com_ptr<ID3D11Texture2D> _backbuffer, _backbuffer_resolved;
@@ -5,6 +5,7 @@
 
 #include "d3d9_runtime.hpp"
 #include "d3d9_effect_compiler.hpp"
+#include "shader_cache.hpp"
 #include <assert.h>
 #include <iomanip>
 #include <fstream>
@@ -154,7 +155,7 @@ namespace reshade::d3d9
 #if RESHADE_DUMP_NATIVE_SHADERS
 		if (_ast.techniques.size() == 0)
 			return;
-		_dump_filename = _ast.techniques[0]->location.source;
+		_dump_filename = std::string(_ast.techniques[0]->location.source);
 		_dump_filename = "ReShade-ShaderDump-" + _dump_filename.filename_without_extension().string() + ".hlsl";
 
 		std::ofstream(_dump_filename.string(), std::ios::trunc);
@@ -175,6 +176,10 @@ namespace reshade::d3d9
 			return false;
 		}
 
+		// Different compiler versions produce different code, so cached shaders are only valid for the exact library they were compiled with
+		const auto d3dcompiler_path = filesystem::get_module_path(_d3dcompiler_module);
+		_d3dcompiler_identity = d3dcompiler_path.string() + '|' + std::to_string(filesystem::last_write_time(d3dcompiler_path));
+
 		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
 
 		for (auto node : _ast.structs)
@@ -229,11 +234,11 @@ namespace reshade::d3d9
 	{
 		_success = false;
 
-		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): error: " + message + '\n';
+		_errors += std::string(location.source) + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): error: " + message + '\n';
 	}
 	void d3d9_effect_compiler::warning(const location &location, const std::string &message)
 	{
-		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
+		_errors += std::string(location.source) + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
 	}
 
 	void d3d9_effect_compiler::visit(std::stringstream &output, const statement_node *node)
@@ -413,16 +418,16 @@ namespace reshade::d3d9
 			switch (node->type.basetype)
 			{
 				case type_node::datatype_bool:
-					output << (node->value_int[i] ? "true" : "false");
+					output << (node->value_int()[i] ? "true" : "false");
 					break;
 				case type_node::datatype_int:
-					output << node->value_int[i];
+					output << node->value_int()[i];
 					break;
 				case type_node::datatype_uint:
-					output << node->value_uint[i];
+					output << node->value_uint()[i];
 					break;
 				case type_node::datatype_float:
-					output << std::setprecision(8) << std::fixed << node->value_float[i];
+					output << std::setprecision(8) << std::fixed << node->value_float()[i];
 					break;
 			}
 
@@ -568,7 +573,7 @@ namespace reshade::d3d9
 			case binary_expression_node::bitwise_and:
 				if (node->operands[1]->id == nodeid::literal_expression && node->operands[1]->type.is_integral() && node->operands[1]->type.is_scalar())
 				{
-					const unsigned int value = static_cast<const literal_expression_node *>(node->operands[1])->value_uint[0];
+					const unsigned int value = static_cast<const literal_expression_node *>(node->operands[1])->value_uint()[0];
 
 					if (is_pow2(value + 1))
 					{
@@ -887,7 +892,7 @@ namespace reshade::d3d9
 			case intrinsic_expression_node::texture_gather:
 				if (node->arguments[2]->id == nodeid::literal_expression && node->arguments[2]->type.is_integral())
 				{
-					const int component = static_cast<const literal_expression_node *>(node->arguments[2])->value_int[0];
+					const int component = static_cast<const literal_expression_node *>(node->arguments[2])->value_int()[0];
 
 					output << "__tex2Dgather" << component << '(';
 					visit(output, node->arguments[0]);
@@ -903,7 +908,7 @@ namespace reshade::d3d9
 			case intrinsic_expression_node::texture_gather_offset:
 				if (node->arguments[3]->id == nodeid::literal_expression && node->arguments[3]->type.is_integral())
 				{
-					const int component = static_cast<const literal_expression_node *>(node->arguments[3])->value_int[0];
+					const int component = static_cast<const literal_expression_node *>(node->arguments[3])->value_int()[0];
 
 					output << "__tex2Dgather" << component << "offset(";
 					visit(output, node->arguments[0]);
@@ -2044,34 +2049,53 @@ namespace reshade::d3d9
 #endif
 
 		UINT flags = 0;
-		com_ptr<ID3DBlob> compiled, errors;
 
 		if (_skip_shader_optimization)
 		{
 			flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
 		}
 
-		const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
-		HRESULT hr = D3DCompile(source_str.c_str(), source_str.size(), nullptr, nullptr, nullptr, "__main", (shadertype + "_3_0").c_str(), flags, 0, &compiled, &errors);
+		const std::string profile = shadertype + "_3_0";
 
-		if (errors != nullptr)
-		{
-			_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
-		}
+		std::vector<char> compiled;
+		const uint64_t cache_key = shader_cache::make_key(source_str, "__main", profile, flags, _d3dcompiler_identity);
 
-		if (FAILED(hr))
+		const bool compile_success = shader_cache::global().load_or_compile(cache_key, compiled, [&](std::vector<char> &data) {
+			com_ptr<ID3DBlob> code, errors;
+
+			const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(_d3dcompiler_module, "D3DCompile"));
+			const HRESULT hr = D3DCompile(source_str.c_str(), source_str.size(), nullptr, nullptr, nullptr, "__main", profile.c_str(), flags, 0, &code, &errors);
+
+			if (errors != nullptr)
+			{
+				_errors.append(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize() - 1);
+			}
+
+			if (FAILED(hr))
+			{
+				return false;
+			}
+
+			data.assign(static_cast<const char *>(code->GetBufferPointer()), static_cast<const char *>(code->GetBufferPointer()) + code->GetBufferSize());
+
+			return true;
+		});
+
+		if (!compile_success)
 		{
 			error(node->location, "internal shader compilation failed");
 			return;
 		}
 
+		HRESULT hr = S_OK;
+
 		if (shadertype == "vs")
 		{
-			hr = _runtime->_device->CreateVertexShader(static_cast<const DWORD *>(compiled->GetBufferPointer()), &pass.vertex_shader);
+			hr = _runtime->_device->CreateVertexShader(reinterpret_cast<const DWORD *>(compiled.data()), &pass.vertex_shader);
 		}
 		else if (shadertype == "ps")
 		{
-			hr = _runtime->_device->CreatePixelShader(static_cast<const DWORD *>(compiled->GetBufferPointer()), &pass.pixel_shader);
+			hr = _runtime->_device->CreatePixelShader(reinterpret_cast<const DWORD *>(compiled.data()), &pass.pixel_shader);
 		}
 
 		if (FAILED(hr))
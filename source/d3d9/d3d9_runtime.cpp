@@ -609,9 +609,9 @@ namespace reshade::d3d9
 			_device->SetPixelShaderConstantF(0, uniform_storage_data, static_cast<UINT>(technique.uniform_storage_index));
 		}
 
-		for (const auto &pass_object : technique.passes)
+		for (const auto &scheduled : technique.schedule)
 		{
-			const d3d9_pass_data &pass = *pass_object->as<d3d9_pass_data>();
+			const d3d9_pass_data &pass = *technique.passes[scheduled.index]->as<d3d9_pass_data>();
 
 			// Setup states
 			pass.stateblock->Apply();
@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "dependency_graph.hpp"
+#include <algorithm>
+
+namespace reshade
+{
+	uint64_t dependency_graph::hash(const std::string &data)
+	{
+		uint64_t hash = 14695981039346656037ull;
+
+		for (const char c : data)
+		{
+			hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	void dependency_graph::update(const filesystem::path &target_path, std::vector<input> &&inputs)
+	{
+		const std::string target_key = make_key(target_path);
+		auto &target = _targets[target_key];
+
+		for (const auto &input : target.inputs)
+		{
+			_dependents[input.first].erase(target_key);
+		}
+
+		target.path = target_path;
+		target.inputs.clear();
+
+		for (const auto &input : inputs)
+		{
+			const std::string input_key = make_key(input.path);
+
+			target.inputs[input_key] = input.hash;
+
+			_dependents[input_key].insert(target_key);
+		}
+	}
+	void dependency_graph::clear()
+	{
+		_targets.clear();
+		_dependents.clear();
+	}
+
+	bool dependency_graph::has_dependents(const filesystem::path &path) const
+	{
+		const auto it = _dependents.find(make_key(path));
+
+		return it != _dependents.end() && !it->second.empty();
+	}
+	bool dependency_graph::is_built_from(const filesystem::path &target_path, const std::vector<input> &inputs) const
+	{
+		const auto target = _targets.find(make_key(target_path));
+
+		if (target == _targets.end() || target->second.inputs.size() != inputs.size())
+		{
+			return false;
+		}
+
+		for (const auto &input : inputs)
+		{
+			const auto it = target->second.inputs.find(make_key(input.path));
+
+			if (it == target->second.inputs.end() || it->second != input.hash)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+	std::vector<filesystem::path> dependency_graph::find_outdated(const std::vector<input> &modifications) const
+	{
+		std::unordered_set<std::string> outdated;
+
+		for (const auto &modification : modifications)
+		{
+			const std::string input_key = make_key(modification.path);
+			const auto dependents = _dependents.find(input_key);
+
+			if (dependents == _dependents.end())
+			{
+				continue;
+			}
+
+			// Every target lists all of its transitive inputs, so the targets that directly record the file are all that is affected
+			for (const auto &target_key : dependents->second)
+			{
+				if (_targets.at(target_key).inputs.at(input_key) != modification.hash)
+				{
+					outdated.insert(target_key);
+				}
+			}
+		}
+
+		std::vector<filesystem::path> result;
+		result.reserve(outdated.size());
+
+		for (const auto &target_key : outdated)
+		{
+			result.push_back(_targets.at(target_key).path);
+		}
+
+		return result;
+	}
+	std::vector<filesystem::path> dependency_graph::list_inputs() const
+	{
+		std::vector<filesystem::path> result;
+		result.reserve(_dependents.size());
+
+		// The keys are normalized paths, which still refer to the same file since file names are case-insensitive
+		for (const auto &dependents : _dependents)
+		{
+			if (!dependents.second.empty())
+			{
+				result.push_back(dependents.first);
+			}
+		}
+
+		return result;
+	}
+
+	std::string dependency_graph::make_key(const filesystem::path &path)
+	{
+		// File names are case-insensitive and may use either kind of separator, so normalize both to get a single node per file
+		std::string key = path.string();
+
+		std::transform(key.begin(), key.end(), key.begin(), [](char c) { return c == '/' ? '\\' : (c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c); });
+
+		return key;
+	}
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include "filesystem.hpp"
+
+namespace reshade
+{
+	/// <summary>
+	/// Records the source files each effect was built from, together with a hash of their contents, so that a modification on disk can be traced back to exactly the effects it affects.
+	/// </summary>
+	class dependency_graph
+	{
+	public:
+		struct input
+		{
+			filesystem::path path;
+			uint64_t hash;
+		};
+
+		/// <summary>
+		/// Compute the hash of file contents that is stored with each input.
+		/// </summary>
+		/// <param name="data">The file contents.</param>
+		static uint64_t hash(const std::string &data);
+
+		/// <summary>
+		/// Replace the inputs of a target. The list is expected to contain all files the target depends on, directly or through other includes, including the target file itself.
+		/// </summary>
+		/// <param name="target">The path to the effect file.</param>
+		/// <param name="inputs">The files the effect was built from and the hashes of the contents that were used.</param>
+		void update(const filesystem::path &target, std::vector<input> &&inputs);
+		/// <summary>
+		/// Remove all targets and their inputs.
+		/// </summary>
+		void clear();
+
+		/// <summary>
+		/// Returns a boolean value indicating whether any target depends on the specified file.
+		/// </summary>
+		/// <param name="path">The path to the file.</param>
+		bool has_dependents(const filesystem::path &path) const;
+		/// <summary>
+		/// Returns a boolean value indicating whether the inputs recorded for a target are exactly the specified ones.
+		/// </summary>
+		/// <param name="target">The path to the effect file.</param>
+		/// <param name="inputs">The files and hashes to compare with.</param>
+		bool is_built_from(const filesystem::path &target, const std::vector<input> &inputs) const;
+		/// <summary>
+		/// Find all targets that were built from a different version of any of the specified files. Files whose contents did not change (e.g. because an editor saved without modifications) are ignored.
+		/// </summary>
+		/// <param name="modifications">The modified files and the hashes of their current contents.</param>
+		/// <returns>The paths to the targets that need to be built again.</returns>
+		std::vector<filesystem::path> find_outdated(const std::vector<input> &modifications) const;
+		/// <summary>
+		/// Returns the paths to all files any target depends on, for when it is not known which of them were modified.
+		/// </summary>
+		std::vector<filesystem::path> list_inputs() const;
+
+		size_t size() const { return _targets.size(); }
+
+	private:
+		struct target
+		{
+			filesystem::path path;
+			std::unordered_map<std::string, uint64_t> inputs;
+		};
+
+		static std::string make_key(const filesystem::path &path);
+
+		std::unordered_map<std::string, target> _targets;
+		std::unordered_map<std::string, std::unordered_set<std::string>> _dependents;
+	};
+}
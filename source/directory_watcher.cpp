@@ -12,23 +12,30 @@ namespace reshade::filesystem
 {
 	directory_watcher::directory_watcher(const path &path) :
 		_path(path),
-		_buffer(sizeof(FILE_NOTIFY_INFORMATION) + MAX_PATH * sizeof(WCHAR))
+		_buffer(64 * 1024), // Large enough to hold the changes of saving many files at once, but not larger than the limit for watching network shares
+		_overlapped(std::make_unique<OVERLAPPED>())
 	{
 		_file_handle = CreateFileW(path.wstring().c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
 		_completion_handle = CreateIoCompletionPort(_file_handle, nullptr, reinterpret_cast<ULONG_PTR>(_file_handle), 1);
 
-		OVERLAPPED overlapped = { };
-		ReadDirectoryChangesW(_file_handle, _buffer.data(), static_cast<DWORD>(_buffer.size()), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, &overlapped, nullptr);
+		ReadDirectoryChangesW(_file_handle, _buffer.data(), static_cast<DWORD>(_buffer.size()), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, _overlapped.get(), nullptr);
 	}
 	directory_watcher::~directory_watcher()
 	{
 		CancelIo(_file_handle);
 
+		// Wait for the cancelled read to complete, so that it does not write to the buffer after it was freed
+		if (!HasOverlappedIoCompleted(_overlapped.get()))
+		{
+			DWORD transferred;
+			GetOverlappedResult(_file_handle, _overlapped.get(), &transferred, TRUE);
+		}
+
 		CloseHandle(_file_handle);
 		CloseHandle(_completion_handle);
 	}
 
-	bool directory_watcher::check(std::vector<path> &modifications)
+	bool directory_watcher::check(std::vector<path> &modifications, bool &overflowed)
 	{
 		DWORD transferred;
 		ULONG_PTR key;
@@ -39,35 +46,31 @@ namespace reshade::filesystem
 			return false;
 		}
 
-		static DWORD s_last_tick_count = 0;
-		static std::string s_last_filename;
-
-		auto record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(_buffer.data());
-		const auto current_tick_count = GetTickCount();
-
-		while (true)
+		// Nothing was transferred if more changes occurred than fit into the buffer, in which case its contents are stale and the changes are lost, so let the caller know it has to look at all files instead
+		if (transferred == 0)
 		{
-			const std::string filename = utf16_to_utf8(record->FileName, record->FileNameLength / sizeof(WCHAR));
+			overflowed = true;
+		}
+		else
+		{
+			auto record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(_buffer.data());
 
-			if (filename != s_last_filename || s_last_tick_count + 2000 < current_tick_count)
+			while (true)
 			{
-				s_last_filename = filename;
-				s_last_tick_count = current_tick_count;
+				modifications.push_back(_path / utf16_to_utf8(record->FileName, record->FileNameLength / sizeof(WCHAR)));
 
-				modifications.push_back(_path / filename);
-			}
+				if (record->NextEntryOffset == 0)
+				{
+					break;
+				}
 
-			if (record->NextEntryOffset == 0)
-			{
-				break;
+				record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(reinterpret_cast<const BYTE *>(record) + record->NextEntryOffset);
 			}
-
-			record = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(reinterpret_cast<const BYTE *>(record) + record->NextEntryOffset);
 		}
 
-		overlapped->hEvent = nullptr;
+		*_overlapped = { };
 
-		ReadDirectoryChangesW(_file_handle, _buffer.data(), static_cast<DWORD>(_buffer.size()), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, overlapped, nullptr);
+		ReadDirectoryChangesW(_file_handle, _buffer.data(), static_cast<DWORD>(_buffer.size()), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, _overlapped.get(), nullptr);
 
 		return true;
 	}
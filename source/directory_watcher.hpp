@@ -6,6 +6,11 @@
 #pragma once
 
 #include "filesystem.hpp"
+#include <memory>
+
+#pragma region Forward Declarations
+struct _OVERLAPPED;
+#pragma endregion
 
 namespace reshade::filesystem
 {
@@ -13,13 +18,17 @@ namespace reshade::filesystem
 	{
 	public:
 		explicit directory_watcher(const path &path);
+		directory_watcher(const directory_watcher &) = delete;
 		~directory_watcher();
 
-		bool check(std::vector<path> &modifications);
+		directory_watcher &operator=(const directory_watcher &) = delete;
+
+		bool check(std::vector<path> &modifications, bool &overflowed);
 
 	private:
 		path _path;
 		std::vector<uint8_t> _buffer;
+		std::unique_ptr<_OVERLAPPED> _overlapped; // Has to stay alive as long as a read is pending, since the system writes the result to it when the read completes
 		void *_file_handle, *_completion_handle;
 	};
 }
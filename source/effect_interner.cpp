@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_interner.hpp"
+#include <mutex>
+#include <assert.h>
+
+namespace reshadefx
+{
+	namespace
+	{
+		/// <summary>
+		/// The atoms the current thread looked up before, keyed by views of the interned strings. Parsing looks up the same few names over and over again, so most lookups end here without touching the lock shared by all threads.
+		/// </summary>
+		struct thread_cache
+		{
+			const interner *owner = nullptr;
+			std::unordered_map<std::string_view, atom> atoms;
+		};
+
+		thread_cache &get_thread_cache(const interner *owner)
+		{
+			thread_local thread_cache s_cache;
+
+			// Only the process-wide interner is ever used in practice, but keep atoms of different tables apart regardless
+			if (s_cache.owner != owner)
+			{
+				s_cache.owner = owner;
+				s_cache.atoms.clear();
+			}
+
+			return s_cache;
+		}
+	}
+
+	interner &interner::global()
+	{
+		static interner s_interner;
+
+		return s_interner;
+	}
+
+	interner::interner()
+	{
+		_names.emplace_back();
+		_atoms.emplace(_names.back(), empty);
+	}
+
+	atom interner::intern(std::string_view name)
+	{
+		auto &cache = get_thread_cache(this);
+
+		if (const auto it = cache.atoms.find(name); it != cache.atoms.end())
+		{
+			return it->second;
+		}
+
+		// Names this thread did not see yet were usually interned by another one already, so try that first without blocking other threads
+		{ const std::shared_lock<std::shared_mutex> lock(_mutex);
+			const auto it = _atoms.find(name);
+
+			if (it != _atoms.end())
+			{
+				cache.atoms.insert(*it);
+				return it->second;
+			}
+		}
+
+		const std::unique_lock<std::shared_mutex> lock(_mutex);
+
+		auto it = _atoms.find(name);
+
+		if (it == _atoms.end())
+		{
+			// Strings in a deque are never moved when new ones are added, so the views used as keys stay valid
+			const atom atom = static_cast<reshadefx::atom>(_names.size());
+			_names.emplace_back(name);
+			it = _atoms.emplace(_names.back(), atom).first;
+		}
+
+		cache.atoms.insert(*it);
+
+		return it->second;
+	}
+	atom interner::find(std::string_view name) const
+	{
+		auto &cache = get_thread_cache(this);
+
+		if (const auto it = cache.atoms.find(name); it != cache.atoms.end())
+		{
+			return it->second;
+		}
+
+		const std::shared_lock<std::shared_mutex> lock(_mutex);
+
+		const auto it = _atoms.find(name);
+
+		if (it == _atoms.end())
+		{
+			return empty;
+		}
+
+		cache.atoms.insert(*it);
+
+		return it->second;
+	}
+	std::string_view interner::name(atom atom) const
+	{
+		const std::shared_lock<std::shared_mutex> lock(_mutex);
+
+		assert(atom < _names.size());
+
+		return _names[atom];
+	}
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// A unique identifier for an interned string. Equal strings are always assigned the same atom, so names can be compared as integers.
+	/// </summary>
+	using atom = unsigned int;
+
+	/// <summary>
+	/// A thread-safe table of interned identifier strings, which is shared by all lexers, pre-processors and symbol tables in the process.
+	/// Atoms stay valid for the lifetime of the process, so they can be cached across effect reloads.
+	/// </summary>
+	class interner
+	{
+	public:
+		/// <summary>
+		/// The atom of the empty string, which is never handed out for anything else.
+		/// </summary>
+		static constexpr atom empty = 0;
+
+		/// <summary>
+		/// Returns the process-wide interner instance.
+		/// </summary>
+		static interner &global();
+
+		interner();
+		interner(const interner &) = delete;
+
+		interner &operator=(const interner &) = delete;
+
+		/// <summary>
+		/// Get the atom for a string, adding it to the table if it was not interned before.
+		/// </summary>
+		/// <param name="name">The string to intern.</param>
+		/// <returns>The atom identifying the string.</returns>
+		atom intern(std::string_view name);
+		/// <summary>
+		/// Get the atom for a string without adding it to the table.
+		/// </summary>
+		/// <param name="name">The string to look up.</param>
+		/// <returns>The atom identifying the string, or "interner::empty" if it was never interned (so nothing can refer to it).</returns>
+		atom find(std::string_view name) const;
+		/// <summary>
+		/// Get a copy of a string that stays valid for the lifetime of the process, adding it to the table if it was not interned before.
+		/// </summary>
+		/// <param name="name">The string to intern.</param>
+		/// <returns>A view of the interned string.</returns>
+		std::string_view intern_string(std::string_view name) { return this->name(intern(name)); }
+		/// <summary>
+		/// Get the string an atom was created from.
+		/// </summary>
+		/// <param name="atom">The atom to look up.</param>
+		/// <returns>A view of the interned string, which stays valid for the lifetime of the process.</returns>
+		std::string_view name(atom atom) const;
+
+	private:
+		mutable std::shared_mutex _mutex;
+		std::deque<std::string> _names;
+		std::unordered_map<std::string_view, atom> _atoms;
+	};
+}
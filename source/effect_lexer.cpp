@@ -4,7 +4,12 @@
  */
 
 #include "effect_lexer.hpp"
-#include <unordered_map>
+#include <assert.h>
+#include <iterator>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <emmintrin.h>
+#endif
 
 namespace reshadefx
 {
@@ -32,7 +37,13 @@ namespace reshadefx
 			IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT, IDENT,
 			IDENT, IDENT, IDENT,   '{',   '|',   '}',   '~',  0x00,  0x00,  0x00,
 		};
-		const std::unordered_map<std::string, tokenid> keyword_lookup = {
+		struct keyword
+		{
+			std::string_view name;
+			tokenid id;
+		};
+
+		constexpr keyword keyword_list[] = {
 			{ "asm", tokenid::reserved },
 			{ "asm_fragment", tokenid::reserved },
 			{ "auto", tokenid::reserved },
@@ -195,7 +206,7 @@ namespace reshadefx
 			{ "volatile", tokenid::volatile_ },
 			{ "while", tokenid::while_ }
 		};
-		const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
+		constexpr keyword pp_directive_list[] = {
 			{ "define", tokenid::hash_def },
 			{ "undef", tokenid::hash_undef },
 			{ "if", tokenid::hash_if },
@@ -210,6 +221,155 @@ namespace reshadefx
 			{ "include", tokenid::hash_include },
 		};
 
+		constexpr uint32_t hash_name(std::string_view name, uint32_t seed)
+		{
+			// FNV-1a with a custom offset basis, which is chosen so that the keyword tables below hash without collisions
+			uint32_t hash = seed;
+			for (const char c : name)
+				hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+			return hash;
+		}
+
+		/// <summary>
+		/// A perfect hash table over a constant list of names, which is built at compile time. Every name is mapped to its own slot, so a lookup needs to hash and compare exactly once.
+		/// </summary>
+		template <size_t SIZE, size_t COUNT>
+		struct perfect_hash_table
+		{
+			static_assert(COUNT < 0xFF);
+
+			constexpr perfect_hash_table(const keyword (&list)[COUNT], uint32_t seed) : list(list), seed(seed)
+			{
+				for (size_t i = 0; i < COUNT; ++i)
+				{
+					uint8_t &slot = slots[hash_name(list[i].name, seed) % SIZE];
+
+					if (slot != 0)
+						collision = true;
+
+					slot = static_cast<uint8_t>(i + 1); // Zero marks an empty slot
+				}
+			}
+
+			constexpr tokenid find(std::string_view name, tokenid default_id) const
+			{
+				const uint8_t slot = slots[hash_name(name, seed) % SIZE];
+
+				return slot != 0 && list[slot - 1].name == name ? list[slot - 1].id : default_id;
+			}
+
+			const keyword (&list)[COUNT];
+			uint32_t seed;
+			uint8_t slots[SIZE] = {};
+			bool collision = false;
+		};
+
+		constexpr perfect_hash_table<2048, std::size(keyword_list)> keyword_lookup(keyword_list, 0x811c9ec4);
+		constexpr perfect_hash_table<64, std::size(pp_directive_list)> pp_directive_lookup(pp_directive_list, 0x811c9dc6);
+
+		static_assert(!keyword_lookup.collision, "keyword hash seed has to be updated after changing the keyword list");
+		static_assert(!pp_directive_lookup.collision, "directive hash seed has to be updated after changing the directive list");
+
+#if defined(_M_IX86) || defined(_M_X64)
+		// All x86 processors capable of running ReShade support SSE2, so there is no need to check for it at runtime
+		inline unsigned int first_set_bit(unsigned int mask)
+		{
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+		}
+
+		inline unsigned int match_space(__m128i block)
+		{
+			// Matches the same characters as "SPACE" in the type lookup table, i.e. ' ' and '\t', '\v', '\f', '\r' (but not '\n')
+			const __m128i is_blank = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+			const __m128i is_control = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(block, _mm_set1_epi8('\r' + 1)));
+			const __m128i is_newline = _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'));
+
+			return _mm_movemask_epi8(_mm_or_si128(is_blank, _mm_andnot_si128(is_newline, is_control)));
+		}
+		inline unsigned int match_identifier(__m128i block)
+		{
+			// Matches the same characters as "IDENT" and "DIGIT" in the type lookup table, i.e. [A-Za-z0-9_]
+			// Setting bit 5 folds upper case letters onto lower case ones without mapping any other character into that range
+			// Characters above 0x7F are negative in the signed comparisons below, so they never match
+			const __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+			const __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+			const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(block, _mm_set1_epi8('9' + 1)));
+			const __m128i is_underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+
+			return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(is_alpha, is_digit), is_underscore));
+		}
+#endif
+
+		/// <summary>
+		/// Find the end of a run of whitespace characters (excluding new lines) in the range [cur, end).
+		/// </summary>
+		const char *find_space_end(const char *cur, const char *end)
+		{
+#if defined(_M_IX86) || defined(_M_X64)
+			for (; end - cur >= 16; cur += 16)
+			{
+				if (const unsigned int mask = ~match_space(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cur))) & 0xFFFF; mask != 0)
+				{
+					return cur + first_set_bit(mask);
+				}
+			}
+#endif
+			while (cur < end && type_lookup[static_cast<uint8_t>(*cur)] == SPACE)
+			{
+				cur++;
+			}
+
+			return cur;
+		}
+		/// <summary>
+		/// Find the end of a run of identifier characters (letters, digits and underscores) in the range [cur, end).
+		/// </summary>
+		const char *find_identifier_end(const char *cur, const char *end)
+		{
+#if defined(_M_IX86) || defined(_M_X64)
+			for (; end - cur >= 16; cur += 16)
+			{
+				if (const unsigned int mask = ~match_identifier(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cur))) & 0xFFFF; mask != 0)
+				{
+					return cur + first_set_bit(mask);
+				}
+			}
+#endif
+			while (cur < end && (type_lookup[static_cast<uint8_t>(*cur)] == IDENT || type_lookup[static_cast<uint8_t>(*cur)] == DIGIT))
+			{
+				cur++;
+			}
+
+			return cur;
+		}
+		/// <summary>
+		/// Find the first occurrence of either of two characters in the range [cur, end), or return end if there is none.
+		/// </summary>
+		const char *find_either(const char *cur, const char *end, char a, char b)
+		{
+#if defined(_M_IX86) || defined(_M_X64)
+			const __m128i match_a = _mm_set1_epi8(a), match_b = _mm_set1_epi8(b);
+
+			for (; end - cur >= 16; cur += 16)
+			{
+				const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+
+				if (const unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, match_a), _mm_cmpeq_epi8(block, match_b))); mask != 0)
+				{
+					return cur + first_set_bit(mask);
+				}
+			}
+#endif
+			while (cur < end && *cur != a && *cur != b)
+			{
+				cur++;
+			}
+
+			return cur;
+		}
+
 		inline bool is_octal_digit(char c)
 		{
 			return static_cast<unsigned>(c - '0') < 8;
@@ -256,53 +416,163 @@ namespace reshadefx
 
 			return n;
 		}
+		size_t scan_string_literal(const char *const begin, const char *const input_end, bool escape, std::string &value)
+		{
+			auto end = begin + 1;
+
+			for (char c = *end; c != '"'; c = *++end)
+			{
+				if (c == '\n' || end >= input_end)
+				{
+					end--;
+					break;
+				}
+				if (c == '\\' && end[1] == '\n')
+				{
+					end++;
+					continue;
+				}
+
+				if (c == '\\' && escape)
+				{
+					unsigned int n = 0;
+
+					switch (c = *++end)
+					{
+						case '0':
+						case '1':
+						case '2':
+						case '3':
+						case '4':
+						case '5':
+						case '6':
+						case '7':
+							for (unsigned int i = 0; i < 3 && is_octal_digit(*end) && end < input_end; i++)
+							{
+								c = *end++;
+								n = (n << 3) | (c - '0');
+							}
+							c = static_cast<char>(n & 0xFF);
+							end--;
+							break;
+						case 'a':
+							c = '\a';
+							break;
+						case 'b':
+							c = '\b';
+							break;
+						case 'f':
+							c = '\f';
+							break;
+						case 'n':
+							c = '\n';
+							break;
+						case 'r':
+							c = '\r';
+							break;
+						case 't':
+							c = '\t';
+							break;
+						case 'v':
+							c = '\v';
+							break;
+						case 'x':
+							if (is_hexadecimal_digit(*++end))
+							{
+								while (is_hexadecimal_digit(*end) && end < input_end)
+								{
+									c = *end++;
+									n = (n << 4) | (is_decimal_digit(c) ? c - '0' : c - 55 - 32 * (c & 0x20));
+								}
+
+								c = static_cast<char>(n);
+							}
+							end--;
+							break;
+					}
+				}
+
+				value += c;
+			}
+
+			return end - begin + 1;
+		}
 	}
 
 	lexer::lexer(const std::string &source, bool ignore_whitespace, bool ignore_pp_directives, bool ignore_keywords, bool escape_string_literals) :
 		_input(source),
+		_source(_input),
+		_ignore_whitespace(ignore_whitespace),
+		_ignore_pp_directives(ignore_pp_directives),
+		_ignore_keywords(ignore_keywords),
+		_escape_string_literals(escape_string_literals),
+		_borrowed_input(false)
+	{
+		_cur = _source.data();
+		_end = _cur + _source.size();
+	}
+	lexer::lexer(std::string_view source, bool ignore_whitespace, bool ignore_pp_directives, bool ignore_keywords, bool escape_string_literals) :
+		_source(source),
 		_ignore_whitespace(ignore_whitespace),
 		_ignore_pp_directives(ignore_pp_directives),
 		_ignore_keywords(ignore_keywords),
-		_escape_string_literals(escape_string_literals)
+		_escape_string_literals(escape_string_literals),
+		_borrowed_input(true)
 	{
-		_cur = _input.data();
-		_end = _cur + _input.size();
+		assert(source.data()[source.size()] == '\0');
+
+		_cur = _source.data();
+		_end = _cur + _source.size();
 	}
 	lexer::lexer(const lexer &lexer) :
 		_input(lexer._input),
+		_source(lexer._borrowed_input ? lexer._source : _input),
 		_cur_location(lexer._cur_location),
 		_ignore_whitespace(lexer._ignore_whitespace),
 		_ignore_pp_directives(lexer._ignore_pp_directives),
 		_ignore_keywords(lexer._ignore_keywords),
-		_escape_string_literals(lexer._escape_string_literals)
+		_escape_string_literals(lexer._escape_string_literals),
+		_borrowed_input(lexer._borrowed_input)
 	{
-		_cur = _input.data() + (lexer._cur - lexer._input.data());
-		_end = _input.data() + _input.size();
+		_cur = _source.data() + (lexer._cur - lexer._source.data());
+		_end = _source.data() + _source.size();
 	}
 
 	lexer &lexer::operator=(const lexer &lexer)
 	{
 		_input = lexer._input;
+		_source = lexer._borrowed_input ? lexer._source : _input;
 		_cur_location = lexer._cur_location;
-		_cur = _input.data() + (lexer._cur - lexer._input.data());
-		_end = _input.data() + _input.size();
+		_cur = _source.data() + (lexer._cur - lexer._source.data());
+		_end = _source.data() + _source.size();
 		_ignore_whitespace = lexer._ignore_whitespace;
 		_ignore_pp_directives = lexer._ignore_pp_directives;
 		_ignore_keywords = lexer._ignore_keywords;
 		_escape_string_literals = lexer._escape_string_literals;
+		_borrowed_input = lexer._borrowed_input;
 
 		return *this;
 	}
 
+	std::string lexer::unescape_string_literal(std::string_view literal)
+	{
+		std::string value;
+		scan_string_literal(literal.data(), literal.data() + literal.size(), true, value);
+
+		return value;
+	}
+
 	token lexer::lex()
 	{
 		bool is_at_line_begin = _cur_location.column <= 1;
 		token tok;
 	next_token:
 		tok.location = _cur_location;
-		tok.offset = _cur - _input.data();
+		tok.offset = _cur - _source.data();
 		tok.length = 1;
 		tok.literal_as_double = 0;
+		tok.literal_as_atom = interner::empty;
+		tok.literal_as_view = std::string_view();
 
 		switch (type_lookup[*_cur])
 		{
@@ -314,6 +584,7 @@ namespace reshadefx
 				if (_ignore_whitespace || is_at_line_begin || *_cur == '\n')
 					goto next_token;
 				tok.id = tokenid::space;
+				tok.literal_as_view = _source.substr(tok.offset, 1);
 				return tok;
 			case '\n':
 				_cur++;
@@ -323,6 +594,7 @@ namespace reshadefx
 				if (_ignore_whitespace)
 					goto next_token;
 				tok.id = tokenid::end_of_line;
+				tok.literal_as_view = _source.substr(tok.offset, 1);
 				return tok;
 			case DIGIT:
 				parse_numeric_literal(tok);
@@ -430,6 +702,14 @@ namespace reshadefx
 				{
 					while (_cur < _end)
 					{
+						// Comment bodies can be long, so jump straight to the next character that is of interest
+						skip(find_either(_cur, _end, '*', '\n') - _cur);
+
+						if (_cur >= _end)
+						{
+							break;
+						}
+
 						if (*_cur == '\n')
 						{
 							_cur_location.line++;
@@ -541,11 +821,30 @@ namespace reshadefx
 				break;
 		}
 
+		// Pre-processor directives already point at the directive name, everything else spans the raw token characters
+		if (tok.literal_as_view.data() == nullptr)
+		{
+			tok.literal_as_view = std::string_view(_cur, tok.length);
+		}
+
 		skip(tok.length);
 
 		return tok;
 	}
 
+	void lexer::restore(const checkpoint &checkpoint)
+	{
+		assert(checkpoint.cur >= _source.data() && checkpoint.cur <= _end);
+
+		_cur = checkpoint.cur;
+		_cur_location = checkpoint.location;
+	}
+
+	tokenid lexer::find_keyword(std::string_view identifier)
+	{
+		return keyword_lookup.find(identifier, tokenid::identifier);
+	}
+
 	void lexer::skip(size_t length)
 	{
 		_cur += length;
@@ -553,39 +852,36 @@ namespace reshadefx
 	}
 	void lexer::skip_space()
 	{
-		while (type_lookup[*_cur] == SPACE && _cur < _end)
-		{
-			skip(1);
-		}
+		skip(find_space_end(_cur, _end) - _cur);
 	}
 	void lexer::skip_to_next_line()
 	{
-		while (*_cur != '\n' && _cur < _end)
-		{
-			skip(1);
-		}
+		skip(find_either(_cur, _end, '\n', '\n') - _cur);
 	}
 
 	void lexer::parse_identifier(token &tok) const
 	{
-		auto *const begin = _cur, *end = begin;
-
-		do end++; while (type_lookup[*end] == IDENT || type_lookup[*end] == DIGIT);
+		auto *const begin = _cur, *const end = find_identifier_end(begin + 1, _end);
 
 		tok.id = tokenid::identifier;
 		tok.length = end - begin;
-		tok.literal_as_string.assign(begin, end);
+		tok.literal_as_view = std::string_view(begin, tok.length);
 
-		if (_ignore_keywords)
+		// Only materialize the identifier string when the input is owned, lexers over borrowed input hand out spans instead
+		if (!_borrowed_input)
 		{
-			return;
+			tok.literal_as_string.assign(begin, end);
 		}
 
-		const auto it = keyword_lookup.find(tok.literal_as_string);
+		if (!_ignore_keywords)
+		{
+			tok.id = keyword_lookup.find(tok.literal_as_view, tokenid::identifier);
+		}
 
-		if (it != keyword_lookup.end())
+		// Keywords are never looked up by name later on, so only intern real identifiers
+		if (tok.id == tokenid::identifier)
 		{
-			tok.id = it->second;
+			tok.literal_as_atom = interner::global().intern(tok.literal_as_view);
 		}
 	}
 	bool lexer::parse_pp_directive(token &tok)
@@ -594,15 +890,13 @@ namespace reshadefx
 		skip_space();
 		parse_identifier(tok);
 
-		const auto it = pp_directive_lookup.find(tok.literal_as_string);
-
-		if (it != pp_directive_lookup.end())
+		if (const tokenid directive = pp_directive_lookup.find(tok.literal_as_view, tokenid::unknown); directive != tokenid::unknown)
 		{
-			tok.id = it->second;
+			tok.id = directive;
 
 			return true;
 		}
-		else if (tok.literal_as_string == "line")
+		else if (tok.literal_as_view == "line")
 		{
 			skip(tok.length);
 			skip_space();
@@ -623,7 +917,7 @@ namespace reshadefx
 				token temptok;
 				parse_string_literal(temptok, false);
 
-				_cur_location.source = temptok.literal_as_string;
+				_cur_location.source = interner::global().intern_string(temptok.literal_as_string);
 			}
 
 			return false;
@@ -635,85 +929,9 @@ namespace reshadefx
 	}
 	void lexer::parse_string_literal(token &tok, bool escape) const
 	{
-		auto *const begin = _cur, *end = begin + 1;
-
-		for (char c = *end; c != '"'; c = *++end)
-		{
-			if (c == '\n' || end >= _end)
-			{
-				end--;
-				break;
-			}
-			if (c == '\\' && end[1] == '\n')
-			{
-				end++;
-				continue;
-			}
-
-			if (c == '\\' && escape)
-			{
-				unsigned int n = 0;
-
-				switch (c = *++end)
-				{
-					case '0':
-					case '1':
-					case '2':
-					case '3':
-					case '4':
-					case '5':
-					case '6':
-					case '7':
-						for (unsigned int i = 0; i < 3 && is_octal_digit(*end) && end < _end; i++)
-						{
-							c = *end++;
-							n = (n << 3) | (c - '0');
-						}
-						c = static_cast<char>(n & 0xFF);
-						end--;
-						break;
-					case 'a':
-						c = '\a';
-						break;
-					case 'b':
-						c = '\b';
-						break;
-					case 'f':
-						c = '\f';
-						break;
-					case 'n':
-						c = '\n';
-						break;
-					case 'r':
-						c = '\r';
-						break;
-					case 't':
-						c = '\t';
-						break;
-					case 'v':
-						c = '\v';
-						break;
-					case 'x':
-						if (is_hexadecimal_digit(*++end))
-						{
-							while (is_hexadecimal_digit(*end) && end < _end)
-							{
-								c = *end++;
-								n = (n << 4) | (is_decimal_digit(c) ? c - '0' : c - 55 - 32 * (c & 0x20));
-							}
-
-							c = static_cast<char>(n);
-						}
-						end--;
-						break;
-				}
-			}
-
-			tok.literal_as_string += c;
-		}
-
 		tok.id = tokenid::string_literal;
-		tok.length = end - begin + 1;
+		tok.length = scan_string_literal(_cur, _end, escape, tok.literal_as_string);
+		tok.literal_as_view = std::string_view(_cur, tok.length);
 	}
 	void lexer::parse_numeric_literal(token &tok) const
 	{
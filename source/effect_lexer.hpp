@@ -5,7 +5,9 @@
 
 #pragma once
 
+#include <string_view>
 #include "source_location.hpp"
+#include "effect_interner.hpp"
 
 namespace reshadefx
 {
@@ -183,6 +185,8 @@ namespace reshadefx
 			double literal_as_double;
 		};
 		std::string literal_as_string;
+		std::string_view literal_as_view; // Span of the raw token characters in the input string of the lexer (the directive name for pre-processor directives)
+		atom literal_as_atom = interner::empty; // Interned name of identifier tokens, so that they can be compared and looked up as integers
 
 		inline operator tokenid() const { return id; }
 	};
@@ -194,7 +198,16 @@ namespace reshadefx
 	{
 	public:
 		/// <summary>
-		/// Construct a new lexical analyzer for an input string.
+		/// A saved position in the input string, which can be returned to later on.
+		/// </summary>
+		struct checkpoint
+		{
+			const std::string::value_type *cur;
+			location location;
+		};
+
+		/// <summary>
+		/// Construct a new lexical analyzer for an input string. The string is copied.
 		/// </summary>
 		/// <param name="source">The string to analyze.</param>
 		explicit lexer(
@@ -204,6 +217,17 @@ namespace reshadefx
 			bool ignore_keywords = false,
 			bool escape_string_literals = true);
 		/// <summary>
+		/// Construct a new lexical analyzer over a borrowed input string, which is not copied and has to outlive the lexer and all tokens it produces.
+		/// Identifier tokens are only emitted as spans into the input (see "token::literal_as_view") and do not fill in "token::literal_as_string".
+		/// </summary>
+		/// <param name="source">The string to analyze. It has to be followed by a null character, as is the case for views over a "std::string".</param>
+		explicit lexer(
+			std::string_view input,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true);
+		/// <summary>
 		/// Construct a copy of an existing instance.
 		/// </summary>
 		/// <param name="lexer">The instance to copy.</param>
@@ -213,8 +237,8 @@ namespace reshadefx
 		/// <summary>
 		/// Get the input string this lexical analyzer works on.
 		/// </summary>
-		/// <returns>A constant reference to the input string.</returns>
-		inline const std::string &input_string() const { return _input; }
+		/// <returns>A view of the input string.</returns>
+		inline std::string_view input_string() const { return _source; }
 
 		/// <summary>
 		/// Perform lexical analysis on the input string and return the next token in sequence.
@@ -222,6 +246,30 @@ namespace reshadefx
 		/// <returns>The next token from the input string.</returns>
 		token lex();
 
+		/// <summary>
+		/// Save the current position in the input string. This is a constant-time operation that does not copy the input.
+		/// </summary>
+		/// <returns>A checkpoint that can be passed to "restore" to rewind to this position.</returns>
+		checkpoint save() const { return { _cur, _cur_location }; }
+		/// <summary>
+		/// Rewind to a position previously saved with "save" on this instance.
+		/// </summary>
+		/// <param name="checkpoint">The checkpoint to restore.</param>
+		void restore(const checkpoint &checkpoint);
+
+		/// <summary>
+		/// Look up the reserved keyword an identifier refers to.
+		/// </summary>
+		/// <param name="identifier">The identifier to look up.</param>
+		/// <returns>The token identifier of the keyword, or "tokenid::identifier" if it is not a keyword.</returns>
+		static tokenid find_keyword(std::string_view identifier);
+		/// <summary>
+		/// Resolve the escape sequences in a string literal, without constructing a lexer for it.
+		/// </summary>
+		/// <param name="literal">The source text of the literal, including the quotes.</param>
+		/// <returns>The value of the literal.</returns>
+		static std::string unescape_string_literal(std::string_view literal);
+
 		/// <summary>
 		/// Advances to the next token that is not whitespace.
 		/// </summary>
@@ -244,11 +292,13 @@ namespace reshadefx
 		void parse_numeric_literal(token &tok) const;
 
 		std::string _input;
+		std::string_view _source;
 		location _cur_location;
 		const std::string::value_type *_cur, *_end;
 		bool _ignore_whitespace;
 		bool _ignore_pp_directives;
 		bool _ignore_keywords;
 		bool _escape_string_literals;
+		bool _borrowed_input;
 	};
 }
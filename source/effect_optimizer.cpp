@@ -0,0 +1,637 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "effect_optimizer.hpp"
+
+namespace reshadefx
+{
+	using namespace nodes;
+
+	void scalar_literal_cast(const nodes::literal_expression_node *from, size_t i, int &to);
+	void vector_literal_cast(const nodes::literal_expression_node *from, size_t k, nodes::literal_expression_node *to, size_t j);
+
+	nodes::expression_node *fold_constant_expression(syntax_tree &ast, nodes::expression_node *expression);
+
+	static bool is_constant_condition(const expression_node *expression, bool &value)
+	{
+		if (expression == nullptr || expression->id != nodeid::literal_expression || !expression->type.is_scalar())
+		{
+			return false;
+		}
+
+		const auto literal = static_cast<const literal_expression_node *>(expression);
+
+		value = literal->type.is_floating_point() ? literal->value_float()[0] != 0.0f : literal->value_int()[0] != 0;
+
+		return true;
+	}
+	static bool is_same_type(const type_node &left, const type_node &right)
+	{
+		return left.basetype == right.basetype && left.rows == right.rows && left.cols == right.cols && left.array_length == right.array_length && left.definition == right.definition;
+	}
+	static bool is_terminator(const statement_node *statement)
+	{
+		switch (statement->id)
+		{
+			case nodeid::return_statement:
+			case nodeid::jump_statement:
+				return true;
+			case nodeid::compound_statement:
+			{
+				const auto &statement_list = static_cast<const compound_statement_node *>(statement)->statement_list;
+
+				return !statement_list.empty() && is_terminator(statement_list.back());
+			}
+			default:
+				return false;
+		}
+	}
+	static bool is_break(const statement_node *statement)
+	{
+		return statement != nullptr && statement->id == nodeid::jump_statement && static_cast<const jump_statement_node *>(statement)->is_break;
+	}
+	static bool contains_jump(const statement_node *statement, bool check_break, bool check_continue)
+	{
+		if (statement == nullptr)
+		{
+			return false;
+		}
+
+		switch (statement->id)
+		{
+			case nodeid::jump_statement:
+			{
+				const auto jump = static_cast<const jump_statement_node *>(statement);
+
+				return (check_break && jump->is_break) || (check_continue && jump->is_continue);
+			}
+			case nodeid::compound_statement:
+			{
+				for (auto child : static_cast<const compound_statement_node *>(statement)->statement_list)
+				{
+					if (contains_jump(child, check_break, check_continue))
+					{
+						return true;
+					}
+				}
+
+				return false;
+			}
+			case nodeid::if_statement:
+			{
+				const auto ifstatement = static_cast<const if_statement_node *>(statement);
+
+				return contains_jump(ifstatement->statement_when_true, check_break, check_continue) || contains_jump(ifstatement->statement_when_false, check_break, check_continue);
+			}
+			case nodeid::switch_statement:
+			{
+				// A "break" inside a nested switch belongs to that switch, but a "continue" still refers to the enclosing loop
+				for (auto casenode : static_cast<const switch_statement_node *>(statement)->case_list)
+				{
+					if (contains_jump(casenode->statement_list, false, check_continue))
+					{
+						return true;
+					}
+				}
+
+				return false;
+			}
+			default:
+				// Loops own any jumps inside them
+				return false;
+		}
+	}
+
+	optimizer::optimizer(syntax_tree &ast) : _ast(ast)
+	{
+	}
+
+	void optimizer::run()
+	{
+		for (auto function : _ast.functions)
+		{
+			if (function->definition != nullptr)
+			{
+				optimize_block(function->definition->statement_list);
+			}
+		}
+	}
+
+	void optimizer::optimize(expression_node *&expression)
+	{
+		if (expression == nullptr)
+		{
+			return;
+		}
+
+		switch (expression->id)
+		{
+			case nodeid::unary_expression:
+				optimize(static_cast<unary_expression_node *>(expression)->operand);
+				break;
+			case nodeid::binary_expression:
+				for (auto &operand : static_cast<binary_expression_node *>(expression)->operands)
+				{
+					optimize(operand);
+				}
+				break;
+			case nodeid::intrinsic_expression:
+				for (auto &argument : static_cast<intrinsic_expression_node *>(expression)->arguments)
+				{
+					optimize(argument);
+				}
+				break;
+			case nodeid::conditional_expression:
+			{
+				const auto conditional = static_cast<conditional_expression_node *>(expression);
+
+				optimize(conditional->condition);
+				optimize(conditional->expression_when_true);
+				optimize(conditional->expression_when_false);
+
+				bool value;
+
+				if (!is_constant_condition(conditional->condition, value))
+				{
+					return;
+				}
+
+				const auto selected = value ? conditional->expression_when_true : conditional->expression_when_false;
+
+				if (is_same_type(selected->type, expression->type))
+				{
+					expression = selected;
+				}
+				else if (selected->id == nodeid::literal_expression && expression->type.is_numeric() && !expression->type.is_array())
+				{
+					// The branches may have been implicitly converted to the type of the whole expression, so do the same to the literal
+					const auto from = static_cast<const literal_expression_node *>(selected);
+					const auto literal = _ast.make_node<literal_expression_node>(expression->location);
+					literal->type = expression->type;
+					_ast.reserve_literal_values(literal);
+
+					for (unsigned int i = 0, size = literal->type.rows * literal->type.cols; i < size; ++i)
+					{
+						vector_literal_cast(from, i, literal, from->type.rows * from->type.cols == 1 ? 0 : i);
+					}
+
+					expression = literal;
+				}
+				return;
+			}
+			case nodeid::assignment_expression:
+				optimize(static_cast<assignment_expression_node *>(expression)->left);
+				optimize(static_cast<assignment_expression_node *>(expression)->right);
+				break;
+			case nodeid::expression_sequence:
+				for (auto &child : static_cast<expression_sequence_node *>(expression)->expression_list)
+				{
+					optimize(child);
+				}
+				break;
+			case nodeid::call_expression:
+				for (auto &argument : static_cast<call_expression_node *>(expression)->arguments)
+				{
+					optimize(argument);
+				}
+				break;
+			case nodeid::constructor_expression:
+				for (auto &argument : static_cast<constructor_expression_node *>(expression)->arguments)
+				{
+					optimize(argument);
+				}
+				break;
+			case nodeid::swizzle_expression:
+				optimize(static_cast<swizzle_expression_node *>(expression)->operand);
+				break;
+			case nodeid::field_expression:
+				optimize(static_cast<field_expression_node *>(expression)->operand);
+				break;
+			case nodeid::initializer_list:
+				for (auto &value : static_cast<initializer_list_node *>(expression)->values)
+				{
+					optimize(value);
+				}
+				break;
+		}
+
+		expression = fold_constant_expression(_ast, expression);
+	}
+	statement_node *optimizer::optimize(statement_node *statement)
+	{
+		if (statement == nullptr)
+		{
+			return nullptr;
+		}
+
+		switch (statement->id)
+		{
+			case nodeid::compound_statement:
+			{
+				auto &statement_list = static_cast<compound_statement_node *>(statement)->statement_list;
+
+				optimize_block(statement_list);
+
+				if (statement_list.empty())
+				{
+					return nullptr;
+				}
+				break;
+			}
+			case nodeid::declarator_list:
+				// Initializers are folded in order of declaration, so constants that depend on earlier constants are propagated as well
+				for (auto variable : static_cast<declarator_list_node *>(statement)->declarator_list)
+				{
+					optimize(variable->initializer_expression);
+				}
+				break;
+			case nodeid::expression_statement:
+			{
+				auto &expression = static_cast<expression_statement_node *>(statement)->expression;
+
+				optimize(expression);
+
+				// Statements that only evaluate a constant or a variable do not have any effect
+				if (expression == nullptr || expression->id == nodeid::literal_expression || expression->id == nodeid::lvalue_expression)
+				{
+					return nullptr;
+				}
+				break;
+			}
+			case nodeid::if_statement:
+			{
+				const auto ifstatement = static_cast<if_statement_node *>(statement);
+
+				optimize(ifstatement->condition);
+
+				bool value;
+
+				if (is_constant_condition(ifstatement->condition, value))
+				{
+					const auto branch = optimize(value ? ifstatement->statement_when_true : ifstatement->statement_when_false);
+
+					// A branch that is a bare declaration has to keep a scope of its own, or it could clash with a declaration of the same name next to the "if" statement
+					if (branch == nullptr || branch->id != nodeid::declarator_list)
+					{
+						return branch;
+					}
+
+					const auto block = _ast.make_node<compound_statement_node>(ifstatement->location);
+					block->statement_list.push_back(branch);
+
+					return block;
+				}
+
+				if (ifstatement->statement_when_true != nullptr && (ifstatement->statement_when_true = optimize(ifstatement->statement_when_true)) == nullptr)
+				{
+					ifstatement->statement_when_true = make_empty_statement(ifstatement->location);
+				}
+
+				ifstatement->statement_when_false = optimize(ifstatement->statement_when_false);
+				break;
+			}
+			case nodeid::switch_statement:
+				return optimize_switch(static_cast<switch_statement_node *>(statement));
+			case nodeid::for_statement:
+			{
+				const auto forstatement = static_cast<for_statement_node *>(statement);
+
+				forstatement->init_statement = optimize(forstatement->init_statement);
+				optimize(forstatement->condition);
+				optimize(forstatement->increment_expression);
+
+				bool value;
+
+				if (is_constant_condition(forstatement->condition, value) && !value)
+				{
+					// The loop body never runs, but the initializer still does. Keep it in a scope of its own, since it may declare the loop variable.
+					if (forstatement->init_statement == nullptr || forstatement->init_statement->id != nodeid::declarator_list)
+					{
+						return forstatement->init_statement;
+					}
+
+					const auto block = _ast.make_node<compound_statement_node>(forstatement->location);
+					block->statement_list.push_back(forstatement->init_statement);
+
+					return block;
+				}
+
+				if (forstatement->statement_list != nullptr && (forstatement->statement_list = optimize(forstatement->statement_list)) == nullptr)
+				{
+					forstatement->statement_list = make_empty_statement(forstatement->location);
+				}
+				break;
+			}
+			case nodeid::while_statement:
+			{
+				const auto whilestatement = static_cast<while_statement_node *>(statement);
+
+				optimize(whilestatement->condition);
+
+				bool value;
+				const bool never_repeats = is_constant_condition(whilestatement->condition, value) && !value;
+
+				if (never_repeats && !whilestatement->is_do_while)
+				{
+					return nullptr;
+				}
+
+				whilestatement->statement_list = optimize(whilestatement->statement_list);
+
+				// A "do { } while (false)" runs its body exactly once, so it can be replaced by the body if nothing in there jumps out of the loop
+				if (never_repeats && !contains_jump(whilestatement->statement_list, true, true))
+				{
+					return whilestatement->statement_list;
+				}
+
+				if (whilestatement->statement_list == nullptr)
+				{
+					whilestatement->statement_list = make_empty_statement(whilestatement->location);
+				}
+				break;
+			}
+			case nodeid::return_statement:
+				optimize(static_cast<return_statement_node *>(statement)->return_value);
+				break;
+		}
+
+		return statement;
+	}
+	void optimizer::optimize_block(std::vector<statement_node *> &statement_list)
+	{
+		size_t count = 0;
+
+		for (auto statement : statement_list)
+		{
+			statement = optimize(statement);
+
+			if (statement == nullptr)
+			{
+				continue;
+			}
+
+			statement_list[count++] = statement;
+
+			// Anything following a return or jump in the same block is unreachable
+			if (is_terminator(statement))
+			{
+				break;
+			}
+		}
+
+		statement_list.resize(count);
+	}
+	statement_node *optimizer::optimize_switch(switch_statement_node *statement)
+	{
+		optimize(statement->test_expression);
+
+		for (auto casenode : statement->case_list)
+		{
+			if ((casenode->statement_list = optimize(casenode->statement_list)) == nullptr)
+			{
+				casenode->statement_list = make_empty_statement(casenode->location);
+			}
+		}
+
+		if (statement->test_expression->id != nodeid::literal_expression)
+		{
+			return statement;
+		}
+
+		int value;
+		scalar_literal_cast(static_cast<const literal_expression_node *>(statement->test_expression), 0, value);
+
+		case_statement_node *selected = nullptr, *fallback = nullptr;
+
+		for (auto casenode : statement->case_list)
+		{
+			for (auto label : casenode->labels)
+			{
+				if (label == nullptr)
+				{
+					fallback = casenode;
+					continue;
+				}
+
+				int label_value;
+				scalar_literal_cast(label, 0, label_value);
+
+				if (label_value == value)
+				{
+					selected = casenode;
+				}
+			}
+		}
+
+		if (selected == nullptr && (selected = fallback) == nullptr)
+		{
+			// No case matches and there is no default, so nothing executes
+			return nullptr;
+		}
+
+		const auto body = selected->statement_list;
+
+		if (is_break(body))
+		{
+			return nullptr;
+		}
+
+		// Only a case that ends in its one and only "break" can replace the whole switch, everything else may fall through or leave early
+		if (body->id == nodeid::compound_statement)
+		{
+			auto &statement_list = static_cast<compound_statement_node *>(body)->statement_list;
+
+			if (!statement_list.empty() && is_break(statement_list.back()))
+			{
+				const auto last = statement_list.back();
+				statement_list.pop_back();
+
+				if (!contains_jump(body, true, false))
+				{
+					return body;
+				}
+
+				statement_list.push_back(last);
+			}
+		}
+
+		return statement;
+	}
+
+	statement_node *optimizer::make_empty_statement(const location &location)
+	{
+		return _ast.make_node<compound_statement_node>(location);
+	}
+
+	static void find_reachable_declarations(const expression_node *expression, std::unordered_set<const declaration_node *> &declarations);
+	static void find_reachable_declarations(const statement_node *statement, std::unordered_set<const declaration_node *> &declarations)
+	{
+		if (statement == nullptr)
+		{
+			return;
+		}
+
+		switch (statement->id)
+		{
+			case nodeid::compound_statement:
+				for (auto child : static_cast<const compound_statement_node *>(statement)->statement_list)
+				{
+					find_reachable_declarations(child, declarations);
+				}
+				break;
+			case nodeid::declarator_list:
+				for (auto variable : static_cast<const declarator_list_node *>(statement)->declarator_list)
+				{
+					find_reachable_declarations(variable->initializer_expression, declarations);
+				}
+				break;
+			case nodeid::expression_statement:
+				find_reachable_declarations(static_cast<const expression_statement_node *>(statement)->expression, declarations);
+				break;
+			case nodeid::if_statement:
+			{
+				const auto ifstatement = static_cast<const if_statement_node *>(statement);
+
+				find_reachable_declarations(ifstatement->condition, declarations);
+				find_reachable_declarations(ifstatement->statement_when_true, declarations);
+				find_reachable_declarations(ifstatement->statement_when_false, declarations);
+				break;
+			}
+			case nodeid::switch_statement:
+			{
+				const auto switchstatement = static_cast<const switch_statement_node *>(statement);
+
+				find_reachable_declarations(switchstatement->test_expression, declarations);
+
+				for (auto casenode : switchstatement->case_list)
+				{
+					find_reachable_declarations(casenode->statement_list, declarations);
+				}
+				break;
+			}
+			case nodeid::for_statement:
+			{
+				const auto forstatement = static_cast<const for_statement_node *>(statement);
+
+				find_reachable_declarations(forstatement->init_statement, declarations);
+				find_reachable_declarations(forstatement->condition, declarations);
+				find_reachable_declarations(forstatement->increment_expression, declarations);
+				find_reachable_declarations(forstatement->statement_list, declarations);
+				break;
+			}
+			case nodeid::while_statement:
+				find_reachable_declarations(static_cast<const while_statement_node *>(statement)->condition, declarations);
+				find_reachable_declarations(static_cast<const while_statement_node *>(statement)->statement_list, declarations);
+				break;
+			case nodeid::return_statement:
+				find_reachable_declarations(static_cast<const return_statement_node *>(statement)->return_value, declarations);
+				break;
+		}
+	}
+	static void find_reachable_declarations(const expression_node *expression, std::unordered_set<const declaration_node *> &declarations)
+	{
+		if (expression == nullptr)
+		{
+			return;
+		}
+
+		switch (expression->id)
+		{
+			case nodeid::lvalue_expression:
+			{
+				const auto variable = static_cast<const lvalue_expression_node *>(expression)->reference;
+
+				// Local variables end up in the set too, which does not matter since only global declarations are ever looked up in it
+				if (!declarations.insert(variable).second)
+				{
+					break;
+				}
+
+				if (variable->type.is_sampler() && variable->properties.texture != nullptr)
+				{
+					declarations.insert(variable->properties.texture);
+				}
+
+				// Global constants may be initialized from other globals, which then have to be declared as well
+				find_reachable_declarations(variable->initializer_expression, declarations);
+				break;
+			}
+			case nodeid::unary_expression:
+				find_reachable_declarations(static_cast<const unary_expression_node *>(expression)->operand, declarations);
+				break;
+			case nodeid::binary_expression:
+				for (auto operand : static_cast<const binary_expression_node *>(expression)->operands)
+				{
+					find_reachable_declarations(operand, declarations);
+				}
+				break;
+			case nodeid::intrinsic_expression:
+				for (auto argument : static_cast<const intrinsic_expression_node *>(expression)->arguments)
+				{
+					find_reachable_declarations(argument, declarations);
+				}
+				break;
+			case nodeid::conditional_expression:
+			{
+				const auto conditional = static_cast<const conditional_expression_node *>(expression);
+
+				find_reachable_declarations(conditional->condition, declarations);
+				find_reachable_declarations(conditional->expression_when_true, declarations);
+				find_reachable_declarations(conditional->expression_when_false, declarations);
+				break;
+			}
+			case nodeid::assignment_expression:
+				find_reachable_declarations(static_cast<const assignment_expression_node *>(expression)->left, declarations);
+				find_reachable_declarations(static_cast<const assignment_expression_node *>(expression)->right, declarations);
+				break;
+			case nodeid::expression_sequence:
+				for (auto child : static_cast<const expression_sequence_node *>(expression)->expression_list)
+				{
+					find_reachable_declarations(child, declarations);
+				}
+				break;
+			case nodeid::call_expression:
+			{
+				const auto call = static_cast<const call_expression_node *>(expression);
+
+				for (auto argument : call->arguments)
+				{
+					find_reachable_declarations(argument, declarations);
+				}
+
+				// Each function is only walked the first time it is called
+				if (!declarations.count(call->callee))
+				{
+					find_reachable_declarations(call->callee, declarations);
+				}
+				break;
+			}
+			case nodeid::constructor_expression:
+				for (auto argument : static_cast<const constructor_expression_node *>(expression)->arguments)
+				{
+					find_reachable_declarations(argument, declarations);
+				}
+				break;
+			case nodeid::swizzle_expression:
+				find_reachable_declarations(static_cast<const swizzle_expression_node *>(expression)->operand, declarations);
+				break;
+			case nodeid::field_expression:
+				find_reachable_declarations(static_cast<const field_expression_node *>(expression)->operand, declarations);
+				break;
+			case nodeid::initializer_list:
+				for (auto value : static_cast<const initializer_list_node *>(expression)->values)
+				{
+					find_reachable_declarations(value, declarations);
+				}
+				break;
+		}
+	}
+	void find_reachable_declarations(const function_declaration_node *entry_point, std::unordered_set<const declaration_node *> &declarations)
+	{
+		declarations.insert(entry_point);
+
+		find_reachable_declarations(entry_point->definition, declarations);
+	}
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "effect_syntax_tree.hpp"
+#include <unordered_set>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// An optimization pass over a parsed syntax tree, which propagates constants and removes code that can never execute.
+	/// </summary>
+	class optimizer
+	{
+	public:
+		/// <summary>
+		/// Construct a new optimizer instance.
+		/// </summary>
+		explicit optimizer(syntax_tree &ast);
+		optimizer(const optimizer &) = delete;
+
+		optimizer &operator=(const optimizer &) = delete;
+
+		/// <summary>
+		/// Optimize all function definitions in the syntax tree in place. This should run after any changes to constant declarations (e.g. uniforms that were turned into constants), so that references to them are folded too.
+		/// </summary>
+		void run();
+
+	private:
+		void optimize(nodes::expression_node *&expression);
+		nodes::statement_node *optimize(nodes::statement_node *statement);
+		void optimize_block(std::vector<nodes::statement_node *> &statement_list);
+		nodes::statement_node *optimize_switch(nodes::switch_statement_node *statement);
+
+		nodes::statement_node *make_empty_statement(const location &location);
+
+		syntax_tree &_ast;
+	};
+
+	/// <summary>
+	/// Collect the function used as a shader entry point and every global declaration it depends on, which includes the functions it calls, the variables and samplers they reference and the textures those samplers read from.
+	/// </summary>
+	/// <param name="entry_point">The function to start from.</param>
+	/// <param name="declarations">The set the reachable declarations are added to.</param>
+	void find_reachable_declarations(const nodes::function_declaration_node *entry_point, std::unordered_set<const nodes::declaration_node *> &declarations);
+}
@@ -4,6 +4,7 @@
  */
 
 #include "effect_parser.hpp"
+#include "effect_preprocessor.hpp"
 #include "effect_symbol_table.hpp"
 #include <algorithm>
 
@@ -261,8 +262,28 @@ namespace reshadefx
 
 	bool parser::run(const std::string &input)
 	{
-		_lexer.reset(new lexer(input));
-		_lexer_backup.reset();
+		_lexer.reset(new lexer(std::string_view(input)));
+		_lexer_backup = _lexer->save();
+		_preprocessor = nullptr;
+
+		consume();
+
+		while (!peek(tokenid::end_of_file))
+		{
+			if (!parse_top_level())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+	bool parser::run(preprocessor &preprocessor)
+	{
+		_lexer.reset();
+		_preprocessor = &preprocessor;
+		_stream_buffer.clear();
+		_stream_buffer_index = 0;
 
 		consume();
 
@@ -280,7 +301,7 @@ namespace reshadefx
 	// Error handling
 	void parser::error(const location &location, unsigned int code, const std::string &message)
 	{
-		_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": ";
+		_errors += std::string(location.source) + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": ";
 
 		if (code == 0)
 		{
@@ -295,7 +316,7 @@ namespace reshadefx
 	}
 	void parser::warning(const location &location, unsigned int code, const std::string &message)
 	{
-		_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": ";
+		_errors += std::string(location.source) + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": ";
 
 		if (code == 0)
 		{
@@ -312,13 +333,30 @@ namespace reshadefx
 	// Input management
 	void parser::backup()
 	{
-		_lexer.swap(_lexer_backup);
-		_lexer.reset(new lexer(*_lexer_backup));
+		if (_preprocessor != nullptr)
+		{
+			// Tokens before the backup are never needed again, only keep those that may have to be replayed
+			_stream_buffer.erase(_stream_buffer.begin(), _stream_buffer.begin() + _stream_buffer_index);
+			_stream_buffer_index = 0;
+		}
+		else
+		{
+			_lexer_backup = _lexer->save();
+		}
+
 		_token_backup = _token_next;
 	}
 	void parser::restore()
 	{
-		_lexer.swap(_lexer_backup);
+		if (_preprocessor != nullptr)
+		{
+			_stream_buffer_index = 0;
+		}
+		else
+		{
+			_lexer->restore(_lexer_backup);
+		}
+
 		_token_next = _token_backup;
 	}
 
@@ -329,7 +367,21 @@ namespace reshadefx
 	void parser::consume()
 	{
 		_token = _token_next;
-		_token_next = _lexer->lex();
+
+		if (_preprocessor == nullptr)
+		{
+			_token_next = _lexer->lex();
+		}
+		else if (_stream_buffer_index < _stream_buffer.size())
+		{
+			_token_next = _stream_buffer[_stream_buffer_index++];
+		}
+		else
+		{
+			_token_next = _preprocessor->next_token();
+			_stream_buffer.push_back(_token_next);
+			_stream_buffer_index++;
+		}
 	}
 	void parser::consume_until(tokenid tokid)
 	{
@@ -372,7 +424,7 @@ namespace reshadefx
 			type.rows = type.cols = 0;
 			type.basetype = type_node::datatype_struct;
 
-			const auto symbol = _symbol_table->find(_token_next.literal_as_string);
+			const auto symbol = _symbol_table->find(_token_next.literal_as_atom);
 
 			if (symbol != nullptr && symbol->id == nodeid::struct_declaration)
 			{
@@ -1059,7 +1111,7 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_bool;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 1, literal->type.array_length = 0;
-			literal->value_int[0] = 1;
+			literal->value_int()[0] = 1;
 
 			node = literal;
 			type = literal->type;
@@ -1070,7 +1122,7 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_bool;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 1, literal->type.array_length = 0;
-			literal->value_int[0] = 0;
+			literal->value_int()[0] = 0;
 
 			node = literal;
 			type = literal->type;
@@ -1081,7 +1133,7 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_int;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 1, literal->type.array_length = 0;
-			literal->value_int[0] = _token.literal_as_int;
+			literal->value_int()[0] = _token.literal_as_int;
 
 			node = literal;
 			type = literal->type;
@@ -1092,7 +1144,7 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_uint;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 1, literal->type.array_length = 0;
-			literal->value_uint[0] = _token.literal_as_uint;
+			literal->value_uint()[0] = _token.literal_as_uint;
 
 			node = literal;
 			type = literal->type;
@@ -1103,7 +1155,7 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_float;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 1, literal->type.array_length = 0;
-			literal->value_float[0] = _token.literal_as_float;
+			literal->value_float()[0] = _token.literal_as_float;
 
 			node = literal;
 			type = literal->type;
@@ -1114,7 +1166,7 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_float;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 1, literal->type.array_length = 0;
-			literal->value_float[0] = static_cast<float>(_token.literal_as_double);
+			literal->value_float()[0] = static_cast<float>(_token.literal_as_double);
 
 			node = literal;
 			type = literal->type;
@@ -1125,13 +1177,15 @@ namespace reshadefx
 			literal->type.basetype = type_node::datatype_string;
 			literal->type.qualifiers = type_node::qualifier_const;
 			literal->type.rows = literal->type.cols = 0, literal->type.array_length = 0;
-			literal->value_string = _token.literal_as_string;
+			std::string value = _token.literal_as_string;
 
 			while (accept(tokenid::string_literal))
 			{
-				literal->value_string += _token.literal_as_string;
+				value += _token.literal_as_string;
 			}
 
+			literal->value_string = _ast.make_string(value);
+
 			node = literal;
 			type = literal->type;
 		}
@@ -1222,11 +1276,13 @@ namespace reshadefx
 			scope scope;
 			bool exclusive;
 			std::string identifier;
+			atom identifier_atom = interner::empty;
 
 			if (accept(tokenid::colon_colon))
 			{
 				scope.name = "::";
 				scope.namespace_level = scope.level = 0;
+				scope.namespace_id = interner::global().intern(scope.name);
 				exclusive = true;
 			}
 			else
@@ -1237,7 +1293,8 @@ namespace reshadefx
 
 			if (exclusive ? expect(tokenid::identifier) : accept(tokenid::identifier))
 			{
-				identifier = _token.literal_as_string;
+				identifier = std::string(_token.literal_as_view);
+				identifier_atom = _token.literal_as_atom;
 			}
 			else
 			{
@@ -1251,10 +1308,11 @@ namespace reshadefx
 					return false;
 				}
 
-				identifier += "::" + _token.literal_as_string;
+				identifier += "::" + std::string(_token.literal_as_view);
+				identifier_atom = interner::global().find(identifier);
 			}
 
-			const auto symbol = _symbol_table->find(identifier, scope, exclusive);
+			const auto symbol = identifier_atom != interner::empty ? _symbol_table->find(identifier_atom, scope, exclusive) : nullptr;
 
 			if (accept('('))
 			{
@@ -1414,7 +1472,7 @@ namespace reshadefx
 				}
 
 				location = _token.location;
-				const auto subscript = _token.literal_as_string;
+				const auto subscript = std::string(_token.literal_as_view);
 
 				if (accept('('))
 				{
@@ -1908,18 +1966,18 @@ namespace reshadefx
 	// Statements
 	bool parser::parse_statement(statement_node *&statement, bool scoped)
 	{
-		std::vector<std::string> attributes;
+		std::vector<atom> attribute_names;
 
 		// Attributes
 		while (accept('['))
 		{
 			if (expect(tokenid::identifier))
 			{
-				const auto attribute = _token.literal_as_string;
+				const auto attribute = _token.literal_as_atom;
 
 				if (expect(']'))
 				{
-					attributes.push_back(attribute);
+					attribute_names.push_back(attribute);
 				}
 			}
 			else
@@ -1928,6 +1986,8 @@ namespace reshadefx
 			}
 		}
 
+		const auto attributes = attribute_names.empty() ? attribute_list() : _ast.make_attribute_list(attribute_names);
+
 		if (peek('{'))
 		{
 			if (!parse_statement_block(statement, scoped))
@@ -2413,7 +2473,7 @@ namespace reshadefx
 
 			variable_declaration_node *declarator = nullptr;
 
-			if (!parse_variable_declaration(type, _token.literal_as_string, declarator))
+			if (!parse_variable_declaration(type, std::string(_token.literal_as_view), declarator))
 			{
 				return false;
 			}
@@ -2472,7 +2532,7 @@ namespace reshadefx
 			{
 				function_declaration_node *function = nullptr;
 
-				if (!parse_function_declaration(type, _token.literal_as_string, function))
+				if (!parse_function_declaration(type, std::string(_token.literal_as_view), function))
 				{
 					return false;
 				}
@@ -2492,7 +2552,7 @@ namespace reshadefx
 
 					variable_declaration_node *variable = nullptr;
 
-					if (!parse_variable_declaration(type, _token.literal_as_string, variable, true))
+					if (!parse_variable_declaration(type, std::string(_token.literal_as_view), variable, true))
 					{
 						consume_until(';');
 
@@ -2532,7 +2592,7 @@ namespace reshadefx
 			return false;
 		}
 
-		const auto name = _token.literal_as_string;
+		const auto name = std::string(_token.literal_as_view);
 
 		if (!expect('{'))
 		{
@@ -2577,7 +2637,7 @@ namespace reshadefx
 					return false;
 				}
 
-				size = static_cast<literal_expression_node *>(expression)->value_int[0];
+				size = static_cast<literal_expression_node *>(expression)->value_int()[0];
 
 				if (size < 1 || size > 65536)
 				{
@@ -2615,7 +2675,7 @@ namespace reshadefx
 				return false;
 			}
 
-			const auto name = _token.literal_as_string;
+			const auto name = std::string(_token.literal_as_view);
 			literal_expression_node *expression = nullptr;
 
 			if (!(expect('=') && parse_expression_unary(reinterpret_cast<expression_node *&>(expression)) && expect(';')))
@@ -2633,17 +2693,17 @@ namespace reshadefx
 			switch (expression->type.basetype)
 			{
 				case type_node::datatype_int:
-					annotations[name] = expression->value_int;
+					annotations[name] = reshade::variant(expression->value_int(), expression->type.rows * expression->type.cols);
 					break;
 				case type_node::datatype_bool:
 				case type_node::datatype_uint:
-					annotations[name] = expression->value_uint;
+					annotations[name] = reshade::variant(expression->value_uint(), expression->type.rows * expression->type.cols);
 					break;
 				case type_node::datatype_float:
-					annotations[name] = expression->value_float;
+					annotations[name] = reshade::variant(expression->value_float(), expression->type.rows * expression->type.cols);
 					break;
 				case type_node::datatype_string:
-					annotations[name] = expression->value_string;
+					annotations[name] = std::string(expression->value_string);
 					break;
 			}
 		}
@@ -2661,7 +2721,7 @@ namespace reshadefx
 
 		if (accept(tokenid::identifier))
 		{
-			structure->name = _token.literal_as_string;
+			structure->name = std::string(_token.literal_as_view);
 
 			if (!_symbol_table->insert(structure, true))
 			{
@@ -2732,7 +2792,7 @@ namespace reshadefx
 				}
 
 				const auto field = _ast.make_node<variable_declaration_node>(_token.location);
-				field->unique_name = field->name = _token.literal_as_string;
+				field->unique_name = field->name = std::string(_token.literal_as_view);
 				field->type = type;
 
 				if (!parse_array(field->type.array_length))
@@ -2749,7 +2809,7 @@ namespace reshadefx
 						return false;
 					}
 
-					field->semantic = _token.literal_as_string;
+					field->semantic = std::string(_token.literal_as_view);
 					std::transform(field->semantic.begin(), field->semantic.end(), field->semantic.begin(), ::toupper);
 				}
 
@@ -2829,7 +2889,7 @@ namespace reshadefx
 				return false;
 			}
 
-			parameter->unique_name = parameter->name = _token.literal_as_string;
+			parameter->unique_name = parameter->name = std::string(_token.literal_as_view);
 			parameter->location = _token.location;
 
 			if (parameter->type.is_void())
@@ -2904,7 +2964,7 @@ namespace reshadefx
 					return false;
 				}
 
-				parameter->semantic = _token.literal_as_string;
+				parameter->semantic = std::string(_token.literal_as_view);
 				std::transform(parameter->semantic.begin(), parameter->semantic.end(), parameter->semantic.begin(), ::toupper);
 			}
 
@@ -2927,7 +2987,7 @@ namespace reshadefx
 				return false;
 			}
 
-			function->return_semantic = _token.literal_as_string;
+			function->return_semantic = std::string(_token.literal_as_view);
 			std::transform(function->return_semantic.begin(), function->return_semantic.end(), function->return_semantic.begin(), ::toupper);
 
 			if (type.is_void())
@@ -3043,7 +3103,7 @@ namespace reshadefx
 				return false;
 			}
 
-			variable->semantic = _token.literal_as_string;
+			variable->semantic = std::string(_token.literal_as_view);
 			std::transform(variable->semantic.begin(), variable->semantic.end(), variable->semantic.begin(), ::toupper);
 
 			return true;
@@ -3076,6 +3136,7 @@ namespace reshadefx
 				nullval->type.basetype = type.basetype;
 				nullval->type.qualifiers = type_node::qualifier_const;
 				nullval->type.rows = type.rows, nullval->type.cols = type.cols, nullval->type.array_length = 0;
+				_ast.reserve_literal_values(nullval);
 
 				const auto initializerlist = static_cast<initializer_list_node *>(variable->initializer_expression);
 
@@ -3117,6 +3178,7 @@ namespace reshadefx
 				const auto zero_initializer = _ast.make_node<literal_expression_node>(location);
 				zero_initializer->type = type;
 				zero_initializer->type.qualifiers = type_node::qualifier_const;
+				_ast.reserve_literal_values(zero_initializer);
 
 				variable->initializer_expression = zero_initializer;
 			}
@@ -3198,7 +3260,7 @@ namespace reshadefx
 				return false;
 			}
 
-			const auto name = _token.literal_as_string;
+			const auto name = std::string(_token.literal_as_view);
 			const auto location = _token.location;
 
 			expression_node *value = nullptr;
@@ -3261,7 +3323,7 @@ namespace reshadefx
 				}
 				else if (name == "SRGBTexture" || name == "SRGBReadEnable")
 				{
-					variable->properties.srgb_texture = value_literal->value_int[0] != 0;
+					variable->properties.srgb_texture = value_literal->value_int()[0] != 0;
 				}
 				else if (name == "AddressU")
 				{
@@ -3376,16 +3438,17 @@ namespace reshadefx
 			};
 
 			const auto location = _token.location;
-			std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), ::toupper);
+			std::string value_name(_token.literal_as_view);
+			std::transform(value_name.begin(), value_name.end(), value_name.begin(), ::toupper);
 
 			for (const auto &value : s_values)
 			{
-				if (value.first == _token.literal_as_string)
+				if (value.first == value_name)
 				{
 					const auto newexpression = _ast.make_node<literal_expression_node>(location);
 					newexpression->type.basetype = type_node::datatype_uint;
 					newexpression->type.rows = newexpression->type.cols = 1, newexpression->type.array_length = 0;
-					newexpression->value_uint[0] = value.second;
+					newexpression->value_uint()[0] = value.second;
 
 					expression = newexpression;
 
@@ -3413,7 +3476,7 @@ namespace reshadefx
 		}
 
 		technique = _ast.make_node<technique_declaration_node>(location);
-		technique->name = _token.literal_as_string;
+		technique->name = std::string(_token.literal_as_view);
 
 		technique->unique_name = 'T' + _symbol_table->current_scope().name + technique->name;
 		std::replace(technique->unique_name.begin(), technique->unique_name.end(), ':', '_');
@@ -3453,7 +3516,7 @@ namespace reshadefx
 
 		if (accept(tokenid::identifier))
 		{
-			pass->unique_name = pass->name = _token.literal_as_string;
+			pass->unique_name = pass->name = std::string(_token.literal_as_view);
 		}
 
 		if (!expect('{'))
@@ -3468,7 +3531,7 @@ namespace reshadefx
 				return false;
 			}
 
-			const auto passstate = _token.literal_as_string;
+			const auto passstate = std::string(_token.literal_as_view);
 			const auto location = _token.location;
 
 			expression_node *value = nullptr;
@@ -3520,19 +3583,19 @@ namespace reshadefx
 
 				if (passstate == "SRGBWriteEnable")
 				{
-					pass->srgb_write_enable = value_literal->value_int[0] != 0;
+					pass->srgb_write_enable = value_literal->value_int()[0] != 0;
 				}
 				else if (passstate == "BlendEnable")
 				{
-					pass->blend_enable = value_literal->value_int[0] != 0;
+					pass->blend_enable = value_literal->value_int()[0] != 0;
 				}
 				else if (passstate == "StencilEnable")
 				{
-					pass->stencil_enable = value_literal->value_int[0] != 0;
+					pass->stencil_enable = value_literal->value_int()[0] != 0;
 				}
 				else if (passstate == "ClearRenderTargets")
 				{
-					pass->clear_render_targets = value_literal->value_int[0] != 0;
+					pass->clear_render_targets = value_literal->value_int()[0] != 0;
 				}
 				else if (passstate == "RenderTargetWriteMask" || passstate == "ColorWriteMask")
 				{
@@ -3665,18 +3728,19 @@ namespace reshadefx
 				{ "NOTEQUAL", pass_declaration_node::NOTEQUAL },
 			};
 
-			auto identifier = _token.literal_as_string;
+			auto identifier = std::string(_token.literal_as_view);
 			const auto location = _token.location;
-			std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), ::toupper);
+			std::string value_name(_token.literal_as_view);
+			std::transform(value_name.begin(), value_name.end(), value_name.begin(), ::toupper);
 
 			for (const auto &value : s_enums)
 			{
-				if (value.first == _token.literal_as_string)
+				if (value.first == value_name)
 				{
 					const auto newexpression = _ast.make_node<literal_expression_node>(location);
 					newexpression->type.basetype = type_node::datatype_uint;
 					newexpression->type.rows = newexpression->type.cols = 1, newexpression->type.array_length = 0;
-					newexpression->value_uint[0] = value.second;
+					newexpression->value_uint()[0] = value.second;
 
 					expression = newexpression;
 
@@ -3686,7 +3750,7 @@ namespace reshadefx
 
 			while (accept(tokenid::colon_colon) && expect(tokenid::identifier))
 			{
-				identifier += "::" + _token.literal_as_string;
+				identifier += "::" + std::string(_token.literal_as_view);
 			}
 
 			const auto symbol = _symbol_table->find(identifier, scope, exclusive);
@@ -37,6 +37,12 @@ namespace reshadefx
 		/// <param name="source">The string to analyze.</param>
 		/// <returns>A boolean value indicating whether parsing was successful or not.</returns>
 		bool run(const std::string &source);
+		/// <summary>
+		/// Parse the output of a pre-processor in streaming mode (see "preprocessor::begin_stream"), consuming its tokens as they are produced instead of lexing its output string again.
+		/// </summary>
+		/// <param name="preprocessor">The pre-processor to pull tokens from.</param>
+		/// <returns>A boolean value indicating whether parsing was successful or not.</returns>
+		bool run(class preprocessor &preprocessor);
 
 	private:
 		void error(const location &location, unsigned int code, const std::string &message);
@@ -85,7 +91,11 @@ namespace reshadefx
 
 		syntax_tree &_ast;
 		std::string _errors;
-		std::unique_ptr<lexer> _lexer, _lexer_backup;
+		std::unique_ptr<lexer> _lexer;
+		lexer::checkpoint _lexer_backup;
+		class preprocessor *_preprocessor = nullptr;
+		std::vector<token> _stream_buffer;
+		size_t _stream_buffer_index = 0;
 		token _token, _token_next, _token_backup;
 		std::unique_ptr<class symbol_table> _symbol_table;
 	};
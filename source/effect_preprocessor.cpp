@@ -9,18 +9,244 @@
 
 namespace reshadefx
 {
-	enum macro_replacement
+	namespace filesystem = reshade::filesystem;
+
+	struct preprocessor::replacement
 	{
-		macro_replacement_start = '\x00',
-		macro_replacement_argument = '\xFA',
-		macro_replacement_concat = '\xFF',
-		macro_replacement_stringize = '\xFE',
-		macro_replacement_space = '\xFD',
-		macro_replacement_break = '\xFC',
-		macro_replacement_expand = '\xFB',
+		enum class element_type
+		{
+			token,
+			argument,
+			stringize,
+			concat,
+		};
+		struct element
+		{
+			element_type type;
+			size_t argument_index;
+			reshadefx::token token;
+		};
+
+		std::string text; // The tokens point into this copy of the replacement list, so they stay valid for as long as the macro is around
+		std::vector<element> elements;
 	};
 
-	namespace filesystem = reshade::filesystem;
+	struct preprocessor::snapshot
+	{
+		std::unordered_map<atom, macro> macros_before, macros_after;
+		std::vector<std::string> pragmas;
+		std::vector<std::pair<std::string, uint64_t>> dependencies;
+		std::unordered_map<std::string, std::shared_ptr<const std::string>> filecache;
+		std::string output, output_after_return;
+		size_t output_begin = 0, output_return = std::string::npos, output_after_return_begin = 0, pragmas_begin = 0, errors_begin = 0;
+		unsigned int output_line = 0;
+	};
+
+	bool operator==(const preprocessor::macro &lhs, const preprocessor::macro &rhs)
+	{
+		return lhs.replacement_list == rhs.replacement_list && lhs.is_function_like == rhs.is_function_like && lhs.is_variadic == rhs.is_variadic && lhs.parameters == rhs.parameters;
+	}
+
+	static std::shared_ptr<const preprocessor::replacement> tokenize_replacement_list(const preprocessor::macro &macro)
+	{
+		using element_type = preprocessor::replacement::element_type;
+
+		const auto result = std::make_shared<preprocessor::replacement>();
+		result->text = macro.replacement_list;
+
+		lexer lexer(std::string_view(result->text), false, false, true, false);
+
+		// The replacement list continues the line of the #define directive, so a leading '#' does not start another directive
+		auto start = lexer.save();
+		start.location.column = 2;
+		lexer.restore(start);
+
+		token tok = lexer.lex();
+
+		while (tok == tokenid::space)
+		{
+			tok = lexer.lex();
+		}
+
+		const auto find_parameter = [&macro](const token &tok) {
+			return tok == tokenid::identifier ? std::find(macro.parameters.begin(), macro.parameters.end(), tok.literal_as_view) : macro.parameters.end();
+		};
+
+		while (tok != tokenid::end_of_file)
+		{
+			token next = lexer.lex();
+
+			switch (tok)
+			{
+				case tokenid::hash:
+				{
+					while (next == tokenid::space)
+					{
+						next = lexer.lex();
+					}
+
+					if (next == tokenid::hash)
+					{
+						// The ## token concatenation operator pastes the tokens to its left and right together, so drop any whitespace around it
+						while (!result->elements.empty() && result->elements.back().type == element_type::token && result->elements.back().token == tokenid::space)
+						{
+							result->elements.pop_back();
+						}
+
+						do next = lexer.lex(); while (next == tokenid::space);
+
+						result->elements.push_back({ element_type::concat, 0, token() });
+						tok = next;
+						continue;
+					}
+
+					if (const auto it = find_parameter(next); macro.is_function_like && it != macro.parameters.end())
+					{
+						// The # stringize operator
+						result->elements.push_back({ element_type::stringize, static_cast<size_t>(std::distance(macro.parameters.begin(), it)), token() });
+						tok = lexer.lex();
+						continue;
+					}
+					break;
+				}
+				case tokenid::identifier:
+				{
+					if (const auto it = find_parameter(tok); it != macro.parameters.end())
+					{
+						result->elements.push_back({ element_type::argument, static_cast<size_t>(std::distance(macro.parameters.begin(), it)), token() });
+						tok = next;
+						continue;
+					}
+					break;
+				}
+			}
+
+			result->elements.push_back({ element_type::token, 0, tok });
+			tok = next;
+		}
+
+		return result;
+	}
+
+	include_cache &include_cache::global()
+	{
+		static include_cache s_cache;
+
+		return s_cache;
+	}
+
+	std::shared_ptr<const std::string> include_cache::load(const filesystem::path &path)
+	{
+		const uint64_t modified = filesystem::last_write_time(path);
+
+		{ const std::lock_guard<std::mutex> lock(_mutex);
+			const auto it = _files.find(path.string());
+
+			if (it != _files.end() && it->second.modified == modified)
+			{
+				_hits++;
+
+				return it->second.data;
+			}
+
+			_misses++;
+		}
+
+		std::ifstream file(path.wstring());
+
+		if (!file.is_open())
+		{
+			return nullptr;
+		}
+
+		auto data = std::make_shared<std::string>(std::istreambuf_iterator<char>(file.rdbuf()), std::istreambuf_iterator<char>());
+		data->push_back('\n');
+
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		auto &entry = _files[path.string()];
+		entry.modified = modified;
+		entry.data = std::move(data);
+		entry.include_guard.clear();
+		entry.pragma_once = false;
+
+		return entry.data;
+	}
+	void include_cache::clear()
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		_files.clear();
+		_snapshots.clear();
+	}
+
+	std::vector<std::shared_ptr<const preprocessor::snapshot>> include_cache::find_snapshots(const filesystem::path &path) const
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		const auto it = _snapshots.find(path.string());
+
+		if (it == _snapshots.end())
+		{
+			return { };
+		}
+
+		return it->second;
+	}
+	std::string include_cache::find_include_guard(const filesystem::path &path, const std::shared_ptr<const std::string> &data, bool &pragma_once) const
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		const auto it = _files.find(path.string());
+
+		if (it == _files.end() || it->second.data != data)
+		{
+			pragma_once = false;
+
+			return std::string();
+		}
+
+		pragma_once = it->second.pragma_once;
+
+		return it->second.include_guard;
+	}
+	void include_cache::store_include_guard(const filesystem::path &path, const std::shared_ptr<const std::string> &data, const std::string &macro_name)
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		const auto it = _files.find(path.string());
+
+		if (it != _files.end() && it->second.data == data)
+		{
+			it->second.include_guard = macro_name;
+		}
+	}
+	void include_cache::store_pragma_once(const filesystem::path &path, const std::shared_ptr<const std::string> &data)
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		const auto it = _files.find(path.string());
+
+		if (it != _files.end() && it->second.data == data)
+		{
+			it->second.pragma_once = true;
+		}
+	}
+
+	void include_cache::store_snapshot(const filesystem::path &path, std::shared_ptr<const preprocessor::snapshot> snapshot)
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		auto &snapshots = _snapshots[path.string()];
+
+		// Keep a few snapshots per header around, since effects may define different macros before including it
+		if (snapshots.size() >= 4)
+		{
+			snapshots.erase(snapshots.begin());
+		}
+
+		snapshots.push_back(std::move(snapshot));
+	}
 
 	void preprocessor::add_include_path(const filesystem::path &path)
 	{
@@ -32,7 +258,14 @@ namespace reshadefx
 	{
 		assert(!name.empty());
 
-		return _macros.emplace(name, macro).second;
+		const auto it = _macros.emplace(interner::global().intern(name), macro);
+
+		if (it.second && macro.replacement_tokens == nullptr)
+		{
+			it.first->second.replacement_tokens = tokenize_replacement_list(macro);
+		}
+
+		return it.second;
 	}
 	bool preprocessor::add_macro_definition(const std::string &name, const std::string &value)
 	{
@@ -41,61 +274,146 @@ namespace reshadefx
 
 		return add_macro_definition(name, macro);
 	}
+	void preprocessor::set_precompiled_header(const filesystem::path &filename)
+	{
+		_precompiled_header = filename;
+	}
 
 	bool preprocessor::run(const filesystem::path &file_path)
 	{
-		std::ifstream file(file_path.wstring());
+		const auto filedata = include_cache::global().load(file_path);
 
-		if (!file.is_open())
+		if (filedata == nullptr)
 		{
 			return false;
 		}
 
 		_success = true;
+		_streaming = false;
 		_filecache.clear();
+		_output_line.clear();
+		_synthesized_text.clear();
+		_retained_sources.clear();
+		_snapshot_recording.reset();
 
-		const std::string filedata(std::istreambuf_iterator<char>(file.rdbuf()), std::istreambuf_iterator<char>());
-
-		push(filedata + '\n', file_path.string());
+		push(filedata, file_path.string());
 		parse();
 
 		return _success;
 	}
 	bool preprocessor::run(const filesystem::path &file_path, std::vector<filesystem::path> &included_files)
 	{
-		if (run(file_path))
+		// Do not report the files of a previous run in case this one cannot even open the main file
+		_filecache.clear();
+
+		const bool success = run(file_path);
+
+		// Report the files that were opened even if pre-processing failed, so that fixing an error in one of them can be detected
+		for (const auto &element : _filecache)
+		{
+			included_files.push_back(element.first);
+		}
+
+		return success;
+	}
+
+	bool preprocessor::begin_stream(const filesystem::path &file_path)
+	{
+		const auto filedata = include_cache::global().load(file_path);
+
+		if (filedata == nullptr)
+		{
+			return false;
+		}
+
+		_success = true;
+		_streaming = true;
+		_filecache.clear();
+		_output_line.clear();
+		_synthesized_text.clear();
+		_retained_sources.clear();
+		_snapshot_recording.reset();
+
+		// Tokens of the main file may still be held on to by the consumer after its input level was popped
+		_retained_sources.push_back(filedata);
+
+		push(filedata, file_path.string());
+
+		return true;
+	}
+	token preprocessor::next_token()
+	{
+		assert(_streaming);
+
+		while (parse_next())
 		{
-			for (const auto &element : _filecache)
+			// Only render output text while recording a snapshot, since that is the only thing that needs it in streaming mode
+			if (_snapshot_recording != nullptr)
 			{
-				included_files.push_back(element.first);
+				append_to_output(current_token());
 			}
 
-			return true;
+			token tok = current_token();
+
+			switch (tok)
+			{
+				case tokenid::space:
+				case tokenid::end_of_line:
+					continue;
+				case tokenid::identifier:
+					tok.id = lexer::find_keyword(tok.literal_as_view);
+					break;
+				case tokenid::string_literal:
+					tok.literal_as_string = lexer::unescape_string_literal(tok.literal_as_view);
+					break;
+			}
+
+			return tok;
 		}
-		else
+
+		token tok;
+		tok.id = tokenid::end_of_file;
+		tok.location = _token.location;
+		tok.offset = tok.length = 0;
+		tok.literal_as_double = 0;
+
+		return tok;
+	}
+	bool preprocessor::end_stream()
+	{
+		while (next_token() != tokenid::end_of_file)
 		{
-			return false;
+			continue;
+		}
+
+		_streaming = false;
+
+		return _success;
+	}
+	bool preprocessor::end_stream(std::vector<filesystem::path> &included_files)
+	{
+		const bool success = end_stream();
+
+		for (const auto &element : _filecache)
+		{
+			included_files.push_back(element.first);
 		}
+
+		return success;
 	}
 
 	// Error handling
 	void preprocessor::error(const location &location, const std::string &message)
 	{
-		_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
+		_errors += std::string(location.source) + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
 		_success = false;
 	}
 	void preprocessor::warning(const location &location, const std::string &message)
 	{
-		_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
+		_errors += std::string(location.source) + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
 	}
 
 	// Input management
-	lexer &preprocessor::current_lexer()
-	{
-		assert(!_input_stack.empty());
-
-		return *_input_stack.top()._lexer;
-	}
 	std::stack<preprocessor::if_level> &preprocessor::current_if_stack()
 	{
 		assert(!_input_stack.empty());
@@ -106,24 +424,24 @@ namespace reshadefx
 	{
 		return current_if_stack().top();
 	}
-	void preprocessor::push(const std::string &input, const std::string &name)
+	void preprocessor::push(std::shared_ptr<const std::string> input, const std::string &name)
 	{
 		const auto parent = _input_stack.empty() ? nullptr : &_input_stack.top();
 
-		_input_stack.emplace(name, input, parent);
+		_input_stack.emplace(name, std::move(input), parent);
 
-		if (name.empty())
-		{
-			if (parent != nullptr)
-			{
-				_input_stack.top()._name = parent->_name;
-			}
-		}
-		else
-		{
-			_output_location.source = name;
-			_output += "#line 1 \"" + name + "\"\n";
-		}
+		_output_location.source = interner::global().intern_string(name);
+		_output += "#line 1 \"" + name + "\"\n";
+
+		consume();
+	}
+	void preprocessor::push(std::vector<token> &&tokens)
+	{
+		assert(!_input_stack.empty());
+
+		const auto parent = &_input_stack.top();
+
+		_input_stack.emplace(parent->_name, std::move(tokens), parent);
 
 		consume();
 	}
@@ -139,11 +457,26 @@ namespace reshadefx
 
 		auto &input_level = _input_stack.top();
 		_token = input_level._next_token;
-		_token.location.source = _output_location.source;
-		_current_token_raw_data = current_lexer().input_string().substr(_token.offset, _token.length);
 
-		input_level._next_token = input_level._lexer->lex();
-		input_level._offset = input_level._next_token.offset;
+		// Tokens that were replayed from a snapshot or come out of a macro expansion already know their source file
+		if (_token.location.source.empty())
+		{
+			_token.location.source = _output_location.source;
+		}
+
+		// Macro expansions are fed from an already tokenized sequence, rather than being turned back into text and lexed again
+		if (input_level._lexer != nullptr)
+		{
+			input_level._next_token = input_level._lexer->lex();
+		}
+		else if (input_level._token_index < input_level._tokens.size())
+		{
+			input_level._next_token = input_level._tokens[input_level._token_index++];
+		}
+		else
+		{
+			input_level._next_token.id = tokenid::end_of_file;
+		}
 
 		// Pop input level if lexical analysis has reached the end of it
 		while (_input_stack.top()._next_token == tokenid::end_of_file)
@@ -153,6 +486,18 @@ namespace reshadefx
 				error(current_if_level().token.location, "unterminated #if");
 			}
 
+			// Remember where the output of a header that is being recorded ends, so that the line directive returning to the parent file is not part of the snapshot
+			if (_snapshot_recording != nullptr && _input_stack.size() == 2)
+			{
+				_snapshot_recording->output_return = _output.size();
+			}
+
+			// Nothing but whitespace followed the #endif of the #ifndef that enclosed the entire file, so it can be skipped whenever that macro is defined
+			if (const auto &level = _input_stack.top(); level._guard_state == guard_closed)
+			{
+				include_cache::global().store_include_guard(level._name, level._text, level._guard_macro);
+			}
+
 			_input_stack.pop();
 
 			if (_input_stack.empty())
@@ -163,8 +508,13 @@ namespace reshadefx
 			if (_output_location.source != _input_stack.top()._name)
 			{
 				_output_location.line = 1;
-				_output_location.source = _input_stack.top()._name;
-				_output += "#line 1 \"" + _output_location.source + "\"\n";
+				_output_location.source = interner::global().intern_string(_input_stack.top()._name);
+				_output += "#line 1 \"" + _input_stack.top()._name + "\"\n";
+			}
+
+			if (_snapshot_recording != nullptr && _input_stack.size() == 1)
+			{
+				_snapshot_recording->output_after_return_begin = _output.size();
 			}
 		}
 	}
@@ -199,7 +549,7 @@ namespace reshadefx
 
 			const auto &actual_token = _input_stack.top()._next_token;
 
-			error(actual_token.location, "syntax error: unexpected token '" + current_lexer().input_string().substr(actual_token.offset, actual_token.length) + "'");
+			error(actual_token.location, "syntax error: unexpected token '" + std::string(actual_token.literal_as_view) + "'");
 
 			return false;
 		}
@@ -210,16 +560,40 @@ namespace reshadefx
 	// Parsing routines
 	void preprocessor::parse()
 	{
-		std::string line;
+		while (parse_next())
+		{
+			append_to_output(current_token());
+		}
 
+		_output += _output_line;
+		_output_line.clear();
+	}
+	bool preprocessor::parse_next()
+	{
 		while (!_input_stack.empty())
 		{
 			_recursion_count = 0;
 
+			if (_snapshot_recording != nullptr && _input_stack.size() == 1)
+			{
+				end_snapshot();
+			}
+
 			const bool skip = !current_if_stack().empty() && current_if_level().skipping;
 
 			consume();
 
+			// Only a file that starts with #ifndef and has nothing but whitespace after the matching #endif is considered guarded
+			if (current_token() != tokenid::space && current_token() != tokenid::end_of_line)
+			{
+				auto &level = _input_stack.top();
+
+				if ((level._guard_state == guard_unknown && current_token() != tokenid::hash_ifndef) || level._guard_state == guard_closed)
+				{
+					level._guard_state = guard_none;
+				}
+			}
+
 			switch (current_token())
 			{
 				case tokenid::hash_if:
@@ -290,35 +664,43 @@ namespace reshadefx
 					parse_include();
 					continue;
 				case tokenid::hash_unknown:
-					error(current_token().location, "unrecognized preprocessing directive '" + current_token().literal_as_string + "'");
+					error(current_token().location, "unrecognized preprocessing directive '" + std::string(current_token().literal_as_view) + "'");
 					consume_until(tokenid::end_of_line);
 					continue;
 
-				case tokenid::end_of_line:
-					if (line.empty())
-					{
-						continue;
-					}
-					if (++_output_location.line != current_token().location.line)
-					{
-						_output += "#line " + std::to_string(_output_location.line = current_token().location.line) + '\n';
-					}
-					_output += line + '\n';
-					line.clear();
-					continue;
-
 				case tokenid::identifier:
-					if (evaluate_identifier_as_macro())
+					if (_input_stack.top()._expand_macros && evaluate_identifier_as_macro())
 					{
 						continue;
 					}
-				default:
-					line += _current_token_raw_data;
 					break;
 			}
+
+			return true;
 		}
 
-		_output += line;
+		return false;
+	}
+	void preprocessor::append_to_output(const token &tok)
+	{
+		if (tok != tokenid::end_of_line)
+		{
+			_output_line += tok.literal_as_view;
+			return;
+		}
+
+		if (_output_line.empty())
+		{
+			return;
+		}
+
+		if (++_output_location.line != tok.location.line)
+		{
+			_output += "#line " + std::to_string(_output_location.line = tok.location.line) + '\n';
+		}
+
+		_output += _output_line + '\n';
+		_output_line.clear();
 	}
 	void preprocessor::parse_def()
 	{
@@ -329,8 +711,7 @@ namespace reshadefx
 
 		macro m;
 		const auto location = current_token().location;
-		const auto macro_name = current_token().literal_as_string;
-		const auto macro_name_end_offset = current_token().offset + current_token().length;
+		const auto macro_name = std::string(current_token().literal_as_view);
 
 		if (macro_name == "defined")
 		{
@@ -338,15 +719,16 @@ namespace reshadefx
 			return;
 		}
 
-		if (current_lexer().input_string()[macro_name_end_offset] == '(')
+		// A function-like macro has its parameter list follow the name without any whitespace in between
+		if (peek(tokenid::parenthesis_open))
 		{
-			accept(tokenid::parenthesis_open);
+			consume();
 
 			m.is_function_like = true;
 
 			while (accept(tokenid::identifier))
 			{
-				m.parameters.push_back(current_token().literal_as_string);
+				m.parameters.emplace_back(current_token().literal_as_view);
 
 				if (!accept(tokenid::comma))
 				{
@@ -386,15 +768,21 @@ namespace reshadefx
 		}
 
 		const auto location = current_token().location;
-		const auto &macro_name = current_token().literal_as_string;
 
-		if (macro_name == "defined")
+		if (current_token().literal_as_view == "defined")
 		{
 			warning(location, "macro name 'defined' is reserved");
 			return;
 		}
 
-		_macros.erase(macro_name);
+		const auto it = _macros.find(current_token().literal_as_atom);
+
+		if (it != _macros.end())
+		{
+			// Tokens of the expansion may still be in flight, so keep them valid until the end of the run
+			_retained_sources.push_back(it->second.replacement_tokens);
+			_macros.erase(it);
+		}
 	}
 	void preprocessor::parse_if()
 	{
@@ -421,9 +809,7 @@ namespace reshadefx
 			return;
 		}
 
-		const auto &macro_name = current_token().literal_as_string;
-
-		level.value = _macros.find(macro_name) != _macros.end();
+		level.value = _macros.find(current_token().literal_as_atom) != _macros.end();
 		level.skipping = (parent != nullptr && parent->skipping) || !level.value;
 		level.parent = parent;
 
@@ -441,9 +827,13 @@ namespace reshadefx
 			return;
 		}
 
-		const auto &macro_name = current_token().literal_as_string;
+		if (auto &input_level = _input_stack.top(); input_level._guard_state == guard_unknown && parent == nullptr)
+		{
+			input_level._guard_state = guard_open;
+			input_level._guard_macro = current_token().literal_as_view;
+		}
 
-		level.value = _macros.find(macro_name) == _macros.end();
+		level.value = _macros.find(current_token().literal_as_atom) == _macros.end();
 		level.skipping = (parent != nullptr && parent->skipping) || !level.value;
 		level.parent = parent;
 
@@ -466,6 +856,11 @@ namespace reshadefx
 
 		const bool condition_result = evaluate_expression();
 
+		if (current_if_stack().size() == 1)
+		{
+			_input_stack.top()._guard_state = guard_none;
+		}
+
 		if_level &level = current_if_level();
 		level.token = current_token();
 		level.skipping = (level.parent != nullptr && level.parent->skipping) || level.value || !condition_result;
@@ -490,6 +885,11 @@ namespace reshadefx
 			return;
 		}
 
+		if (current_if_stack().size() == 1)
+		{
+			_input_stack.top()._guard_state = guard_none;
+		}
+
 		if_level &level = current_if_level();
 		level.token = current_token();
 		level.skipping = (level.parent != nullptr && level.parent->skipping) || level.value;
@@ -509,6 +909,11 @@ namespace reshadefx
 			return;
 		}
 
+		if (auto &input_level = _input_stack.top(); input_level._guard_state == guard_open && current_if_stack().size() == 1)
+		{
+			input_level._guard_state = guard_closed;
+		}
+
 		current_if_stack().pop();
 	}
 	void preprocessor::parse_error()
@@ -540,7 +945,7 @@ namespace reshadefx
 			return;
 		}
 
-		std::string pragma = current_token().literal_as_string;
+		std::string pragma(current_token().literal_as_view);
 
 		while (!peek(tokenid::end_of_line) && !peek(tokenid::end_of_file))
 		{
@@ -558,18 +963,18 @@ namespace reshadefx
 						continue;
 					}
 				default:
-					pragma += _current_token_raw_data;
+					pragma += current_token().literal_as_view;
 					break;
 			}
 		}
 
 		if (pragma == "once")
 		{
-			const auto it = _filecache.find(_output_location.source);
+			const auto it = _filecache.find(std::string(_output_location.source));
 
 			if (it != _filecache.end())
 			{
-				it->second.clear();
+				include_cache::global().store_pragma_once(it->first, it->second);
 			}
 		}
 
@@ -596,32 +1001,171 @@ namespace reshadefx
 		}
 
 		filesystem::path filename = current_token().literal_as_string;
-		filesystem::path filepath = filesystem::path(_output_location.source).remove_filename() / filename;
+		filesystem::path filepath = filesystem::path(std::string(_output_location.source)).remove_filename() / filename;
 
 		if (!filesystem::exists(filepath))
 		{
 			filepath = filesystem::resolve(filename, _include_paths);
 		}
 
-		auto it = _filecache.find(filepath.string());
+		const auto it = _filecache.find(filepath.string());
+		std::shared_ptr<const std::string> filedata;
 
-		if (it == _filecache.end())
+		if (it != _filecache.end())
 		{
-			std::ifstream file(filepath.wstring());
+			filedata = it->second;
+		}
+		else if (filedata = include_cache::global().load(filepath); filedata == nullptr)
+		{
+			error(keyword_location, "could not open included file '" + filepath.string() + "'");
+			consume_until(tokenid::end_of_line);
+			return;
+		}
+
+		// Skip files that are known to disable themselves right away, instead of lexing all of their contents again
+		bool pragma_once = false;
+		const auto guard_macro = include_cache::global().find_include_guard(filepath, filedata, pragma_once);
 
-			if (!file.is_open())
+		if ((pragma_once && it != _filecache.end()) || (!guard_macro.empty() && _macros.find(interner::global().find(guard_macro)) != _macros.end()))
+		{
+			return;
+		}
+
+		// Headers designated for precompilation are only handled when included by the main file for the first time
+		if (it == _filecache.end() && _input_stack.size() == 1 && _snapshot_recording == nullptr && !_precompiled_header.empty() && filepath.filename() == _precompiled_header)
+		{
+			if (resume_from_snapshot(filepath))
 			{
-				error(keyword_location, "could not open included file '" + filepath.string() + "'");
-				consume_until(tokenid::end_of_line);
 				return;
 			}
 
-			const std::string filedata(std::istreambuf_iterator<char>(file.rdbuf()), std::istreambuf_iterator<char>());
+			begin_snapshot(filepath);
+		}
+
+		if (it == _filecache.end())
+		{
+			_filecache.emplace(filepath.string(), filedata);
+		}
+
+		push(std::move(filedata), filepath.string());
+	}
+
+	bool preprocessor::resume_from_snapshot(const filesystem::path &path)
+	{
+		for (const auto &snapshot : include_cache::global().find_snapshots(path))
+		{
+			if (snapshot->macros_before != _macros ||
+				std::any_of(snapshot->dependencies.begin(), snapshot->dependencies.end(),
+					[](const auto &dependency) { return filesystem::last_write_time(dependency.first) != dependency.second; }))
+			{
+				continue;
+			}
+
+			// Reproduce everything processing the header would have done
+			std::string output = snapshot->output;
+
+			if (snapshot->output_after_return_begin > snapshot->output_return)
+			{
+				output += "#line 1 \"" + std::string(_output_location.source) + "\"\n";
+			}
+
+			output += snapshot->output_after_return;
+
+			if (_streaming)
+			{
+				// Replay the output as a new input level, whose line directives restore the original source locations of its tokens
+				if (output.empty() || output.back() != '\n')
+				{
+					output += '\n';
+				}
+
+				const auto parent = &_input_stack.top();
+
+				_input_stack.emplace(parent->_name, std::make_shared<const std::string>(std::move(output)), parent);
+				_input_stack.top()._expand_macros = false;
+				_retained_sources.push_back(_input_stack.top()._text);
+
+				consume();
+			}
+			else
+			{
+				_output += output;
+			}
+
+			_output_location.line = snapshot->output_line;
+
+			for (const auto &macro : _macros)
+			{
+				_retained_sources.push_back(macro.second.replacement_tokens);
+			}
+
+			_macros = snapshot->macros_after;
+			_pragmas.insert(_pragmas.end(), snapshot->pragmas.begin(), snapshot->pragmas.end());
+			_filecache.insert(snapshot->filecache.begin(), snapshot->filecache.end());
+
+			return true;
+		}
+
+		return false;
+	}
+	void preprocessor::begin_snapshot(const filesystem::path &path)
+	{
+		_snapshot_recording = std::make_shared<snapshot>();
+		_snapshot_recording->macros_before = _macros;
+		_snapshot_recording->dependencies.emplace_back(path.string(), 0);
+		_snapshot_recording->output_begin = _output.size();
+		_snapshot_recording->pragmas_begin = _pragmas.size();
+		_snapshot_recording->errors_begin = _errors.size();
+
+		for (const auto &file : _filecache)
+		{
+			_snapshot_recording->filecache.insert(file);
+		}
+	}
+	void preprocessor::end_snapshot()
+	{
+		const auto recording = std::move(_snapshot_recording);
+
+		// Do not save headers that produced errors or warnings, so those are reported again by every run
+		if (_errors.size() != recording->errors_begin || recording->output_return == std::string::npos)
+		{
+			return;
+		}
+
+		const auto header_path = recording->dependencies.front().first;
+
+		// Only keep the files that were opened while processing the header
+		std::unordered_map<std::string, std::shared_ptr<const std::string>> filecache;
+
+		for (const auto &file : _filecache)
+		{
+			if (recording->filecache.find(file.first) != recording->filecache.end())
+			{
+				continue;
+			}
+
+			filecache.insert(file);
 
-			it = _filecache.emplace(filepath.string(), filedata + '\n').first;
+			if (file.first != header_path)
+			{
+				recording->dependencies.emplace_back(file.first, 0);
+			}
 		}
 
-		push(it->second, filepath.string());
+		recording->filecache = std::move(filecache);
+
+		for (auto &dependency : recording->dependencies)
+		{
+			dependency.second = filesystem::last_write_time(dependency.first);
+		}
+
+		recording->macros_after = _macros;
+		recording->pragmas.assign(_pragmas.begin() + recording->pragmas_begin, _pragmas.end());
+		recording->output = _output.substr(recording->output_begin, recording->output_return - recording->output_begin);
+		recording->output_after_return = _output.substr(recording->output_after_return_begin);
+		recording->output_line = _output_location.line;
+
+		include_cache::global().store_snapshot(header_path, recording);
 	}
 
 	bool preprocessor::evaluate_expression()
@@ -796,7 +1340,7 @@ namespace reshadefx
 					{
 						continue;
 					}
-					else if (current_token().literal_as_string == "exists")
+					else if (current_token().literal_as_view == "exists")
 					{
 						const bool has_parentheses = accept(tokenid::parenthesis_open);
 
@@ -815,7 +1359,7 @@ namespace reshadefx
 						}
 
 						const filesystem::path filename = current_token().literal_as_string;
-						const filesystem::path filename_with_current_directory = filesystem::path(_output_location.source).remove_filename() / filename;
+						const filesystem::path filename_with_current_directory = filesystem::path(std::string(_output_location.source)).remove_filename() / filename;
 
 						if (has_parentheses && !expect(tokenid::parenthesis_close))
 						{
@@ -826,7 +1370,7 @@ namespace reshadefx
 						rpn[rpn_count++].value = filesystem::exists(filename_with_current_directory) || filesystem::exists(filesystem::resolve(filename, _include_paths));
 						continue;
 					}
-					else if (current_token().literal_as_string == "defined")
+					else if (current_token().literal_as_view == "defined")
 					{
 						const bool has_parentheses = accept(tokenid::parenthesis_open);
 
@@ -835,7 +1379,7 @@ namespace reshadefx
 							return false;
 						}
 
-						const bool is_macro_defined = _macros.find(current_token().literal_as_string) != _macros.end();
+						const bool is_macro_defined = _macros.find(current_token().literal_as_atom) != _macros.end();
 
 						if (has_parentheses && !expect(tokenid::parenthesis_close))
 						{
@@ -970,7 +1514,7 @@ namespace reshadefx
 			return false;
 		}
 
-		const auto it = _macros.find(current_token().literal_as_string);
+		const auto it = _macros.find(current_token().literal_as_atom);
 
 		if (it == _macros.end())
 		{
@@ -978,7 +1522,8 @@ namespace reshadefx
 		}
 
 		const auto &macro = it->second;
-		std::vector<std::string> arguments;
+		const auto location = current_token().location;
+		std::vector<std::vector<token>> arguments;
 
 		if (macro.is_function_like)
 		{
@@ -990,10 +1535,16 @@ namespace reshadefx
 			while (true)
 			{
 				int parentheses_level = 0;
-				std::string argument;
+				std::vector<token> argument;
 
 				while (true)
 				{
+					if (_input_stack.empty())
+					{
+						error(current_token().location, "unexpected end of file in macro invocation");
+						return false;
+					}
+
 					consume();
 
 					if (current_token() == tokenid::parenthesis_open)
@@ -1007,70 +1558,222 @@ namespace reshadefx
 						break;
 					}
 
-					argument += _current_token_raw_data;
+					argument.push_back(current_token());
+
+					// Arguments may span multiple lines, but the new line characters are only whitespace inside them
+					if (argument.back() == tokenid::end_of_line)
+					{
+						argument.back().id = tokenid::space;
+						argument.back().literal_as_view = " ";
+					}
 				}
 
-				if (!argument.empty() && argument.back() == ' ')
+				while (!argument.empty() && argument.back() == tokenid::space)
 				{
 					argument.pop_back();
 				}
-				if (!argument.empty() && argument.front() == ' ')
+				if (!argument.empty() && argument.front() == tokenid::space)
 				{
-					argument.erase(0, 1);
+					argument.erase(argument.begin());
 				}
 
-				arguments.push_back(argument);
+				arguments.push_back(std::move(argument));
 
 				if (parentheses_level < 0)
 				{
 					break;
 				}
 			}
+
+			if (arguments.size() < macro.parameters.size() && !(arguments.size() == 1 && macro.parameters.empty()))
+			{
+				error(current_token().location, "not enough arguments for function-like macro invocation '" + std::string(interner::global().name(it->first)) + "'");
+				return false;
+			}
 		}
 
-		std::string input;
-		expand_macro(it->second, arguments, input);
+		std::vector<token> tokens;
+		expand_macro(macro, location, arguments, tokens);
 
-		push(input);
+		push(std::move(tokens));
 
 		return true;
 	}
 
 	// Macro management routines
-	void preprocessor::expand_macro(const macro &macro, const std::vector<std::string> &arguments, std::string &out)
+	void preprocessor::expand_macro(const macro &macro, const location &location, const std::vector<std::vector<token>> &arguments, std::vector<token> &out)
 	{
-		for (auto it = macro.replacement_list.begin(); it != macro.replacement_list.end(); ++it)
+		using element_type = replacement::element_type;
+
+		assert(macro.replacement_tokens != nullptr);
+
+		size_t concat_index = std::string::npos;
+
+		for (const auto &element : macro.replacement_tokens->elements)
 		{
-			if (*it == macro_replacement_start)
+			const size_t index = out.size();
+
+			switch (element.type)
 			{
-				switch (*++it)
+				case element_type::token:
+					out.push_back(element.token);
+					out.back().location = location;
+					break;
+				case element_type::argument:
+					// Arguments are fully macro-expanded in isolation before they are substituted
+					expand_tokens(arguments[element.argument_index], out);
+					break;
+				case element_type::stringize:
 				{
-					case macro_replacement_concat:
-						continue;
-					case macro_replacement_stringize:
-						out += '"' + arguments.at(*++it) + '"';
-						break;
-					case macro_replacement_argument:
-						push(arguments.at(*++it) + static_cast<char>(macro_replacement_argument));
-						while (!accept(tokenid::unknown))
-						{
-							consume();
+					std::string text(1, '"');
 
-							if (current_token() == tokenid::identifier && evaluate_identifier_as_macro())
-							{
-								continue;
-							}
+					for (const auto &tok : arguments[element.argument_index])
+					{
+						text += tok.literal_as_view;
+					}
 
-							out += _current_token_raw_data;
-						}
-						assert(_current_token_raw_data[0] == macro_replacement_argument);
+					text += '"';
+
+					out.push_back(synthesize_token(tokenid::string_literal, std::move(text), location));
+					out.back().literal_as_string = out.back().literal_as_view.substr(1, out.back().literal_as_view.size() - 2);
+					break;
+				}
+				case element_type::concat:
+					concat_index = index;
+					continue;
+			}
+
+			// Paste the last token before the ## operator and the first token after it together
+			if (concat_index != std::string::npos)
+			{
+				if (concat_index != 0 && concat_index < out.size())
+				{
+					auto &lhs = out[concat_index - 1];
+					const auto &rhs = out[concat_index];
+					const auto pasted = synthesize_token(tokenid::unknown, std::string(lhs.literal_as_view) + std::string(rhs.literal_as_view), lhs.location);
+
+					lexer lexer(pasted.literal_as_view, false, false, true, false);
+					std::vector<token> pasted_tokens;
+
+					auto start = lexer.save();
+					start.location.column = 2;
+					lexer.restore(start);
+
+					for (token tok = lexer.lex(); tok != tokenid::end_of_file; tok = lexer.lex())
+					{
+						tok.location = lhs.location;
+						pasted_tokens.push_back(std::move(tok));
+					}
+
+					out.erase(out.begin() + (concat_index - 1), out.begin() + (concat_index + 1));
+					out.insert(out.begin() + (concat_index - 1), pasted_tokens.begin(), pasted_tokens.end());
+				}
+
+				concat_index = std::string::npos;
+			}
+		}
+	}
+	void preprocessor::expand_tokens(const std::vector<token> &tokens, std::vector<token> &out)
+	{
+		for (size_t i = 0; i < tokens.size(); ++i)
+		{
+			const auto &tok = tokens[i];
+
+			if (tok != tokenid::identifier)
+			{
+				out.push_back(tok);
+				continue;
+			}
+
+			const auto it = _macros.find(tok.literal_as_atom);
+
+			if (it == _macros.end())
+			{
+				out.push_back(tok);
+				continue;
+			}
+
+			const auto &macro = it->second;
+			std::vector<std::vector<token>> arguments;
+			size_t end = i + 1;
+
+			if (macro.is_function_like)
+			{
+				while (end < tokens.size() && tokens[end] == tokenid::space)
+				{
+					end++;
+				}
+
+				// Function-like macros without an argument list are not expanded, the invocation may be completed after substitution
+				if (end == tokens.size() || tokens[end] != tokenid::parenthesis_open)
+				{
+					out.push_back(tok);
+					continue;
+				}
+
+				int parentheses_level = 0;
+				arguments.emplace_back();
+
+				for (end++; end < tokens.size(); end++)
+				{
+					const auto &arg = tokens[end];
+
+					if (arg == tokenid::parenthesis_open)
+					{
+						parentheses_level++;
+					}
+					else if (arg == tokenid::parenthesis_close && --parentheses_level < 0)
+					{
 						break;
+					}
+					else if (arg == tokenid::comma && parentheses_level == 0)
+					{
+						arguments.emplace_back();
+						continue;
+					}
+
+					if (arg != tokenid::space || !arguments.back().empty())
+					{
+						arguments.back().push_back(arg);
+					}
+				}
+
+				if (end == tokens.size())
+				{
+					out.push_back(tok);
+					continue;
+				}
+
+				end++;
+
+				for (auto &argument : arguments)
+				{
+					while (!argument.empty() && argument.back() == tokenid::space)
+					{
+						argument.pop_back();
+					}
+				}
+
+				if (arguments.size() < macro.parameters.size() && !(arguments.size() == 1 && macro.parameters.empty()))
+				{
+					error(tok.location, "not enough arguments for function-like macro invocation '" + std::string(interner::global().name(it->first)) + "'");
+					return;
 				}
 			}
-			else
+
+			if (_recursion_count++ >= 256)
 			{
-				out += *it;
+				error(tok.location, "macro recursion too high");
+				return;
 			}
+
+			// Rescan the expansion together with the remaining tokens, so that it can be completed by what follows it
+			std::vector<token> expansion;
+			expand_macro(macro, tok.location, arguments, expansion);
+			expansion.insert(expansion.end(), tokens.begin() + end, tokens.end());
+
+			expand_tokens(expansion, out);
+			return;
 		}
 	}
 	void preprocessor::create_macro_replacement_list(macro &macro)
@@ -1089,6 +1792,8 @@ namespace reshadefx
 			{
 				case tokenid::hash:
 				{
+					macro.replacement_list += current_token().literal_as_view;
+
 					if (accept(tokenid::hash))
 					{
 						if (peek(tokenid::end_of_line))
@@ -1098,8 +1803,7 @@ namespace reshadefx
 						}
 
 						// the ## token concatenation operator
-						macro.replacement_list += macro_replacement_start;
-						macro.replacement_list += macro_replacement_concat;
+						macro.replacement_list += current_token().literal_as_view;
 						continue;
 					}
 					else if (macro.is_function_like)
@@ -1109,21 +1813,16 @@ namespace reshadefx
 							return;
 						}
 
-						const auto it = std::find(macro.parameters.begin(), macro.parameters.end(), current_token().literal_as_string);
-
-						if (it == macro.parameters.end())
+						if (std::find(macro.parameters.begin(), macro.parameters.end(), current_token().literal_as_view) == macro.parameters.end())
 						{
 							error(current_token().location, "# must be followed by parameter name");
 							return;
 						}
 
 						// the # stringize operator
-						macro.replacement_list += macro_replacement_start;
-						macro.replacement_list += macro_replacement_stringize;
-						macro.replacement_list += static_cast<char>(std::distance(macro.parameters.begin(), it));
-						continue;
+						macro.replacement_list += current_token().literal_as_view;
 					}
-					break;
+					continue;
 				}
 				case tokenid::backslash:
 				{
@@ -1134,22 +1833,24 @@ namespace reshadefx
 					}
 					break;
 				}
-				case tokenid::identifier:
-				{
-					const auto it = std::find(macro.parameters.begin(), macro.parameters.end(), current_token().literal_as_string);
-
-					if (it != macro.parameters.end())
-					{
-						macro.replacement_list += macro_replacement_start;
-						macro.replacement_list += macro_replacement_argument;
-						macro.replacement_list += static_cast<char>(std::distance(macro.parameters.begin(), it));
-						continue;
-					}
-					break;
-				}
 			}
 
-			macro.replacement_list += _current_token_raw_data;
+			macro.replacement_list += current_token().literal_as_view;
 		}
 	}
+	token preprocessor::synthesize_token(tokenid id, std::string &&text, const location &location)
+	{
+		// Keep the text of tokens created during expansion around until the end of the run, so that they can refer to it like any other token
+		const auto &storage = _synthesized_text.emplace_back(std::move(text));
+
+		token tok;
+		tok.id = id;
+		tok.location = location;
+		tok.offset = 0;
+		tok.length = storage.size();
+		tok.literal_as_double = 0;
+		tok.literal_as_view = storage;
+
+		return tok;
+	}
 }
@@ -6,9 +6,11 @@
 #pragma once
 
 #include <stack>
+#include <deque>
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include "effect_lexer.hpp"
 #include "filesystem.hpp"
 
@@ -20,16 +22,25 @@ namespace reshadefx
 	class preprocessor
 	{
 	public:
+		struct replacement;
 		struct macro
 		{
 			std::string replacement_list;
 			bool is_function_like = false, is_variadic = false;
 			std::vector<std::string> parameters;
+			std::shared_ptr<const replacement> replacement_tokens; // Tokenized replacement list, filled in once when the macro is defined
 		};
+		struct snapshot;
 
 		void add_include_path(const reshade::filesystem::path &path);
 		bool add_macro_definition(const std::string &name, const macro &macro);
 		bool add_macro_definition(const std::string &name, const std::string &value = "1");
+		/// <summary>
+		/// Designate a header after which the pre-processor state (macros, pragmas and output) is saved to the shared include cache.
+		/// Later runs that include the same header from their main file with identical macro definitions resume from that snapshot instead of processing it again.
+		/// </summary>
+		/// <param name="filename">The file name of the header, e.g. "ReShade.fxh".</param>
+		void set_precompiled_header(const reshade::filesystem::path &filename);
 
 		const std::string &errors() const { return _errors; }
 		const std::string &current_output() const { return _output; }
@@ -38,6 +49,25 @@ namespace reshadefx
 		bool run(const reshade::filesystem::path &file_path);
 		bool run(const reshade::filesystem::path &file_path, std::vector<reshade::filesystem::path> &included_files);
 
+		/// <summary>
+		/// Start pre-processing a file in streaming mode. Instead of rendering the output to a string, it is handed out token by token through "next_token", so that a parser can consume it directly.
+		/// </summary>
+		/// <param name="file_path">The path to the file to pre-process.</param>
+		/// <returns>A boolean value indicating whether the file could be opened.</returns>
+		bool begin_stream(const reshade::filesystem::path &file_path);
+		/// <summary>
+		/// Pre-process input until the next output token is available. Tokens are converted to what the parser expects (whitespace is skipped, keywords are resolved and string literals are escaped) and keep the location in their original source file.
+		/// The tokens may refer to memory owned by the pre-processor, so they are only valid until the next call to "begin_stream" or "run".
+		/// </summary>
+		/// <returns>The next output token, or an end of file token once all input was processed.</returns>
+		token next_token();
+		/// <summary>
+		/// Finish pre-processing in streaming mode, which processes any input that was not requested via "next_token" yet.
+		/// </summary>
+		/// <returns>A boolean value indicating whether pre-processing was successful or not.</returns>
+		bool end_stream();
+		bool end_stream(std::vector<reshade::filesystem::path> &included_files);
+
 	private:
 		struct if_level
 		{
@@ -45,21 +75,43 @@ namespace reshadefx
 			bool value, skipping;
 			if_level *parent;
 		};
+		enum guard_state
+		{
+			guard_unknown,
+			guard_open,
+			guard_closed,
+			guard_none,
+		};
 		struct input_level
 		{
-			input_level(const std::string &name, const std::string &text, input_level *parent) :
+			input_level(const std::string &name, std::shared_ptr<const std::string> text, input_level *parent) :
 				_name(name),
-				_lexer(new lexer(text, false, false, true, false)),
+				_text(std::move(text)),
+				_lexer(new lexer(std::string_view(*_text), false, false, true, false)),
+				_parent(parent)
+			{
+				_next_token.id = tokenid::unknown;
+				_next_token.offset = _next_token.length = 0;
+			}
+			input_level(const std::string &name, std::vector<token> &&tokens, input_level *parent) :
+				_guard_state(guard_none),
+				_name(name),
+				_tokens(std::move(tokens)),
 				_parent(parent)
 			{
 				_next_token.id = tokenid::unknown;
 				_next_token.offset = _next_token.length = 0;
 			}
 
+			bool _expand_macros = true;
+			int _guard_state = guard_unknown;
+			std::string _guard_macro;
 			std::string _name;
+			std::shared_ptr<const std::string> _text;
 			std::unique_ptr<lexer> _lexer;
+			std::vector<token> _tokens;
+			size_t _token_index = 0;
 			token _next_token;
-			size_t _offset;
 			std::stack<if_level> _if_stack;
 			input_level *_parent;
 		};
@@ -67,11 +119,11 @@ namespace reshadefx
 		void error(const location &location, const std::string &message);
 		void warning(const location &location, const std::string &message);
 
-		lexer &current_lexer();
-		inline token current_token() const { return _token; }
+		inline const token &current_token() const { return _token; }
 		std::stack<if_level> &current_if_stack();
 		if_level &current_if_level();
-		void push(const std::string &input, const std::string &name = std::string());
+		void push(std::shared_ptr<const std::string> input, const std::string &name);
+		void push(std::vector<token> &&tokens);
 		bool peek(tokenid token) const;
 		void consume();
 		void consume_until(tokenid token);
@@ -79,6 +131,8 @@ namespace reshadefx
 		bool expect(tokenid token);
 
 		void parse();
+		bool parse_next();
+		void append_to_output(const token &tok);
 		void parse_def();
 		void parse_undef();
 		void parse_if();
@@ -92,21 +146,106 @@ namespace reshadefx
 		void parse_pragma();
 		void parse_include();
 
+		bool resume_from_snapshot(const reshade::filesystem::path &path);
+		void begin_snapshot(const reshade::filesystem::path &path);
+		void end_snapshot();
+
 		bool evaluate_expression();
 		bool evaluate_identifier_as_macro();
 
-		void expand_macro(const macro &macro, const std::vector<std::string> &arguments, std::string &out);
+		void expand_macro(const macro &macro, const location &location, const std::vector<std::vector<token>> &arguments, std::vector<token> &out);
+		void expand_tokens(const std::vector<token> &tokens, std::vector<token> &out);
 		void create_macro_replacement_list(macro &macro);
+		token synthesize_token(tokenid id, std::string &&text, const location &location);
 
-		bool _success = true;
+		bool _success = true, _streaming = false;
 		token _token;
 		std::stack<input_level> _input_stack;
 		location _output_location;
-		std::string _output, _errors, _current_token_raw_data;
+		std::string _output, _output_line, _errors;
+		std::deque<std::string> _synthesized_text;
+		std::vector<std::shared_ptr<const void>> _retained_sources;
 		int _recursion_count = 0;
-		std::unordered_map<std::string, macro> _macros;
+		std::unordered_map<atom, macro> _macros;
 		std::vector<std::string> _pragmas;
 		std::vector<reshade::filesystem::path> _include_paths;
-		std::unordered_map<std::string, std::string> _filecache;
+		std::unordered_map<std::string, std::shared_ptr<const std::string>> _filecache;
+		reshade::filesystem::path _precompiled_header;
+		std::shared_ptr<snapshot> _snapshot_recording;
+	};
+
+	/// <summary>
+	/// A cache of source files keyed by their resolved path, which is shared between pre-processor instances.
+	/// Entries are validated against the file modification time on every lookup, so it stays valid across effect reloads.
+	/// </summary>
+	class include_cache
+	{
+	public:
+		/// <summary>
+		/// Returns the process-wide cache instance used by all pre-processors.
+		/// </summary>
+		static include_cache &global();
+
+		/// <summary>
+		/// Returns the contents of the file at the specified path, reading it from disk only if it was not cached yet or has been modified since.
+		/// </summary>
+		/// <param name="path">The resolved path to the file.</param>
+		/// <returns>The file contents followed by a new line, or a null pointer if the file could not be opened.</returns>
+		std::shared_ptr<const std::string> load(const reshade::filesystem::path &path);
+		/// <summary>
+		/// Remove all files from the cache.
+		/// </summary>
+		void clear();
+
+		/// <summary>
+		/// Returns the pre-processor snapshots that were saved after processing the specified header.
+		/// </summary>
+		/// <param name="path">The resolved path to the header file.</param>
+		std::vector<std::shared_ptr<const preprocessor::snapshot>> find_snapshots(const reshade::filesystem::path &path) const;
+		/// <summary>
+		/// Save a pre-processor snapshot for the specified header, replacing the oldest one if there are too many already.
+		/// </summary>
+		/// <param name="path">The resolved path to the header file.</param>
+		/// <param name="snapshot">The snapshot to save.</param>
+		void store_snapshot(const reshade::filesystem::path &path, std::shared_ptr<const preprocessor::snapshot> snapshot);
+
+		/// <summary>
+		/// Returns the macro that guards the specified file against multiple inclusion (the classic "#ifndef X / #define X / ... / #endif" idiom), as detected while it was last pre-processed.
+		/// </summary>
+		/// <param name="path">The resolved path to the file.</param>
+		/// <param name="data">The file contents that are about to be included, which have to match the cached ones for the result to apply.</param>
+		/// <param name="pragma_once">Set to whether the file contains a "#pragma once" directive.</param>
+		/// <returns>The name of the guard macro, or an empty string if the file is not guarded.</returns>
+		std::string find_include_guard(const reshade::filesystem::path &path, const std::shared_ptr<const std::string> &data, bool &pragma_once) const;
+		/// <summary>
+		/// Remember the macro that guards the specified file against multiple inclusion.
+		/// </summary>
+		/// <param name="path">The resolved path to the file.</param>
+		/// <param name="data">The file contents the guard was detected in.</param>
+		/// <param name="macro_name">The name of the guard macro.</param>
+		void store_include_guard(const reshade::filesystem::path &path, const std::shared_ptr<const std::string> &data, const std::string &macro_name);
+		/// <summary>
+		/// Remember that the specified file contains a "#pragma once" directive.
+		/// </summary>
+		/// <param name="path">The resolved path to the file.</param>
+		/// <param name="data">The file contents the directive was found in.</param>
+		void store_pragma_once(const reshade::filesystem::path &path, const std::shared_ptr<const std::string> &data);
+
+		size_t hits() const { const std::lock_guard<std::mutex> lock(_mutex); return _hits; }
+		size_t misses() const { const std::lock_guard<std::mutex> lock(_mutex); return _misses; }
+
+	private:
+		struct file
+		{
+			uint64_t modified;
+			std::shared_ptr<const std::string> data;
+			std::string include_guard;
+			bool pragma_once = false;
+		};
+
+		mutable std::mutex _mutex;
+		size_t _hits = 0, _misses = 0;
+		std::unordered_map<std::string, file> _files;
+		std::unordered_map<std::string, std::vector<std::shared_ptr<const preprocessor::snapshot>>> _snapshots;
 	};
 }
@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <algorithm>
 #include <functional>
+#include <iterator>
 
 namespace reshadefx
 {
@@ -377,49 +378,60 @@ namespace reshadefx
 			intrinsic("trunc", intrinsic_expression_node::trunc, type_node::datatype_float, 4, 1, type_node::datatype_float, 4, 1),
 		};
 
-		int compare_functions(const call_expression_node *call, const function_declaration_node *function1, const function_declaration_node *function2)
+		/// <summary>
+		/// Returns the range of overloads of the intrinsic with the specified name in "s_intrinsics", which lists all overloads of an intrinsic next to each other.
+		/// </summary>
+		std::pair<const intrinsic *, const intrinsic *> find_intrinsic_overloads(atom name)
 		{
-			if (function2 == nullptr)
-			{
-				return -1;
-			}
+			static const auto s_index = []() {
+				std::unordered_map<atom, std::pair<const intrinsic *, const intrinsic *>> index;
 
-			const size_t count = call->arguments.size();
-
-			bool function1_viable = true;
-			bool function2_viable = true;
-			const auto function1_ranks = static_cast<unsigned int *>(alloca(count * sizeof(unsigned int)));
-			const auto function2_ranks = static_cast<unsigned int *>(alloca(count * sizeof(unsigned int)));
+				for (auto it = std::begin(s_intrinsics); it != std::end(s_intrinsics); ++it)
+				{
+					auto &range = index.try_emplace(interner::global().intern(it->function.name), it, it).first->second;
 
-			for (size_t i = 0; i < count; ++i)
-			{
-				function1_ranks[i] = type_node::rank(call->arguments[i]->type, function1->parameter_list[i]->type);
+					assert(range.second == it);
 
-				if (function1_ranks[i] == 0)
-				{
-					function1_viable = false;
-					break;
+					range.second = it + 1;
 				}
-			}
+
+				return index;
+			}();
+
+			const auto it = s_index.find(name);
+
+			return it != s_index.end() ? it->second : std::pair<const intrinsic *, const intrinsic *>(nullptr, nullptr);
+		}
+
+		/// <summary>
+		/// Computes the conversion rank of every call argument to the corresponding parameter of a function, sorted from worst to best match.
+		/// </summary>
+		/// <returns>A boolean value indicating whether all arguments can be converted, in which case the function is viable.</returns>
+		bool rank_function(const call_expression_node *call, const function_declaration_node *function, unsigned int *ranks)
+		{
+			const size_t count = call->arguments.size();
+
 			for (size_t i = 0; i < count; ++i)
 			{
-				function2_ranks[i] = type_node::rank(call->arguments[i]->type, function2->parameter_list[i]->type);
+				ranks[i] = type_node::rank(call->arguments[i]->type, function->parameter_list[i]->type);
 
-				if (function2_ranks[i] == 0)
+				if (ranks[i] == 0)
 				{
-					function2_viable = false;
-					break;
+					return false;
 				}
 			}
 
+			std::sort(ranks, ranks + count, std::greater<unsigned int>());
+
+			return true;
+		}
+		int compare_ranks(size_t count, bool function1_viable, const unsigned int *function1_ranks, bool function2_viable, const unsigned int *function2_ranks)
+		{
 			if (!(function1_viable && function2_viable))
 			{
 				return function2_viable - function1_viable;
 			}
 
-			std::sort(function1_ranks, function1_ranks + count, std::greater<unsigned int>());
-			std::sort(function2_ranks, function2_ranks + count, std::greater<unsigned int>());
-
 			for (size_t i = 0; i < count; ++i)
 			{
 				if (function1_ranks[i] < function2_ranks[i])
@@ -434,6 +446,23 @@ namespace reshadefx
 
 			return 0;
 		}
+		int compare_functions(const call_expression_node *call, const function_declaration_node *function1, const function_declaration_node *function2)
+		{
+			if (function2 == nullptr)
+			{
+				return -1;
+			}
+
+			const size_t count = call->arguments.size();
+
+			const auto function1_ranks = static_cast<unsigned int *>(alloca(count * sizeof(unsigned int)));
+			const auto function2_ranks = static_cast<unsigned int *>(alloca(count * sizeof(unsigned int)));
+
+			const bool function1_viable = rank_function(call, function1, function1_ranks);
+			const bool function2_viable = rank_function(call, function2, function2_ranks);
+
+			return compare_ranks(count, function1_viable, function1_ranks, function2_viable, function2_ranks);
+		}
 	}
 
 	unsigned int nodes::type_node::rank(const type_node &src, const type_node &dst)
@@ -488,6 +517,9 @@ namespace reshadefx
 		_current_scope.name = "::";
 		_current_scope.level = 0;
 		_current_scope.namespace_level = 0;
+		_current_scope.namespace_id = interner::global().intern(_current_scope.name);
+
+		_namespace_stack.push_back(_current_scope);
 	}
 
 	void symbol_table::enter_scope(symbol parent)
@@ -508,27 +540,29 @@ namespace reshadefx
 		_current_scope.name += name + "::";
 		_current_scope.level++;
 		_current_scope.namespace_level++;
+		_current_scope.namespace_id = interner::global().intern(_current_scope.name);
+
+		_namespace_stack.push_back(_current_scope);
 	}
 	void symbol_table::leave_scope()
 	{
 		assert(_current_scope.level > 0);
 
-		for (auto &symbol : _symbol_stack)
+		// Scopes are strictly nested, so all symbols declared in the current one are at the end of the log
+		while (!_undo_log.empty() && _undo_log.back().level >= _current_scope.level)
 		{
-			auto &scope_list = symbol.second;
+			const auto &entry = _undo_log.back();
+			auto &scope_list = _symbol_stack[entry.name];
 
-			for (auto scope_it = scope_list.begin(); scope_it != scope_list.end();)
-			{
-				if (scope_it->first.level > scope_it->first.namespace_level &&
-					scope_it->first.level >= _current_scope.level)
-				{
-					scope_it = scope_list.erase(scope_it);
-				}
-				else
-				{
-					++scope_it;
-				}
-			}
+			// Symbols of the innermost scope are usually the last ones in the list, so search from the back
+			const auto scope_it = std::find_if(scope_list.rbegin(), scope_list.rend(),
+				[&entry](const scoped_symbol &item) { return item.symbol == entry.symbol && item.level == entry.level; });
+
+			assert(scope_it != scope_list.rend());
+
+			scope_list.erase(std::next(scope_it).base());
+
+			_undo_log.pop_back();
 		}
 
 		_parent_stack.pop();
@@ -540,61 +574,65 @@ namespace reshadefx
 		assert(_current_scope.level > 0);
 		assert(_current_scope.namespace_level > 0);
 
-		_current_scope.name.erase(_current_scope.name.substr(0, _current_scope.name.size() - 2).rfind("::") + 2);
+		_namespace_stack.pop_back();
+
+		_current_scope.name = _namespace_stack.back().name;
 		_current_scope.level--;
 		_current_scope.namespace_level--;
+		_current_scope.namespace_id = _namespace_stack.back().namespace_id;
 	}
 
 	bool symbol_table::insert(symbol symbol, bool global)
 	{
+		const atom name = interner::global().intern(symbol->name);
+
 		// Make sure the symbol does not exist yet
-		if (symbol->id != nodeid::function_declaration && find(symbol->name, _current_scope, true))
+		if (symbol->id != nodeid::function_declaration && find(name, _current_scope, true))
 		{
 			return false;
 		}
 
 		// Insertion routine which keeps the symbol stack sorted by namespace level
-		const auto insert_sorted = [](auto &vec, const auto &item) {
+		const auto insert_sorted = [](auto &vec, const scoped_symbol &item) {
 			return vec.insert(
 				std::upper_bound(vec.begin(), vec.end(), item,
-					[](auto lhs, auto rhs) {
-						return lhs.first.namespace_level < rhs.first.namespace_level;
+					[](const scoped_symbol &lhs, const scoped_symbol &rhs) {
+						return lhs.namespace_level < rhs.namespace_level;
 					}), item);
 		};
 
 		// Global symbols are accessible from every scope
 		if (global)
 		{
-			scope scope = { "", 0, 0 };
-
-			// Walk scope chain from global scope back to current one
-			for (size_t pos = 0; pos != std::string::npos; pos = _current_scope.name.find("::", pos))
+			// Walk scope chain from global scope to current one and insert the symbol into each scope, qualified with the namespaces in between
+			for (const auto &scope : _namespace_stack)
 			{
-				// Extract scope name
-				scope.name = _current_scope.name.substr(0, pos += 2);
-				const auto previous_scope_name = _current_scope.name.substr(pos);
-
-				// Insert symbol into this scope
-				insert_sorted(_symbol_stack[previous_scope_name + symbol->name], std::make_pair(scope, symbol));
+				const atom qualified_name = scope.namespace_level == _current_scope.namespace_level ? name :
+					interner::global().intern(_current_scope.name.substr(scope.name.size()) + symbol->name);
 
-				// Continue walking up the scope chain
-				scope.level = ++scope.namespace_level;
+				insert_sorted(_symbol_stack[qualified_name], { scope.namespace_id, scope.namespace_level, scope.namespace_level, symbol });
 			}
 		}
 		else
 		{
 			// This is a local symbol so it's sufficient to update the symbol stack with just the current scope
-			insert_sorted(_symbol_stack[symbol->name], std::make_pair(_current_scope, symbol));
+			insert_sorted(_symbol_stack[name], { _current_scope.namespace_id, _current_scope.level, _current_scope.namespace_level, symbol });
+
+			// Symbols declared directly in a namespace stay around, everything else has to be removed again when leaving its scope
+			if (_current_scope.level > _current_scope.namespace_level)
+			{
+				_undo_log.push_back({ name, _current_scope.level, symbol });
+			}
 		}
 
 		return true;
 	}
-	symbol symbol_table::find(const std::string &name) const
+	symbol symbol_table::find(atom name) const
 	{
 		// Default to start search with current scope and walk back the scope chain
 		return find(name, _current_scope, false);
 	}
-	symbol symbol_table::find(const std::string &name, const scope &scope, bool exclusive) const
+	symbol symbol_table::find(atom name, const scope &scope, bool exclusive) const
 	{
 		const auto it = _symbol_stack.find(name);
 
@@ -610,29 +648,45 @@ namespace reshadefx
 
 		for (auto scope_it = scope_list.rbegin(), end = scope_list.rend(); scope_it != end; ++scope_it)
 		{
-			if (scope_it->first.level > scope.level ||
-				scope_it->first.namespace_level > scope.namespace_level ||
-				(scope_it->first.namespace_level == scope.namespace_level && scope_it->first.name != scope.name))
+			if (scope_it->level > scope.level ||
+				scope_it->namespace_level > scope.namespace_level ||
+				(scope_it->namespace_level == scope.namespace_level && scope_it->namespace_id != scope.namespace_id))
 			{
 				continue;
 			}
-			if (exclusive && scope_it->first.level < scope.level)
+			if (exclusive && scope_it->level < scope.level)
 			{
 				continue;
 			}
 
-			if (scope_it->second->id == nodeid::variable_declaration || scope_it->second->id == nodeid::struct_declaration)
+			if (scope_it->symbol->id == nodeid::variable_declaration || scope_it->symbol->id == nodeid::struct_declaration)
 			{
-				return scope_it->second;
+				return scope_it->symbol;
 			}
 			if (result == nullptr)
 			{
-				result = scope_it->second;
+				result = scope_it->symbol;
 			}
 		}
 
 		return result;
 	}
+	symbol symbol_table::find(const std::string &name) const
+	{
+		return find(name, _current_scope, false);
+	}
+	symbol symbol_table::find(const std::string &name, const scope &scope, bool exclusive) const
+	{
+		const atom name_atom = interner::global().find(name);
+
+		// Names that were never interned cannot have been inserted either
+		if (name_atom == interner::empty && !name.empty())
+		{
+			return nullptr;
+		}
+
+		return find(name_atom, scope, exclusive);
+	}
 	bool symbol_table::resolve_call(call_expression_node *call, const scope &scope, bool &is_intrinsic, bool &is_ambiguous) const
 	{
 		is_intrinsic = false;
@@ -642,7 +696,8 @@ namespace reshadefx
 		const function_declaration_node *overload = nullptr;
 		auto intrinsic_op = intrinsic_expression_node::none;
 
-		const auto it = _symbol_stack.find(call->callee_name);
+		const atom callee_name = interner::global().find(call->callee_name);
+		const auto it = _symbol_stack.find(callee_name);
 
 		if (it != _symbol_stack.end() && !it->second.empty())
 		{
@@ -650,14 +705,14 @@ namespace reshadefx
 
 			for (auto scope_it = scope_list.rbegin(), end = scope_list.rend(); scope_it != end; ++scope_it)
 			{
-				if (scope_it->first.level > scope.level ||
-					scope_it->first.namespace_level > scope.namespace_level ||
-					scope_it->second->id != nodeid::function_declaration)
+				if (scope_it->level > scope.level ||
+					scope_it->namespace_level > scope.namespace_level ||
+					scope_it->symbol->id != nodeid::function_declaration)
 				{
 					continue;
 				}
 
-				const auto function = static_cast<function_declaration_node *>(scope_it->second);
+				const auto function = static_cast<function_declaration_node *>(scope_it->symbol);
 
 				if (function->parameter_list.empty())
 				{
@@ -683,9 +738,9 @@ namespace reshadefx
 				{
 					overload = function;
 					overload_count = 1;
-					overload_namespace = scope_it->first.namespace_level;
+					overload_namespace = scope_it->namespace_level;
 				}
-				else if (comparison == 0 && overload_namespace == scope_it->first.namespace_level)
+				else if (comparison == 0 && overload_namespace == scope_it->namespace_level)
 				{
 					++overload_count;
 				}
@@ -694,27 +749,32 @@ namespace reshadefx
 
 		if (overload_count == 0)
 		{
-			for (auto &intrinsic : s_intrinsics)
+			const auto [intrinsics_begin, intrinsics_end] = find_intrinsic_overloads(callee_name);
+
+			// Keep the ranks of the best overload so far around, so that they do not have to be computed again for every comparison
+			bool overload_viable = false;
+			unsigned int overload_ranks[4], ranks[4];
+
+			for (auto intrinsic = intrinsics_begin; intrinsic != intrinsics_end; ++intrinsic)
 			{
-				if (intrinsic.function.name != call->callee_name)
-				{
-					continue;
-				}
-				if (intrinsic.function.parameter_list.size() != call->arguments.size())
+				if (intrinsic->function.parameter_list.size() != call->arguments.size())
 				{
 					is_intrinsic = overload_count == 0;
 					break;
 				}
 
-				const int comparison = compare_functions(call, &intrinsic.function, overload);
+				const bool viable = rank_function(call, &intrinsic->function, ranks);
+				const int comparison = overload == nullptr ? -1 : compare_ranks(call->arguments.size(), viable, ranks, overload_viable, overload_ranks);
 
 				if (comparison < 0)
 				{
-					overload = &intrinsic.function;
+					overload = &intrinsic->function;
 					overload_count = 1;
+					overload_viable = viable;
+					std::copy_n(ranks, call->arguments.size(), overload_ranks);
 
 					is_intrinsic = true;
-					intrinsic_op = intrinsic.op;
+					intrinsic_op = intrinsic->op;
 				}
 				else if (comparison == 0 && overload_namespace == 0)
 				{
@@ -8,6 +8,7 @@
 #include <stack>
 #include <unordered_map>
 #include <string>
+#include "effect_interner.hpp"
 
 namespace reshadefx
 {
@@ -26,6 +27,7 @@ namespace reshadefx
 	{
 		std::string name;
 		unsigned int level, namespace_level;
+		atom namespace_id = interner::empty; // Interned "name", which is what symbols are matched against
 	};
 
 	/// <summary>
@@ -50,13 +52,30 @@ namespace reshadefx
 		const scope &current_scope() const { return _current_scope; }
 
 		bool insert(symbol symbol, bool global = false);
+		symbol find(atom name) const;
+		symbol find(atom name, const scope &scope, bool exclusive) const;
 		symbol find(const std::string &name) const;
 		symbol find(const std::string &name, const scope &scope, bool exclusive) const;
 		bool resolve_call(nodes::call_expression_node *call, const scope &scope, bool &intrinsic, bool &ambiguous) const;
 
 	private:
+		struct scoped_symbol
+		{
+			atom namespace_id;
+			unsigned int level, namespace_level;
+			symbol symbol;
+		};
+		struct undo_entry
+		{
+			atom name;
+			unsigned int level;
+			symbol symbol;
+		};
+
 		scope _current_scope;
 		std::stack<symbol> _parent_stack;
-		std::unordered_map<std::string, std::vector<std::pair<scope, symbol>>> _symbol_stack;
+		std::vector<scope> _namespace_stack; // The global scope followed by all namespaces enclosing the current scope
+		std::vector<undo_entry> _undo_log; // Local symbols in the order they were inserted, so that leaving a scope only has to remove the ones declared in it
+		std::unordered_map<atom, std::vector<scoped_symbol>> _symbol_stack; // Keyed by the interned (qualified) symbol name
 	};
 }
@@ -6,7 +6,9 @@
 #pragma once
 
 #include "effect_syntax_tree_nodes.hpp"
-#include <list>
+#include <new>
+#include <algorithm>
+#include <type_traits>
 
 namespace reshadefx
 {
@@ -27,77 +29,149 @@ namespace reshadefx
 			return node;
 		}
 
+		/// <summary>
+		/// Copy a list of statement attributes into memory owned by the syntax tree.
+		/// </summary>
+		nodes::attribute_list make_attribute_list(const std::vector<atom> &names)
+		{
+			const auto data = _pool.add_array<atom>(names.size());
+			std::copy(names.begin(), names.end(), data);
+
+			return nodes::attribute_list(data, static_cast<unsigned int>(names.size()));
+		}
+		/// <summary>
+		/// Copy a string into memory owned by the syntax tree, so that nodes can refer to it without owning an allocation of their own.
+		/// </summary>
+		std::string_view make_string(std::string_view text)
+		{
+			const auto data = _pool.add_array<char>(text.size());
+			std::copy(text.begin(), text.end(), data);
+
+			return std::string_view(data, text.size());
+		}
+		/// <summary>
+		/// Make sure a literal has room for as many values as its type has components. This has to be called whenever a literal is given a matrix type, since only scalars and vectors fit into the node itself.
+		/// </summary>
+		void reserve_literal_values(nodes::literal_expression_node *literal)
+		{
+			if (literal->_external_values != nullptr || literal->type.rows * literal->type.cols <= nodes::literal_expression_node::inline_values)
+			{
+				return;
+			}
+
+			const auto data = _pool.add_array<unsigned int>(nodes::literal_expression_node::max_values);
+			std::fill_n(std::copy_n(literal->_inline_values, nodes::literal_expression_node::inline_values, data), nodes::literal_expression_node::max_values - nodes::literal_expression_node::inline_values, 0u);
+
+			literal->_external_values = data;
+		}
+
 		std::vector<nodes::struct_declaration_node *> structs;
 		std::vector<nodes::variable_declaration_node *> variables;
 		std::vector<nodes::function_declaration_node *> functions;
 		std::vector<nodes::technique_declaration_node *> techniques;
 
 	private:
+		/// <summary>
+		/// A bump-pointer arena the syntax tree nodes are allocated from. Pages grow geometrically, so a tree needs only a handful of them, and allocation only ever looks at the current page.
+		/// </summary>
 		class memory_pool
 		{
 			struct page
 			{
-				explicit page(size_t size) : cursor(0), memory(size, '\0') { }
-
-				size_t cursor;
-				std::vector<unsigned char> memory;
+				page *prev;
+				size_t size;
 			};
-			struct nodeinfo
+			struct cleanup
 			{
-				size_t size;
 				void(*dtor)(void *);
-				unsigned char data[sizeof(node)];
+				void *object;
+				cleanup *prev;
 			};
 
+			static constexpr size_t min_page_size = 4096, max_page_size = 1024 * 1024;
+
 		public:
+			memory_pool() = default;
+			memory_pool(const memory_pool &) = delete;
 			~memory_pool()
 			{
 				clear();
 			}
 
+			memory_pool &operator=(const memory_pool &) = delete;
+
 			template <typename T>
 			T *add()
 			{
-				auto size = sizeof(nodeinfo) - sizeof(node) + sizeof(T);
-				auto page = std::find_if(_pages.begin(), _pages.end(),
-					[size](const struct page &page)
-				{
-					return page.cursor + size < page.memory.size();
-				});
+				const auto node = new (allocate(sizeof(T), alignof(T))) T();
 
-				if (page == _pages.end())
+				// Nodes without members that own memory do not have to be visited again when the pool is destroyed
+				if constexpr (!std::is_trivially_destructible_v<T>)
 				{
-					_pages.emplace_back(std::max(size_t(4096), size));
+					const auto entry = new (allocate(sizeof(cleanup), alignof(cleanup))) cleanup;
+					entry->dtor = [](void *object) { static_cast<T *>(object)->~T(); };
+					entry->object = node;
+					entry->prev = _cleanup;
 
-					page = std::prev(_pages.end());
+					_cleanup = entry;
 				}
 
-				const auto node = new (&page->memory.at(page->cursor)) nodeinfo;
-				const auto node_data = new (&node->data) T();
-				node->size = size;
-				node->dtor = [](void *object) { reinterpret_cast<T *>(object)->~T(); };
-
-				page->cursor += node->size;
+				return node;
+			}
+			template <typename T>
+			T *add_array(size_t count)
+			{
+				static_assert(std::is_trivially_destructible_v<T>);
 
-				return node_data;
+				return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
 			}
 			void clear()
 			{
-				for (auto &page : _pages)
+				// Destroy nodes in reverse order of creation, then release all pages at once
+				for (auto entry = _cleanup; entry != nullptr; entry = entry->prev)
 				{
-					auto node = reinterpret_cast<nodeinfo *>(&page.memory.front());
-
-					do
-					{
-						node->dtor(node->data);
-						node = reinterpret_cast<nodeinfo *>(reinterpret_cast<unsigned char *>(node) + node->size);
-					}
-					while (node->size > 0 && (page.cursor -= node->size) > 0);
+					entry->dtor(entry->object);
 				}
+
+				for (auto page = _page; page != nullptr;)
+				{
+					const auto prev = page->prev;
+					::operator delete(page);
+					page = prev;
+				}
+
+				_page = nullptr;
+				_cleanup = nullptr;
+				_cursor = _end = 0;
 			}
 
 		private:
-			std::list<page> _pages;
+			void *allocate(size_t size, size_t alignment)
+			{
+				auto address = (_cursor + alignment - 1) & ~(alignment - 1);
+
+				if (_page == nullptr || address + size > _end)
+				{
+					const size_t page_size = std::max(std::min(_page != nullptr ? _page->size * 2 : min_page_size, max_page_size), sizeof(page) + size + alignment);
+					const auto new_page = static_cast<page *>(::operator new(page_size));
+					new_page->prev = _page;
+					new_page->size = page_size;
+
+					_page = new_page;
+					_cursor = reinterpret_cast<uintptr_t>(new_page + 1);
+					_end = reinterpret_cast<uintptr_t>(new_page) + page_size;
+
+					address = (_cursor + alignment - 1) & ~(alignment - 1);
+				}
+
+				_cursor = address + size;
+
+				return reinterpret_cast<void *>(address);
+			}
+
+			page *_page = nullptr;
+			cleanup *_cleanup = nullptr;
+			uintptr_t _cursor = 0, _end = 0;
 		} _pool;
 	};
 }
@@ -7,10 +7,13 @@
 
 #include "variant.hpp"
 #include "source_location.hpp"
+#include "effect_interner.hpp"
 #include "runtime_objects.hpp"
 
 namespace reshadefx
 {
+	class syntax_tree;
+
 	enum class nodeid
 	{
 		unknown,
@@ -127,11 +130,44 @@ namespace reshadefx::nodes
 		type_node type;
 
 	protected:
-		expression_node(nodeid id) : node(id) { }
+		expression_node(nodeid id) : node(id), type() { }
+	};
+	/// <summary>
+	/// The attributes of a statement (e.g. "[unroll]"). Most statements have none, so they are stored out-of-line as an array of interned names owned by the syntax tree.
+	/// </summary>
+	class attribute_list
+	{
+	public:
+		class iterator
+		{
+		public:
+			explicit iterator(const atom *it) : _it(it) { }
+
+			std::string_view operator*() const { return interner::global().name(*_it); }
+			iterator &operator++() { ++_it; return *this; }
+			bool operator==(const iterator &other) const { return _it == other._it; }
+			bool operator!=(const iterator &other) const { return _it != other._it; }
+
+		private:
+			const atom *_it;
+		};
+
+		attribute_list() = default;
+		attribute_list(const atom *names, unsigned int count) : _names(names), _count(count) { }
+
+		iterator begin() const { return iterator(_names); }
+		iterator end() const { return iterator(_names + _count); }
+		bool empty() const { return _count == 0; }
+		size_t size() const { return _count; }
+
+	private:
+		const atom *_names = nullptr;
+		unsigned int _count = 0;
 	};
+
 	struct statement_node abstract : public node
 	{
-		std::vector<std::string> attributes;
+		attribute_list attributes;
 
 	protected:
 		statement_node(nodeid id) : node(id) { }
@@ -149,20 +185,34 @@ namespace reshadefx::nodes
 	{
 		lvalue_expression_node() : expression_node(nodeid::lvalue_expression) { }
 
-		const struct variable_declaration_node *reference;
+		const struct variable_declaration_node *reference = nullptr;
 	};
 	struct literal_expression_node : public expression_node
 	{
+		friend class reshadefx::syntax_tree;
+
+		/// <summary>
+		/// The number of values a literal stores in the node itself. Only matrices have more, so those are stored out-of-line in memory owned by the syntax tree (see "syntax_tree::reserve_literal_values").
+		/// </summary>
+		static constexpr unsigned int inline_values = 4, max_values = 16;
+
 		literal_expression_node() : expression_node(nodeid::literal_expression) { }
 
-		union
-		{
-			int value_int[16];
-			unsigned int value_uint[16];
-			float value_float[16];
-		};
+		int *value_int() { return reinterpret_cast<int *>(values()); }
+		const int *value_int() const { return reinterpret_cast<const int *>(values()); }
+		unsigned int *value_uint() { return values(); }
+		const unsigned int *value_uint() const { return values(); }
+		float *value_float() { return reinterpret_cast<float *>(values()); }
+		const float *value_float() const { return reinterpret_cast<const float *>(values()); }
+
+		std::string_view value_string; // Owned by the syntax tree
+
+	private:
+		unsigned int *values() { return _external_values != nullptr ? _external_values : _inline_values; }
+		const unsigned int *values() const { return _external_values != nullptr ? _external_values : _inline_values; }
 
-		std::string value_string;
+		unsigned int _inline_values[inline_values] = {};
+		unsigned int *_external_values = nullptr; // Owned by the syntax tree
 	};
 	struct unary_expression_node : public expression_node
 	{
@@ -181,8 +231,8 @@ namespace reshadefx::nodes
 
 		unary_expression_node() : expression_node(nodeid::unary_expression) { }
 
-		op op;
-		expression_node *operand;
+		op op = none;
+		expression_node *operand = nullptr;
 	};
 	struct binary_expression_node : public expression_node
 	{
@@ -212,8 +262,8 @@ namespace reshadefx::nodes
 
 		binary_expression_node() : expression_node(nodeid::binary_expression) { }
 
-		op op;
-		expression_node *operands[2];
+		op op = none;
+		expression_node *operands[2] = {};
 	};
 	struct intrinsic_expression_node : public expression_node
 	{
@@ -296,15 +346,15 @@ namespace reshadefx::nodes
 
 		intrinsic_expression_node() : expression_node(nodeid::intrinsic_expression) { }
 
-		op op;
-		expression_node *arguments[4];
+		op op = none;
+		expression_node *arguments[4] = {};
 	};
 	struct conditional_expression_node : public expression_node
 	{
 		conditional_expression_node() : expression_node(nodeid::conditional_expression) { }
 
-		expression_node *condition;
-		expression_node *expression_when_true, *expression_when_false;
+		expression_node *condition = nullptr;
+		expression_node *expression_when_true = nullptr, *expression_when_false = nullptr;
 	};
 	struct assignment_expression_node : public expression_node
 	{
@@ -325,8 +375,8 @@ namespace reshadefx::nodes
 
 		assignment_expression_node() : expression_node(nodeid::assignment_expression) { }
 
-		op op;
-		expression_node *left, *right;
+		op op = none;
+		expression_node *left = nullptr, *right = nullptr;
 	};
 	struct expression_sequence_node : public expression_node
 	{
@@ -339,7 +389,7 @@ namespace reshadefx::nodes
 		call_expression_node() : expression_node(nodeid::call_expression) { }
 
 		std::string callee_name;
-		const struct function_declaration_node *callee;
+		const struct function_declaration_node *callee = nullptr;
 		std::vector<expression_node *> arguments;
 	};
 	struct constructor_expression_node : public expression_node
@@ -352,15 +402,15 @@ namespace reshadefx::nodes
 	{
 		swizzle_expression_node() : expression_node(nodeid::swizzle_expression) { }
 
-		expression_node *operand;
-		signed char mask[4];
+		expression_node *operand = nullptr;
+		signed char mask[4] = {};
 	};
 	struct field_expression_node : public expression_node
 	{
 		field_expression_node() : expression_node(nodeid::field_expression) { }
 
-		expression_node *operand;
-		variable_declaration_node *field_reference;
+		expression_node *operand = nullptr;
+		variable_declaration_node *field_reference = nullptr;
 	};
 	struct initializer_list_node : public expression_node
 	{
@@ -380,80 +430,80 @@ namespace reshadefx::nodes
 	{
 		expression_statement_node() : statement_node(nodeid::expression_statement) { }
 
-		expression_node *expression;
+		expression_node *expression = nullptr;
 	};
 	struct if_statement_node : public statement_node
 	{
 		if_statement_node() : statement_node(nodeid::if_statement) { }
 
-		expression_node *condition;
-		statement_node *statement_when_true, *statement_when_false;
+		expression_node *condition = nullptr;
+		statement_node *statement_when_true = nullptr, *statement_when_false = nullptr;
 	};
 	struct case_statement_node : public statement_node
 	{
 		case_statement_node() : statement_node(nodeid::case_statement) { }
 
-		statement_node *statement_list;
+		statement_node *statement_list = nullptr;
 		std::vector<literal_expression_node *> labels;
 	};
 	struct switch_statement_node : public statement_node
 	{
 		switch_statement_node() : statement_node(nodeid::switch_statement) { }
 
-		expression_node *test_expression;
+		expression_node *test_expression = nullptr;
 		std::vector<case_statement_node *> case_list;
 	};
 	struct for_statement_node : public statement_node
 	{
 		for_statement_node() : statement_node(nodeid::for_statement) { }
 
-		statement_node *init_statement;
-		expression_node *condition, *increment_expression;
-		statement_node *statement_list;
+		statement_node *init_statement = nullptr;
+		expression_node *condition = nullptr, *increment_expression = nullptr;
+		statement_node *statement_list = nullptr;
 	};
 	struct while_statement_node : public statement_node
 	{
 		while_statement_node() : statement_node(nodeid::while_statement) { }
 
-		bool is_do_while;
-		expression_node *condition;
-		statement_node *statement_list;
+		bool is_do_while = false;
+		expression_node *condition = nullptr;
+		statement_node *statement_list = nullptr;
 	};
 	struct return_statement_node : public statement_node
 	{
 		return_statement_node() : statement_node(nodeid::return_statement) { }
 
-		bool is_discard;
-		expression_node *return_value;
+		bool is_discard = false;
+		expression_node *return_value = nullptr;
 	};
 	struct jump_statement_node : public statement_node
 	{
 		jump_statement_node() : statement_node(nodeid::jump_statement) { }
 
-		bool is_break, is_continue;
+		bool is_break = false, is_continue = false;
 	};
 
 	// Declarations
 	struct variable_declaration_node : public declaration_node
 	{
-		variable_declaration_node() : declaration_node(nodeid::variable_declaration) { }
+		variable_declaration_node() : declaration_node(nodeid::variable_declaration), type() { }
 
 		type_node type;
 		std::unordered_map<std::string, reshade::variant> annotation_list;
 		std::string semantic;
-		expression_node *initializer_expression;
+		expression_node *initializer_expression = nullptr;
 
 		struct
 		{
-			const variable_declaration_node *texture;
+			const variable_declaration_node *texture = nullptr;
 			unsigned int width = 1, height = 1, depth = 1, levels = 1;
-			bool srgb_texture;
+			bool srgb_texture = false;
 			reshade::texture_format format = reshade::texture_format::rgba8;
 			reshade::texture_filter filter = reshade::texture_filter::min_mag_mip_linear;
 			reshade::texture_address_mode address_u = reshade::texture_address_mode::clamp;
 			reshade::texture_address_mode address_v = reshade::texture_address_mode::clamp;
 			reshade::texture_address_mode address_w = reshade::texture_address_mode::clamp;
-			float min_lod, max_lod = FLT_MAX, lod_bias;
+			float min_lod = 0.0f, max_lod = FLT_MAX, lod_bias = 0.0f;
 		} properties;
 	};
 	struct declarator_list_node : public statement_node
@@ -470,12 +520,12 @@ namespace reshadefx::nodes
 	};
 	struct function_declaration_node : public declaration_node
 	{
-		function_declaration_node() : declaration_node(nodeid::function_declaration) { }
+		function_declaration_node() : declaration_node(nodeid::function_declaration), return_type() { }
 
 		type_node return_type;
 		std::vector<variable_declaration_node *> parameter_list;
 		std::string return_semantic;
-		compound_statement_node *definition;
+		compound_statement_node *definition = nullptr;
 	};
 	struct pass_declaration_node : public declaration_node
 	{
@@ -520,12 +570,12 @@ namespace reshadefx::nodes
 
 		pass_declaration_node() : declaration_node(nodeid::pass_declaration) { }
 
-		const variable_declaration_node *render_targets[8];
-		const function_declaration_node *vertex_shader, *pixel_shader;
-		bool clear_render_targets = true, srgb_write_enable, blend_enable, stencil_enable;
+		const variable_declaration_node *render_targets[8] = {};
+		const function_declaration_node *vertex_shader = nullptr, *pixel_shader = nullptr;
+		bool clear_render_targets = true, srgb_write_enable = false, blend_enable = false, stencil_enable = false;
 		unsigned char color_write_mask = 0xF, stencil_read_mask = 0xFF, stencil_write_mask = 0xFF;
 		unsigned int blend_op = ADD, blend_op_alpha = ADD, src_blend = ONE, dest_blend = ZERO, src_blend_alpha = ONE, dest_blend_alpha = ZERO;
-		unsigned int stencil_comparison_func = ALWAYS, stencil_reference_value, stencil_op_pass = KEEP, stencil_op_fail = KEEP, stencil_op_depth_fail = KEEP;
+		unsigned int stencil_comparison_func = ALWAYS, stencil_reference_value = 0, stencil_op_pass = KEEP, stencil_op_fail = KEEP, stencil_op_depth_fail = KEEP;
 	};
 	struct technique_declaration_node : public declaration_node
 	{
@@ -100,6 +100,17 @@ namespace reshade::filesystem
 	{
 		return GetFileAttributesW(path.wstring().c_str()) != INVALID_FILE_ATTRIBUTES;
 	}
+	uint64_t last_write_time(const path &path)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+		if (!GetFileAttributesExW(path.wstring().c_str(), GetFileExInfoStandard, &attributes))
+		{
+			return 0;
+		}
+
+		return (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	}
 	path resolve(const path &filename, const std::vector<path> &paths)
 	{
 		for (const auto &path : paths)
@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 #include <ostream>
+#include <cstdint>
 
 namespace reshade::filesystem
 {
@@ -55,6 +56,7 @@ namespace reshade::filesystem
 	};
 
 	bool exists(const path &path);
+	uint64_t last_write_time(const path &path);
 	path resolve(const path &filename, const std::vector<path> &paths);
 	path absolute(const path &filename, const path &parent_path);
 
@@ -38,6 +38,11 @@ namespace reshade
 		}
 		template <typename T, size_t SIZE>
 		void get(const std::string &section, const std::string &key, T(&values)[SIZE]) const
+		{
+			get(section, key, values, SIZE);
+		}
+		template <typename T>
+		void get(const std::string &section, const std::string &key, T *values, size_t count) const
 		{
 			const auto it1 = _sections.find(section);
 
@@ -53,7 +58,7 @@ namespace reshade
 				return;
 			}
 
-			for (size_t i = 0; i < SIZE; i++)
+			for (size_t i = 0; i < count; i++)
 			{
 				values[i] = it2->second.as<T>(i);
 			}
@@ -5,6 +5,8 @@
 
 #include "opengl_runtime.hpp"
 #include "opengl_effect_compiler.hpp"
+#include "shader_cache.hpp"
+#include "effect_optimizer.hpp"
 #include <assert.h>
 #include <iomanip>
 #include <fstream>
@@ -368,6 +370,17 @@ namespace reshade::opengl
 			address += alignment - address % alignment;
 		return address;
 	}
+	static bool is_backbuffer_texture(const declaration_node *node)
+	{
+		if (node->id != nodeid::variable_declaration)
+		{
+			return false;
+		}
+
+		const auto variable = static_cast<const variable_declaration_node *>(node);
+
+		return variable->type.is_texture() && (variable->semantic == "COLOR" || variable->semantic == "SV_TARGET");
+	}
 
 	opengl_effect_compiler::opengl_effect_compiler(opengl_runtime *runtime, const syntax_tree &ast, std::string &errors) :
 		_runtime(runtime),
@@ -379,7 +392,7 @@ namespace reshade::opengl
 #if RESHADE_DUMP_NATIVE_SHADERS
 		if (_ast.techniques.size() == 0)
 			return;
-		_dump_filename = _ast.techniques[0]->location.source;
+		_dump_filename = std::string(_ast.techniques[0]->location.source);
 		_dump_filename = "ReShade-ShaderDump-" + _dump_filename.filename_without_extension().string() + ".glsl";
 
 		std::ofstream(_dump_filename.string(), std::ios::trunc);
@@ -388,7 +401,8 @@ namespace reshade::opengl
 
 	bool opengl_effect_compiler::run()
 	{
-		_uniform_storage_offset = _runtime->get_uniform_value_storage().size();
+		// Program binaries are only valid for the driver that produced them
+		_driver_identity = std::string(reinterpret_cast<const char *>(glGetString(GL_VENDOR))) + '|' + reinterpret_cast<const char *>(glGetString(GL_RENDERER)) + '|' + reinterpret_cast<const char *>(glGetString(GL_VERSION));
 
 		for (auto node : _ast.structs)
 		{
@@ -417,6 +431,8 @@ namespace reshade::opengl
 			}
 		}
 
+		layout_uniform_buffers();
+
 		for (auto function : _ast.functions)
 		{
 			std::stringstream function_code;
@@ -433,8 +449,13 @@ namespace reshade::opengl
 			visit_technique(technique);
 		}
 
-		if (_uniform_buffer_size != 0)
+		for (size_t i = 0; i < uniform_buffer_count; i++)
 		{
+			if (_uniform_buffer_size[i] == 0)
+			{
+				continue;
+			}
+
 			GLuint ubo = 0;
 			glGenBuffers(1, &ubo);
 
@@ -442,11 +463,11 @@ namespace reshade::opengl
 			glGetIntegerv(GL_UNIFORM_BUFFER_BINDING, &previous);
 
 			glBindBuffer(GL_UNIFORM_BUFFER, ubo);
-			glBufferData(GL_UNIFORM_BUFFER, _uniform_buffer_size, _runtime->get_uniform_value_storage().data() + _uniform_storage_offset, GL_DYNAMIC_DRAW);
+			glBufferData(GL_UNIFORM_BUFFER, _uniform_buffer_size[i], _runtime->get_uniform_value_storage().data() + _uniform_buffer_offset[i], GL_DYNAMIC_DRAW);
 
 			glBindBuffer(GL_UNIFORM_BUFFER, previous);
 
-			_runtime->_effect_ubos.emplace_back(ubo, _uniform_buffer_size);
+			_runtime->_effect_ubos.emplace_back(ubo, _uniform_buffer_size[i]);
 		}
 
 		return _success;
@@ -456,11 +477,11 @@ namespace reshade::opengl
 	{
 		_success = false;
 
-		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): error: " + message + '\n';
+		_errors += std::string(location.source) + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): error: " + message + '\n';
 	}
 	void opengl_effect_compiler::warning(const location &location, const std::string &message)
 	{
-		_errors += location.source + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
+		_errors += std::string(location.source) + "(" + std::to_string(location.line) + ", " + std::to_string(location.column) + "): warning: " + message + '\n';
 	}
 
 	void opengl_effect_compiler::visit(std::stringstream &output, const statement_node *node)
@@ -652,16 +673,16 @@ namespace reshade::opengl
 			switch (node->type.basetype)
 			{
 				case type_node::datatype_bool:
-					output << (node->value_int[i] ? "true" : "false");
+					output << (node->value_int()[i] ? "true" : "false");
 					break;
 				case type_node::datatype_int:
-					output << node->value_int[i];
+					output << node->value_int()[i];
 					break;
 				case type_node::datatype_uint:
-					output << node->value_uint[i] << 'u';
+					output << node->value_uint()[i] << 'u';
 					break;
 				case type_node::datatype_float:
-					output << std::setprecision(8) << std::fixed << node->value_float[i];
+					output << std::setprecision(8) << std::fixed << node->value_float()[i];
 					break;
 			}
 
@@ -2163,23 +2184,25 @@ namespace reshade::opengl
 	}
 	void opengl_effect_compiler::visit_uniform(const variable_declaration_node *node)
 	{
-		visit(_global_uniforms, node->type, true, false);
+		const uniform_buffer_index buffer = node->annotation_list.count("source") ? dynamic_uniforms : static_uniforms;
 
-		_global_uniforms << ' ' << escape_name(node->unique_name);
+		visit(_global_uniforms[buffer], node->type, true, false);
+
+		_global_uniforms[buffer] << ' ' << escape_name(node->unique_name);
 
 		if (node->type.is_array())
 		{
-			_global_uniforms << '[';
+			_global_uniforms[buffer] << '[';
 
 			if (node->type.array_length > 0)
 			{
-				_global_uniforms << node->type.array_length;
+				_global_uniforms[buffer] << node->type.array_length;
 			}
 
-			_global_uniforms << ']';
+			_global_uniforms[buffer] << ']';
 		}
 
-		_global_uniforms << ";\n";
+		_global_uniforms[buffer] << ";\n";
 
 		uniform obj;
 		obj.name = node->name;
@@ -2200,27 +2223,50 @@ namespace reshade::opengl
 		{
 			alignment = alignment * 4 / 3;
 		}
-		_uniform_buffer_size = align(_uniform_buffer_size, alignment);
-		obj.storage_offset = _uniform_storage_offset + _uniform_buffer_size;
-		_uniform_buffer_size += obj.storage_size;
+		auto &buffer_size = _uniform_buffer_size[buffer];
+		buffer_size = align(buffer_size, alignment);
+		obj.storage_offset = buffer_size;
+		buffer_size += obj.storage_size;
 
-		auto &uniform_storage = _runtime->get_uniform_value_storage();
+		auto &buffer_data = _uniform_buffer_data[buffer];
+		buffer_data.resize(buffer_size);
 
-		if (_uniform_storage_offset + _uniform_buffer_size >= static_cast<ptrdiff_t>(uniform_storage.size()))
+		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
 		{
-			uniform_storage.resize(uniform_storage.size() + 128);
+			const auto initializer = static_cast<const literal_expression_node *>(node->initializer_expression);
+			const size_t initializer_size = std::min<size_t>(obj.storage_size, initializer->type.rows * initializer->type.cols * 4);
+
+			// The literal only stores as many values as its type has components, so fill the rest with zeros
+			std::memcpy(buffer_data.data() + obj.storage_offset, initializer->value_float(), initializer_size);
+			std::memset(buffer_data.data() + obj.storage_offset + initializer_size, 0, obj.storage_size - initializer_size);
+		}
+		else
+		{
+			std::memset(buffer_data.data() + obj.storage_offset, 0, obj.storage_size);
 		}
 
-		if (node->initializer_expression != nullptr && node->initializer_expression->id == nodeid::literal_expression)
+		_uniforms.emplace_back(std::move(obj), buffer);
+	}
+	void opengl_effect_compiler::layout_uniform_buffers()
+	{
+		auto &uniform_storage = _runtime->get_uniform_value_storage();
+
+		// Place the uniform buffers one after another in the uniform storage, now that all of their uniforms were visited
+		for (size_t i = 0; i < uniform_buffer_count; i++)
 		{
-			std::memcpy(uniform_storage.data() + obj.storage_offset, &static_cast<const literal_expression_node *>(node->initializer_expression)->value_float, obj.storage_size);
+			_uniform_buffer_offset[i] = uniform_storage.size();
+
+			uniform_storage.insert(uniform_storage.end(), _uniform_buffer_data[i].begin(), _uniform_buffer_data[i].end());
 		}
-		else
+
+		for (auto &uniform : _uniforms)
 		{
-			std::memset(uniform_storage.data() + obj.storage_offset, 0, obj.storage_size);
+			uniform.first.storage_offset += _uniform_buffer_offset[uniform.second];
+
+			_runtime->add_uniform(std::move(uniform.first));
 		}
 
-		_runtime->add_uniform(std::move(obj));
+		_uniforms.clear();
 	}
 	void opengl_effect_compiler::visit_technique(const technique_declaration_node *node)
 	{
@@ -2232,10 +2278,16 @@ namespace reshade::opengl
 		const auto obj_data = obj.impl->as<opengl_technique_data>();
 		glGenQueries(1, &obj_data->query);
 
-		if (_uniform_buffer_size != 0)
+		// The uniform buffers are created after all techniques were visited, in the order of their index
+		if (_uniform_buffer_size[static_uniforms] != 0)
 		{
 			obj.uniform_storage_index = _runtime->_effect_ubos.size();
-			obj.uniform_storage_offset = _uniform_storage_offset;
+			obj.uniform_storage_offset = _uniform_buffer_offset[static_uniforms];
+		}
+		if (_uniform_buffer_size[dynamic_uniforms] != 0)
+		{
+			obj.dynamic_uniform_storage_index = _runtime->_effect_ubos.size() + (_uniform_buffer_size[static_uniforms] != 0 ? 1 : 0);
+			obj.dynamic_uniform_storage_offset = _uniform_buffer_offset[dynamic_uniforms];
 		}
 
 		for (auto pass : node->pass_list)
@@ -2311,6 +2363,8 @@ namespace reshade::opengl
 			pass.draw_textures[i] = texture_data->id[pass.srgb];
 		}
 
+		pass.writes_backbuffer = backbuffer_fbo;
+
 		if (backbuffer_fbo)
 		{
 			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _runtime->_default_backbuffer_rbo[0]);
@@ -2334,19 +2388,85 @@ namespace reshade::opengl
 		GLuint shaders[2] = { 0, 0 };
 		GLenum shader_types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
 		const function_declaration_node *shader_functions[2] = { node->vertex_shader, node->pixel_shader };
+		std::string shader_sources[2];
 
-		pass.program = glCreateProgram();
+		// Record whether the shaders of this pass sample the back buffer, so that the runtime can skip copying it for all other passes
+		std::unordered_set<const declaration_node *> reachable;
 
 		for (unsigned int i = 0; i < 2; i++)
 		{
 			if (shader_functions[i] != nullptr)
 			{
-				shaders[i] = glCreateShader(shader_types[i]);
+				find_reachable_declarations(shader_functions[i], reachable);
+			}
+		}
+
+		pass.samples_backbuffer = std::any_of(reachable.begin(), reachable.end(), is_backbuffer_texture);
+
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			if (shader_functions[i] != nullptr)
+			{
+				visit_pass_shader(shader_functions[i], shader_types[i], shader_sources[i]);
+			}
+		}
+
+		pass.program = glCreateProgram();
+
+		// GLSL has no intermediate code for single shaders, so the linked program is cached as a whole, prefixed with its binary format
+		std::vector<char> binary;
+		const uint64_t cache_key = shader_cache::make_key(shader_sources[0] + '\0' + shader_sources[1], std::string(), "glsl", 0, _driver_identity);
+
+		if (shader_cache::global().load(cache_key, binary) && binary.size() > sizeof(GLenum))
+		{
+			GLenum format = GL_NONE;
+			std::memcpy(&format, binary.data(), sizeof(format));
+
+			glProgramBinary(pass.program, format, binary.data() + sizeof(format), static_cast<GLsizei>(binary.size() - sizeof(format)));
+
+			GLint status = GL_FALSE;
+			glGetProgramiv(pass.program, GL_LINK_STATUS, &status);
+
+			if (status != GL_FALSE)
+			{
+				return;
+			}
+
+			// The driver may reject binaries from a different version of itself, in which case the program is compiled from source again below
+		}
 
-				visit_pass_shader(shader_functions[i], shader_types[i], shaders[i]);
+		glProgramParameteri(pass.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
-				glAttachShader(pass.program, shaders[i]);
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			if (shader_functions[i] == nullptr)
+			{
+				continue;
 			}
+
+			shaders[i] = glCreateShader(shader_types[i]);
+
+			GLint status = GL_FALSE;
+			const GLchar *src = shader_sources[i].c_str();
+			const GLsizei len = static_cast<GLsizei>(shader_sources[i].size());
+
+			glShaderSource(shaders[i], 1, &src, &len);
+			glCompileShader(shaders[i]);
+			glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &status);
+
+			if (status == GL_FALSE)
+			{
+				GLint logsize = 0;
+				glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &logsize);
+
+				std::string log(logsize, '\0');
+				glGetShaderInfoLog(shaders[i], logsize, nullptr, &log.front());
+
+				_errors += log;
+				error(shader_functions[i]->location, "internal shader compilation failed");
+			}
+
+			glAttachShader(pass.program, shaders[i]);
 		}
 
 		glLinkProgram(pass.program);
@@ -2376,8 +2496,22 @@ namespace reshade::opengl
 			error(node->location, "program linking failed");
 			return;
 		}
+
+		GLint binary_length = 0;
+		glGetProgramiv(pass.program, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+
+		if (binary_length > 0)
+		{
+			GLenum format = GL_NONE;
+			binary.resize(sizeof(format) + binary_length);
+
+			glGetProgramBinary(pass.program, binary_length, nullptr, &format, binary.data() + sizeof(format));
+			std::memcpy(binary.data(), &format, sizeof(format));
+
+			shader_cache::global().store(cache_key, binary);
+		}
 	}
-	void opengl_effect_compiler::visit_pass_shader(const function_declaration_node *node, unsigned int shadertype, unsigned int &shader)
+	void opengl_effect_compiler::visit_pass_shader(const function_declaration_node *node, unsigned int shadertype, std::string &code)
 	{
 		std::stringstream source;
 
@@ -2398,9 +2532,13 @@ namespace reshade::opengl
 			"vec4 _texelFetch(sampler2D s, ivec4 c) { return texelFetch(s, c.xy, c.w); }\n"
 			"#define _textureLodOffset(s, c, offset) textureLodOffset(s, (c).xy, (c).w, offset)\n";
 
-		if (_uniform_buffer_size != 0)
+		if (_uniform_buffer_size[static_uniforms] != 0)
 		{
-			source << "layout(std140, binding = 0) uniform _GLOBAL_\n{\n" << _global_uniforms.str() << "};\n";
+			source << "layout(std140, binding = 0) uniform _GLOBAL_\n{\n" << _global_uniforms[static_uniforms].str() << "};\n";
+		}
+		if (_uniform_buffer_size[dynamic_uniforms] != 0)
+		{
+			source << "layout(std140, binding = 1) uniform _GLOBAL_DYNAMIC_\n{\n" << _global_uniforms[dynamic_uniforms].str() << "};\n";
 		}
 
 		if (shadertype != GL_FRAGMENT_SHADER)
@@ -2642,10 +2780,7 @@ namespace reshade::opengl
 
 		source << "}\n";
 
-		GLint status = GL_FALSE;
-		const std::string source_str = source.str();
-		const GLchar *src = source_str.c_str();
-		const GLsizei len = static_cast<GLsizei>(source_str.size());
+		code = source.str();
 
 #if RESHADE_DUMP_NATIVE_SHADERS
 		if (!_dumped_shaders.count(node->unique_name))
@@ -2654,28 +2789,12 @@ namespace reshade::opengl
 
 			if (dumpfile.is_open())
 			{
-				dumpfile << "#ifdef RESHADE_SHADER_" << shadertype << "_" << node->unique_name << std::endl << source_str << "#endif" << std::endl << std::endl;
+				dumpfile << "#ifdef RESHADE_SHADER_" << shadertype << "_" << node->unique_name << std::endl << code << "#endif" << std::endl << std::endl;
 
 				_dumped_shaders.insert(node->unique_name);
 			}
 		}
 #endif
-
-		glShaderSource(shader, 1, &src, &len);
-		glCompileShader(shader);
-		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-
-		if (status == GL_FALSE)
-		{
-			GLint logsize = 0;
-			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logsize);
-
-			std::string log(logsize, '\0');
-			glGetShaderInfoLog(shader, logsize, nullptr, &log.front());
-
-			_errors += log;
-			error(node->location, "internal shader compilation failed");
-		}
 	}
 	void opengl_effect_compiler::visit_shader_param(std::stringstream &output, type_node type, unsigned int qualifier, const std::string &name, const std::string &semantic, unsigned int shadertype)
 	{
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "effect_syntax_tree.hpp"
+#include "runtime_objects.hpp"
 #include <sstream>
 #include <unordered_set>
 
@@ -61,9 +62,10 @@ namespace reshade::opengl
 		void visit_texture(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_sampler(const reshadefx::nodes::variable_declaration_node *node);
 		void visit_uniform(const reshadefx::nodes::variable_declaration_node *node);
+		void layout_uniform_buffers();
 		void visit_technique(const reshadefx::nodes::technique_declaration_node *node);
 		void visit_pass(const reshadefx::nodes::pass_declaration_node *node, opengl_pass_data &pass);
-		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, unsigned int shadertype, unsigned int &shader);
+		void visit_pass_shader(const reshadefx::nodes::function_declaration_node *node, unsigned int shadertype, std::string &code);
 		void visit_shader_param(std::stringstream &output, reshadefx::nodes::type_node type, unsigned int qualifier, const std::string &name, const std::string &semantic, unsigned int shadertype);
 
 		struct function
@@ -76,10 +78,16 @@ namespace reshade::opengl
 		bool _success;
 		const reshadefx::syntax_tree &_ast;
 		std::string &_errors;
-		std::stringstream _global_code, _global_uniforms;
+		// Uniforms bound to a source the runtime updates every frame are kept in a uniform buffer of their own, so that the one with all other uniforms is only uploaded when a value is changed
+		enum uniform_buffer_index { static_uniforms, dynamic_uniforms, uniform_buffer_count };
+
+		std::stringstream _global_code, _global_uniforms[uniform_buffer_count];
+		std::string _driver_identity;
 		const reshadefx::nodes::function_declaration_node *_current_function;
 		std::unordered_map<const reshadefx::nodes::function_declaration_node *, function> _functions;
-		GLintptr _uniform_storage_offset = 0, _uniform_buffer_size = 0;
+		GLintptr _uniform_buffer_offset[uniform_buffer_count] = { }, _uniform_buffer_size[uniform_buffer_count] = { };
+		std::vector<unsigned char> _uniform_buffer_data[uniform_buffer_count];
+		std::vector<std::pair<uniform, uniform_buffer_index>> _uniforms; // Storage offsets are relative to the uniform buffer until the size of all buffers is known
 #if RESHADE_DUMP_NATIVE_SHADERS
 		filesystem::path _dump_filename;
 		std::unordered_set<std::string> _dumped_shaders;
@@ -399,6 +399,22 @@ namespace reshade::opengl
 
 		_effect_ubos.clear();
 	}
+	void opengl_runtime::swap_effects()
+	{
+		runtime::swap_effects();
+
+		std::swap(_effect_samplers, _inactive_effects.samplers);
+		std::swap(_effect_ubos, _inactive_effects.ubos);
+
+		// The depth buffer may have changed while these effects were inactive
+		for (auto &texture : _textures)
+		{
+			if (texture.impl_reference == texture_reference::depth_buffer)
+			{
+				update_texture_reference(texture, texture_reference::depth_buffer);
+			}
+		}
+	}
 	void opengl_runtime::on_present()
 	{
 		if (!is_initialized())
@@ -470,6 +486,9 @@ namespace reshade::opengl
 			glFrontFace(GL_CCW);
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
+			// The copy of the back buffer shaders sample from still has the contents of the last frame
+			_is_backbuffer_copy_outdated = true;
+
 			// Apply post processing
 			on_present_effect();
 		}
@@ -721,64 +740,95 @@ namespace reshade::opengl
 		glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
 
 		// Setup shader constants
-		if (technique.uniform_storage_index >= 0)
-		{
-			glBindBufferBase(GL_UNIFORM_BUFFER, 0, _effect_ubos[technique.uniform_storage_index].first);
-			glBufferSubData(GL_UNIFORM_BUFFER, 0, _effect_ubos[technique.uniform_storage_index].second, get_uniform_value_storage().data() + technique.uniform_storage_offset);
-		}
+		const ptrdiff_t storage_indices[2] = { technique.uniform_storage_index, technique.dynamic_uniform_storage_index };
+		const ptrdiff_t storage_offsets[2] = { technique.uniform_storage_offset, technique.dynamic_uniform_storage_offset };
 
-		for (const auto &pass_object : technique.passes)
+		for (GLuint i = 0; i < 2; i++)
 		{
-			const opengl_pass_data &pass = *pass_object->as<opengl_pass_data>();
+			if (storage_indices[i] < 0)
+			{
+				continue;
+			}
 
-			// Save frame buffer of previous pass
-			glDisable(GL_FRAMEBUFFER_SRGB);
-			glBindFramebuffer(GL_READ_FRAMEBUFFER, _default_backbuffer_fbo);
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _blit_fbo);
-			glReadBuffer(GL_COLOR_ATTACHMENT0);
-			glDrawBuffer(GL_COLOR_ATTACHMENT0);
-			glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindBufferBase(GL_UNIFORM_BUFFER, i, _effect_ubos[storage_indices[i]].first);
 
-			// Setup states
-			glUseProgram(pass.program);
-			glColorMask(pass.color_mask[0], pass.color_mask[1], pass.color_mask[2], pass.color_mask[3]);
-			glBlendFuncSeparate(pass.blend_src, pass.blend_dest, pass.blend_src_alpha, pass.blend_dest_alpha);
-			glBlendEquationSeparate(pass.blend_eq_color, pass.blend_eq_alpha);
-			glStencilFunc(pass.stencil_func, pass.stencil_reference, pass.stencil_read_mask);
-			glStencilOp(pass.stencil_op_fail, pass.stencil_op_z_fail, pass.stencil_op_z_pass);
-			glStencilMask(pass.stencil_mask);
-
-			if (pass.srgb)
+			// The buffer is shared by all techniques in the effect and keeps its contents between frames, so only the part that changed since it was last updated is uploaded
+			size_t modified_offset = storage_offsets[i], modified_size = static_cast<size_t>(_effect_ubos[storage_indices[i]].second);
+
+			if (consume_modified_uniform_range(modified_offset, modified_size))
 			{
-				glEnable(GL_FRAMEBUFFER_SRGB);
+				glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(modified_offset - storage_offsets[i]), static_cast<GLsizeiptr>(modified_size), get_uniform_value_storage().data() + modified_offset);
 			}
-			else
+		}
+
+		for (size_t schedule_index = 0; schedule_index < technique.schedule.size(); schedule_index++)
+		{
+			const auto &scheduled = technique.schedule[schedule_index];
+			const opengl_pass_data &pass = *technique.passes[scheduled.index]->as<opengl_pass_data>();
+
+			// The previous pass rendered to the same targets with the same states, so everything but the program is still set up for this one
+			bool is_state_bound = scheduled.shares_state_with_previous;
+
+			// Save frame buffer of previous pass, but only if this pass samples it and it changed since the last copy
+			if (pass.samples_backbuffer && _is_backbuffer_copy_outdated)
 			{
+				// This binds other frame buffers, so set everything up again afterwards
+				is_state_bound = false;
+
 				glDisable(GL_FRAMEBUFFER_SRGB);
-			}
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, _default_backbuffer_fbo);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _blit_fbo);
+				glReadBuffer(GL_COLOR_ATTACHMENT0);
+				glDrawBuffer(GL_COLOR_ATTACHMENT0);
+				glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 
-			if (pass.blend)
-			{
-				glEnable(GL_BLEND);
-			}
-			else
-			{
-				glDisable(GL_BLEND);
+				_is_backbuffer_copy_outdated = false;
 			}
 
-			if (pass.stencil_test)
-			{
-				glEnable(GL_STENCIL_TEST);
-			}
-			else
+			// Setup states
+			glUseProgram(pass.program);
+
+			if (!is_state_bound)
 			{
-				glDisable(GL_STENCIL_TEST);
-			}
+				glColorMask(pass.color_mask[0], pass.color_mask[1], pass.color_mask[2], pass.color_mask[3]);
+				glBlendFuncSeparate(pass.blend_src, pass.blend_dest, pass.blend_src_alpha, pass.blend_dest_alpha);
+				glBlendEquationSeparate(pass.blend_eq_color, pass.blend_eq_alpha);
+				glStencilFunc(pass.stencil_func, pass.stencil_reference, pass.stencil_read_mask);
+				glStencilOp(pass.stencil_op_fail, pass.stencil_op_z_fail, pass.stencil_op_z_pass);
+				glStencilMask(pass.stencil_mask);
+
+				if (pass.srgb)
+				{
+					glEnable(GL_FRAMEBUFFER_SRGB);
+				}
+				else
+				{
+					glDisable(GL_FRAMEBUFFER_SRGB);
+				}
+
+				if (pass.blend)
+				{
+					glEnable(GL_BLEND);
+				}
+				else
+				{
+					glDisable(GL_BLEND);
+				}
+
+				if (pass.stencil_test)
+				{
+					glEnable(GL_STENCIL_TEST);
+				}
+				else
+				{
+					glDisable(GL_STENCIL_TEST);
+				}
 
-			// Setup render targets
-			glBindFramebuffer(GL_FRAMEBUFFER, pass.fbo);
-			glDrawBuffers(8, pass.draw_buffers);
-			glViewport(0, 0, pass.viewport_width, pass.viewport_height);
+				// Setup render targets
+				glBindFramebuffer(GL_FRAMEBUFFER, pass.fbo);
+				glDrawBuffers(8, pass.draw_buffers);
+				glViewport(0, 0, pass.viewport_width, pass.viewport_height);
+			}
 
 			if (pass.clear_render_targets)
 			{
@@ -800,6 +850,17 @@ namespace reshade::opengl
 			_vertices += 3;
 			_drawcalls += 1;
 
+			if (pass.writes_backbuffer)
+			{
+				_is_backbuffer_copy_outdated = true;
+			}
+
+			// The next pass renders to the same targets, so leave updating them to it
+			if (schedule_index + 1 < technique.schedule.size() && technique.schedule[schedule_index + 1].shares_state_with_previous)
+			{
+				continue;
+			}
+
 			// Update shader resources
 			for (GLuint texture_id : pass.draw_textures)
 			{
@@ -42,6 +42,7 @@ namespace reshade::opengl
 		GLenum blend_eq_color = GL_NONE, blend_eq_alpha = GL_NONE, blend_src = GL_NONE, blend_dest = GL_NONE, blend_src_alpha = GL_NONE, blend_dest_alpha = GL_NONE;
 		GLboolean color_mask[4] = { };
 		bool srgb = false, blend = false, stencil_test = false, clear_render_targets = true;
+		bool samples_backbuffer = false, writes_backbuffer = false;
 	};
 	struct opengl_technique_data : base_object
 	{
@@ -70,6 +71,7 @@ namespace reshade::opengl
 		bool on_init(unsigned int width, unsigned int height);
 		void on_reset();
 		void on_reset_effect() override;
+		void swap_effects() override;
 		void on_present();
 		void on_draw_call(unsigned int vertices);
 		void on_fbo_attachment(GLenum target, GLenum attachment, GLenum objecttarget, GLuint object, GLint level);
@@ -92,6 +94,12 @@ namespace reshade::opengl
 		std::vector<std::pair<GLuint, GLsizeiptr>> _effect_ubos;
 
 	private:
+		struct
+		{
+			std::vector<struct opengl_sampler> samplers;
+			std::vector<std::pair<GLuint, GLsizeiptr>> ubos;
+		} _inactive_effects;
+
 		struct depth_source_info
 		{
 			unsigned int width, height;
@@ -110,6 +118,7 @@ namespace reshade::opengl
 
 		opengl_stateblock _stateblock;
 		std::unordered_map<GLuint, depth_source_info> _depth_source_table;
+		bool _is_backbuffer_copy_outdated = true;
 
 		GLuint _imgui_shader_program = 0, _imgui_VertHandle = 0, _imgui_FragHandle = 0;
 		int _imgui_attribloc_tex = 0, _imgui_attribloc_projmtx = 0;
@@ -0,0 +1,329 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "pass_graph.hpp"
+#include "effect_optimizer.hpp"
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+namespace reshade
+{
+	using namespace reshadefx;
+	using namespace reshadefx::nodes;
+
+	const char *const pass_graph::backbuffer_resource = "<BackBuffer>";
+	const char *const pass_graph::stencil_resource = "<Stencil>";
+
+	static std::string resource_name(const variable_declaration_node *texture)
+	{
+		// All textures with this semantic refer to the same back buffer, regardless of what they are called in each effect
+		if (texture->semantic == "COLOR" || texture->semantic == "SV_TARGET")
+		{
+			return pass_graph::backbuffer_resource;
+		}
+
+		return texture->unique_name;
+	}
+	static bool contains(const std::vector<std::string> &resources, const std::string &resource)
+	{
+		return std::find(resources.begin(), resources.end(), resource) != resources.end();
+	}
+
+	void pass_graph::clear()
+	{
+		_nodes.clear();
+		_output_states.clear();
+		_schedule.clear();
+	}
+	void pass_graph::add_technique(size_t technique_index, const technique_declaration_node *technique)
+	{
+		for (size_t pass_index = 0; pass_index < technique->pass_list.size(); pass_index++)
+		{
+			const auto pass = technique->pass_list[pass_index];
+
+			node node;
+			node.technique_index = technique_index;
+			node.pass_index = pass_index;
+			node.name = technique->name + '/' + (pass->name.empty() ? std::to_string(pass_index) : pass->name);
+
+			std::unordered_set<const declaration_node *> reachable;
+
+			if (pass->vertex_shader != nullptr)
+			{
+				find_reachable_declarations(pass->vertex_shader, reachable);
+			}
+			if (pass->pixel_shader != nullptr)
+			{
+				find_reachable_declarations(pass->pixel_shader, reachable);
+			}
+
+			for (const auto declaration : reachable)
+			{
+				if (declaration->id == nodeid::variable_declaration && static_cast<const variable_declaration_node *>(declaration)->type.is_texture())
+				{
+					node.reads.push_back(resource_name(static_cast<const variable_declaration_node *>(declaration)));
+				}
+			}
+
+			// The set is unordered, so sort the list to get the same result every time
+			std::sort(node.reads.begin(), node.reads.end());
+			node.reads.erase(std::unique(node.reads.begin(), node.reads.end()), node.reads.end());
+
+			output_state state;
+
+			// The back buffer takes the place of the first render target if that is not set
+			if (pass->render_targets[0] == nullptr)
+			{
+				node.writes.push_back(backbuffer_resource);
+			}
+
+			for (unsigned int i = 0; i < 8; i++)
+			{
+				if (pass->render_targets[i] != nullptr)
+				{
+					node.writes.push_back(pass->render_targets[i]->unique_name);
+				}
+
+				state.render_targets += (pass->render_targets[i] != nullptr ? pass->render_targets[i]->unique_name : i == 0 ? backbuffer_resource : std::string()) + ',';
+			}
+
+			state.render_targets += pass->srgb_write_enable ? "srgb" : "linear";
+
+			// The stencil buffer is shared by all passes, so treat it like a resource that is both read and written by every pass using it
+			if (pass->stencil_enable)
+			{
+				node.reads.push_back(stencil_resource);
+				node.writes.push_back(stencil_resource);
+			}
+
+			state.states = {
+				pass->blend_enable, pass->blend_op, pass->blend_op_alpha, pass->src_blend, pass->dest_blend, pass->src_blend_alpha, pass->dest_blend_alpha, pass->color_write_mask,
+				pass->stencil_enable, pass->stencil_read_mask, pass->stencil_write_mask, pass->stencil_comparison_func, pass->stencil_reference_value, pass->stencil_op_pass, pass->stencil_op_fail, pass->stencil_op_depth_fail };
+
+			_nodes.push_back(std::move(node));
+			_output_states.push_back(std::move(state));
+		}
+	}
+	void pass_graph::build()
+	{
+		_schedule.clear();
+
+		// Connect each pass with the passes before it that it has to stay behind: The last one to render to any resource it accesses, and every one that sampled a resource it renders to since that was last rendered to
+		// Render targets count as accessed even if they are not sampled, since blending, the color write mask and discarded pixels all keep parts of their previous contents
+		std::unordered_map<std::string, size_t> last_writers;
+		std::unordered_map<std::string, std::vector<size_t>> readers_since_write;
+
+		for (size_t i = 0; i < _nodes.size(); i++)
+		{
+			auto &node = _nodes[i];
+			node.dependencies.clear();
+			node.culled = false;
+			node.shares_state_with_previous = false;
+
+			for (const auto resources : { &node.reads, &node.writes })
+			{
+				for (const auto &resource : *resources)
+				{
+					if (const auto it = last_writers.find(resource); it != last_writers.end() && it->second != i)
+					{
+						node.dependencies.push_back(it->second);
+					}
+				}
+			}
+			for (const auto &resource : node.writes)
+			{
+				for (const size_t reader : readers_since_write[resource])
+				{
+					if (reader != i)
+					{
+						node.dependencies.push_back(reader);
+					}
+				}
+			}
+
+			std::sort(node.dependencies.begin(), node.dependencies.end());
+			node.dependencies.erase(std::unique(node.dependencies.begin(), node.dependencies.end()), node.dependencies.end());
+
+			for (const auto &resource : node.reads)
+			{
+				readers_since_write[resource].push_back(i);
+			}
+			for (const auto &resource : node.writes)
+			{
+				last_writers[resource] = i;
+				readers_since_write[resource].clear();
+			}
+		}
+
+		// Only what ends up in the back buffer or the stencil buffer is visible, so every other pass is only needed if one of those samples its output, directly or through other passes
+		// This includes passes that sample a texture before it is rendered to in the same frame, since they see the contents of the previous frame then
+		std::unordered_map<std::string, std::vector<size_t>> writers;
+		std::vector<size_t> used_nodes;
+		std::vector<bool> is_used(_nodes.size(), false);
+
+		for (size_t i = 0; i < _nodes.size(); i++)
+		{
+			for (const auto &resource : _nodes[i].writes)
+			{
+				writers[resource].push_back(i);
+			}
+
+			if (contains(_nodes[i].writes, backbuffer_resource) || contains(_nodes[i].writes, stencil_resource))
+			{
+				is_used[i] = true;
+				used_nodes.push_back(i);
+			}
+		}
+
+		while (!used_nodes.empty())
+		{
+			const size_t i = used_nodes.back();
+			used_nodes.pop_back();
+
+			for (const auto &resource : _nodes[i].reads)
+			{
+				for (const size_t writer : writers[resource])
+				{
+					if (!is_used[writer])
+					{
+						is_used[writer] = true;
+						used_nodes.push_back(writer);
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < _nodes.size(); i++)
+		{
+			_nodes[i].culled = !is_used[i];
+		}
+
+		// Techniques keep their order, but the passes in each of them are rendered in any order their dependencies allow, preferring passes that render to the same targets as the one before
+		std::vector<bool> is_scheduled(_nodes.size(), false);
+		std::string current_render_targets;
+
+		for (size_t begin = 0, end = 0; begin < _nodes.size(); begin = end)
+		{
+			for (end = begin + 1; end < _nodes.size() && _nodes[end].technique_index == _nodes[begin].technique_index; end++)
+			{
+				continue;
+			}
+
+			size_t previous = std::numeric_limits<size_t>::max();
+
+			while (true)
+			{
+				size_t next = std::numeric_limits<size_t>::max();
+
+				for (size_t i = begin; i < end; i++)
+				{
+					if (_nodes[i].culled || is_scheduled[i])
+					{
+						continue;
+					}
+
+					// Culled passes are never rendered, so they do not hold up the passes that depend on them
+					if (!std::all_of(_nodes[i].dependencies.begin(), _nodes[i].dependencies.end(), [&](size_t dependency) { return is_scheduled[dependency] || _nodes[dependency].culled; }))
+					{
+						continue;
+					}
+
+					if (next == std::numeric_limits<size_t>::max())
+					{
+						next = i;
+					}
+
+					if (_output_states[i].render_targets == current_render_targets)
+					{
+						next = i;
+						break;
+					}
+				}
+
+				if (next == std::numeric_limits<size_t>::max())
+				{
+					break;
+				}
+
+				// Passes that sample what the previous one rendered need the render targets to be unbound in between, so those cannot share state (the stencil buffer is never sampled, so it does not count)
+				if (previous != std::numeric_limits<size_t>::max() && _output_states[next] == _output_states[previous])
+				{
+					_nodes[next].shares_state_with_previous = std::none_of(_nodes[next].reads.begin(), _nodes[next].reads.end(),
+						[this, previous](const std::string &resource) { return resource != stencil_resource && contains(_nodes[previous].writes, resource); });
+				}
+
+				is_scheduled[next] = true;
+				current_render_targets = _output_states[next].render_targets;
+				previous = next;
+
+				_schedule.push_back(next);
+			}
+		}
+	}
+	void pass_graph::apply(std::vector<technique> &techniques) const
+	{
+		for (const auto &node : _nodes)
+		{
+			techniques[node.technique_index].schedule.clear();
+		}
+
+		for (const size_t index : _schedule)
+		{
+			const auto &node = _nodes[index];
+
+			techniques[node.technique_index].schedule.push_back({ node.pass_index, node.shares_state_with_previous });
+		}
+	}
+
+	std::string pass_graph::to_dot() const
+	{
+		std::string dot = "digraph passes\n{\n\tnode [shape=box];\n";
+
+		for (size_t i = 0; i < _nodes.size(); i++)
+		{
+			const auto &node = _nodes[i];
+
+			dot += "\tpass" + std::to_string(i) + " [label=\"" + node.name + "\\n";
+
+			if (node.culled)
+			{
+				dot += "culled";
+			}
+			else
+			{
+				dot += "#" + std::to_string(std::distance(_schedule.begin(), std::find(_schedule.begin(), _schedule.end(), i)) + 1);
+
+				if (node.shares_state_with_previous)
+				{
+					dot += ", shares state";
+				}
+			}
+
+			for (const auto &resource : node.reads)
+			{
+				dot += "\\nreads " + resource;
+			}
+			for (const auto &resource : node.writes)
+			{
+				dot += "\\nwrites " + resource;
+			}
+
+			dot += node.culled ? "\", style=dashed];\n" : "\"];\n";
+		}
+
+		for (size_t i = 0; i < _nodes.size(); i++)
+		{
+			for (const size_t dependency : _nodes[i].dependencies)
+			{
+				dot += "\tpass" + std::to_string(dependency) + " -> pass" + std::to_string(i) + ";\n";
+			}
+		}
+
+		dot += "}\n";
+
+		return dot;
+	}
+}
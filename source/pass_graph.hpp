@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include "runtime_objects.hpp"
+
+namespace reshadefx::nodes
+{
+	#pragma region Forward Declarations
+	struct technique_declaration_node;
+	#pragma endregion
+}
+
+namespace reshade
+{
+	/// <summary>
+	/// A directed acyclic graph of the passes of all techniques rendered in a frame, connected through the textures they sample and render to.
+	/// It is used to skip passes whose output is never used and to choose the order the remaining passes of each technique are rendered in, so that render targets change as rarely as possible. Techniques themselves are always rendered in the order they were added in.
+	/// </summary>
+	class pass_graph
+	{
+	public:
+		struct node
+		{
+			size_t technique_index, pass_index;
+			std::string name;
+			std::vector<std::string> reads; // Resources sampled by the shaders of the pass
+			std::vector<std::string> writes; // Resources the pass renders to
+			std::vector<size_t> dependencies; // Nodes that have to be rendered before this one, because they access the same resources
+			bool culled = false;
+			bool shares_state_with_previous = false;
+		};
+
+		/// <summary>
+		/// The name the back buffer is referred to with in the list of resources a pass accesses.
+		/// </summary>
+		static const char *const backbuffer_resource;
+		/// <summary>
+		/// The name the stencil buffer is referred to with in the list of resources a pass accesses.
+		/// </summary>
+		static const char *const stencil_resource;
+
+		/// <summary>
+		/// Remove all passes.
+		/// </summary>
+		void clear();
+		/// <summary>
+		/// Add all passes of a technique. Techniques have to be added in the order they are rendered in.
+		/// </summary>
+		/// <param name="technique_index">The index of the technique in the runtime.</param>
+		/// <param name="node">The declaration of the technique in the syntax tree its effect was compiled from.</param>
+		void add_technique(size_t technique_index, const reshadefx::nodes::technique_declaration_node *node);
+		/// <summary>
+		/// Connect all passes that access the same resources, cull those whose output is never sampled by any other pass and schedule the rest.
+		/// </summary>
+		void build();
+		/// <summary>
+		/// Update the pass schedule of all techniques that were added to the graph.
+		/// </summary>
+		/// <param name="techniques">The techniques of the runtime, indexed like they were added.</param>
+		void apply(std::vector<technique> &techniques) const;
+
+		/// <summary>
+		/// Returns all passes in the order they were added in.
+		/// </summary>
+		const std::vector<node> &nodes() const { return _nodes; }
+		/// <summary>
+		/// Returns the indices of the passes that are not culled, in the order they are rendered in.
+		/// </summary>
+		const std::vector<size_t> &schedule() const { return _schedule; }
+
+		/// <summary>
+		/// Write the graph in the Graphviz DOT language, for debugging.
+		/// </summary>
+		std::string to_dot() const;
+
+	private:
+		struct output_state
+		{
+			std::string render_targets;
+			std::vector<unsigned int> states;
+
+			bool operator==(const output_state &other) const { return render_targets == other.render_targets && states == other.states; }
+		};
+
+		std::vector<node> _nodes;
+		std::vector<output_state> _output_states;
+		std::vector<size_t> _schedule;
+	};
+}
@@ -7,9 +7,13 @@
 #include "version.h"
 #include "runtime.hpp"
 #include "effect_parser.hpp"
+#include "effect_optimizer.hpp"
 #include "effect_preprocessor.hpp"
 #include "input.hpp"
 #include "ini_file.hpp"
+#include "shader_cache.hpp"
+#include "directory_watcher.hpp"
+#include <fstream>
 #include <algorithm>
 #include <unordered_set>
 #include <stb_image.h>
@@ -24,6 +28,76 @@ namespace reshade
 {
 	filesystem::path runtime::s_reshade_dll_path, runtime::s_target_executable_path;
 
+	static uint64_t hash_source_file(const filesystem::path &path)
+	{
+		// Go through the include cache, which only reads the file again if it was modified since the pre-processor last opened it
+		const auto data = reshadefx::include_cache::global().load(path);
+
+		return data != nullptr ? dependency_graph::hash(*data) : 0;
+	}
+	template <typename T>
+	static void store_uniform_value(unsigned char *data, size_t size, uniform_datatype basetype, const T *values, size_t count)
+	{
+		// Convert to the type of the variable the same way "runtime::set_uniform_value" does
+		count = std::min(count, size / 4);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (basetype == uniform_datatype::floating_point)
+			{
+				reinterpret_cast<float *>(data)[i] = static_cast<float>(values[i]);
+			}
+			else if (std::is_same_v<T, bool> && basetype == uniform_datatype::boolean)
+			{
+				reinterpret_cast<int *>(data)[i] = values[i] ? -1 : 0;
+			}
+			else
+			{
+				reinterpret_cast<int *>(data)[i] = static_cast<int>(values[i]);
+			}
+		}
+	}
+	static void load_uniform_value(const unsigned char *data, size_t size, uniform_datatype basetype, float *values, size_t count)
+	{
+		count = std::min(count, size / 4);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			switch (basetype)
+			{
+				case uniform_datatype::boolean:
+				case uniform_datatype::signed_integer:
+					values[i] = static_cast<float>(reinterpret_cast<const int *>(data)[i]);
+					break;
+				case uniform_datatype::unsigned_integer:
+					values[i] = static_cast<float>(reinterpret_cast<const unsigned int *>(data)[i]);
+					break;
+				case uniform_datatype::floating_point:
+					values[i] = reinterpret_cast<const float *>(data)[i];
+					break;
+			}
+		}
+	}
+	static void schedule_in_declaration_order(technique &technique)
+	{
+		technique.schedule.clear();
+
+		for (size_t pass_index = 0; pass_index < technique.passes.size(); pass_index++)
+		{
+			technique.schedule.push_back({ pass_index });
+		}
+	}
+	static bool is_up_to_date(const std::vector<dependency_graph::input> &dependencies)
+	{
+		return std::all_of(dependencies.begin(), dependencies.end(),
+			[](const auto &input) { return hash_source_file(input.path) == input.hash; });
+	}
+	static bool is_same_version(const std::vector<dependency_graph::input> &lhs, const std::vector<dependency_graph::input> &rhs)
+	{
+		return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+			[](const auto &a, const auto &b) { return a.path == b.path && a.hash == b.hash; });
+	}
+
 	runtime::runtime(uint32_t renderer) :
 		_renderer_id(renderer),
 		_start_time(std::chrono::high_resolution_clock::now()),
@@ -120,6 +194,8 @@ namespace reshade
 	}
 	void runtime::on_reset()
 	{
+		cancel_background_reload();
+
 		on_reset_effect();
 
 		if (!_is_initialized)
@@ -140,11 +216,32 @@ namespace reshade
 		_uniforms.clear();
 		_techniques.clear();
 		_uniform_data_storage.clear();
+		_uniform_storage_modified.clear();
+		_uniform_bindings.clear();
+		_deferred_effects.clear();
 		_errors.clear();
 
 		_texture_count = 0;
 		_uniform_count = 0;
 		_technique_count = 0;
+
+		_is_pass_graph_outdated = true;
+	}
+	void runtime::swap_effects()
+	{
+		std::swap(_textures, _inactive_effects.textures);
+		std::swap(_uniforms, _inactive_effects.uniforms);
+		std::swap(_techniques, _inactive_effects.techniques);
+		std::swap(_uniform_data_storage, _inactive_effects.uniform_data_storage);
+		std::swap(_uniform_storage_modified, _inactive_effects.uniform_storage_modified);
+		std::swap(_uniform_bindings, _inactive_effects.uniform_bindings);
+		std::swap(_deferred_effects, _inactive_effects.deferred_effects);
+		std::swap(_errors, _inactive_effects.errors);
+		std::swap(_texture_count, _inactive_effects.texture_count);
+		std::swap(_uniform_count, _inactive_effects.uniform_count);
+		std::swap(_technique_count, _inactive_effects.technique_count);
+
+		_is_pass_graph_outdated = true;
 	}
 	void runtime::on_present()
 	{
@@ -175,233 +272,139 @@ namespace reshade
 		// Reset input status
 		_input->next_frame();
 
-		// Update and compile next effect queued for reloading
-		if (_reload_remaining_effects != 0 && _framecount > 1)
+		// Compile effects again whose source files were modified, as long as no reload is in progress already (in which case notifications stay queued until it finished)
+		if (_reload_remaining_effects == 0 && !_effect_watchers.empty())
 		{
-			load_effect(_effect_files[_effect_files.size() - _reload_remaining_effects]);
-
-			_last_reload_time = std::chrono::high_resolution_clock::now();
-			_reload_remaining_effects--;
+			bool overflowed = false;
+			std::vector<filesystem::path> modifications;
 
-			if (_reload_remaining_effects == 0)
+			for (const auto &watcher : _effect_watchers)
 			{
-				load_textures();
-
-				load_current_preset();
-
-				if (_effect_filter_buffer[0] != '\0' && strcmp(_effect_filter_buffer, "Search") != 0)
+				while (watcher->check(modifications, overflowed))
 				{
-					filter_techniques(_effect_filter_buffer);
+					continue;
 				}
 			}
-		}
 
-		_drawcalls = _vertices = 0;
-	}
-	void runtime::on_present_effect()
-	{
-		if (_input->is_key_pressed(_effects_key_data[0], _effects_key_data[1] != 0, _effects_key_data[2] != 0, false))
-		{
-			_effects_enabled = !_effects_enabled;
-		}
-
-		if (!_effects_enabled)
-		{
-			return;
-		}
-
-		// Update all uniform variables
-		for (auto &variable : _uniforms)
-		{
-			const auto it = variable.annotations.find("source");
-
-			if (it == variable.annotations.end())
+			// Some notifications were lost, so compare every file effects were built from against its current contents instead (files that did not change are filtered out by their hash)
+			if (overflowed)
 			{
-				continue;
+				LOG(WARNING) << "Lost track of modifications to effect files, checking all of them ...";
+
+				modifications = _effect_dependencies.list_inputs();
 			}
 
-			const auto source = it->second.as<std::string>();
+			std::vector<dependency_graph::input> changed_files;
 
-			if (source == "frametime")
+			for (const auto &path : modifications)
 			{
-				const float value = _last_frame_duration.count() * 1e-6f;
-				set_uniform_value(variable, &value, 1);
-			}
-			else if (source == "framecount")
-			{
-				switch (variable.basetype)
+				if (_effect_dependencies.has_dependents(path))
 				{
-					case uniform_datatype::boolean:
-					{
-						const bool even = (_framecount % 2) == 0;
-						set_uniform_value(variable, &even, 1);
-						break;
-					}
-					case uniform_datatype::signed_integer:
-					case uniform_datatype::unsigned_integer:
-					{
-						const unsigned int framecount = static_cast<unsigned int>(_framecount % UINT_MAX);
-						set_uniform_value(variable, &framecount, 1);
-						break;
-					}
-					case uniform_datatype::floating_point:
-					{
-						const float framecount = static_cast<float>(_framecount % 16777216);
-						set_uniform_value(variable, &framecount, 1);
-						break;
-					}
+					changed_files.push_back({ path, hash_source_file(path) });
 				}
 			}
-			else if (source == "pingpong")
-			{
-				float value[2] = { 0, 0 };
-				get_uniform_value(variable, value, 2);
-
-				const float min = variable.annotations["min"].as<float>(), max = variable.annotations["max"].as<float>();
-				const float step_min = variable.annotations["step"].as<float>(0), step_max = variable.annotations["step"].as<float>(1);
-				float increment = step_max == 0 ? step_min : (step_min + std::fmodf(static_cast<float>(std::rand()), step_max - step_min + 1));
-				const float smoothing = variable.annotations["smoothing"].as<float>();
 
-				if (value[1] >= 0)
-				{
-					increment = std::max(increment - std::max(0.0f, smoothing - (max - value[0])), 0.05f);
-					increment *= _last_frame_duration.count() * 1e-9f;
+			if (!changed_files.empty())
+			{
+				const std::vector<filesystem::path> outdated = _effect_dependencies.find_outdated(changed_files);
 
-					if ((value[0] += increment) >= max)
-					{
-						value[0] = max;
-						value[1] = -1;
-					}
-				}
-				else
+				if (!outdated.empty())
 				{
-					increment = std::max(increment - std::max(0.0f, smoothing - (value[0] - min)), 0.05f);
-					increment *= _last_frame_duration.count() * 1e-9f;
+					LOG(INFO) << "Detected modifications to " << outdated.size() << " effect(s), compiling them again ...";
 
-					if ((value[0] -= increment) <= min)
-					{
-						value[0] = min;
-						value[1] = +1;
-					}
+					reload_effects(outdated);
 				}
-
-				set_uniform_value(variable, value, 2);
 			}
-			else if (source == "date")
+		}
+
+		// Compile next effect queued for reloading as soon as the worker threads finished parsing it, without ever waiting for them here
+		if (_reload_remaining_effects != 0 && _framecount > 1 &&
+			_parsed_effects[_effect_files.size() - _reload_remaining_effects].wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			// Effects reloaded in the background are created in the inactive set, so that the current ones keep rendering until all of them are done
+			if (_is_reloading_in_background)
 			{
-				set_uniform_value(variable, _date, 4);
+				swap_effects();
 			}
-			else if (source == "timer")
-			{
-				const unsigned long long timer = std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count();
 
-				switch (variable.basetype)
+			load_effect(_parsed_effects[_effect_files.size() - _reload_remaining_effects].get());
+
+			_last_reload_time = std::chrono::high_resolution_clock::now();
+			_reload_remaining_effects--;
+
+			if (_reload_remaining_effects != 0)
+			{
+				if (_is_reloading_in_background)
 				{
-					case uniform_datatype::boolean:
-					{
-						const bool even = (timer % 2) == 0;
-						set_uniform_value(variable, &even, 1);
-						break;
-					}
-					case uniform_datatype::signed_integer:
-					case uniform_datatype::unsigned_integer:
-					{
-						const unsigned int timer_int = static_cast<unsigned int>(timer % UINT_MAX);
-						set_uniform_value(variable, &timer_int, 1);
-						break;
-					}
-					case uniform_datatype::floating_point:
-					{
-						const float timer_float = std::fmod(static_cast<float>(timer * 1e-6f), 16777216.0f);
-						set_uniform_value(variable, &timer_float, 1);
-						break;
-					}
+					swap_effects();
 				}
 			}
-			else if (source == "key")
+			else
 			{
-				const int key = variable.annotations["keycode"].as<int>();
+				_parsed_effects.clear();
 
-				if (key > 7 && key < 256)
+				// The new set stays active from here on, so release the previous one
+				if (_is_reloading_in_background)
 				{
-					const std::string mode = variable.annotations["mode"].as<std::string>();
+					_is_reloading_in_background = false;
 
-					if (mode == "toggle" || variable.annotations["toggle"].as<bool>())
-					{
-						bool current = false;
-						get_uniform_value(variable, &current, 1);
+					swap_effects();
+					on_reset_effect();
+					swap_effects();
+				}
 
-						if (_input->is_key_pressed(key))
-						{
-							current = !current;
+				load_textures();
 
-							set_uniform_value(variable, &current, 1);
-						}
-					}
-					else if (mode == "press")
-					{
-						const bool state = _input->is_key_pressed(key);
+				load_current_preset();
 
-						set_uniform_value(variable, &state, 1);
-					}
-					else
+				// Techniques that were enabled with their toggle key while their effect was not compiled yet are not part of the preset, so enable them again
+				for (auto &technique : _techniques)
+				{
+					if (std::find(_techniques_enabled_on_demand.begin(), _techniques_enabled_on_demand.end(), technique.name) != _techniques_enabled_on_demand.end())
 					{
-						const bool state = _input->is_key_down(key);
-
-						set_uniform_value(variable, &state, 1);
+						technique.enabled = true;
+						technique.timeleft = technique.timeout;
 					}
 				}
-			}
-			else if (source == "mousepoint")
-			{
-				const float values[2] = { static_cast<float>(_input->mouse_position_x()), static_cast<float>(_input->mouse_position_y()) };
 
-				set_uniform_value(variable, values, 2);
-			}
-			else if (source == "mousedelta")
-			{
-				const float values[2] = { static_cast<float>(_input->mouse_movement_delta_x()), static_cast<float>(_input->mouse_movement_delta_y()) };
+				_techniques_enabled_on_demand.clear();
 
-				set_uniform_value(variable, values, 2);
-			}
-			else if (source == "mousebutton")
-			{
-				const int index = variable.annotations["keycode"].as<int>();
-
-				if (index >= 0 && index < 5)
+				if (_effect_index_modified)
 				{
-					if (variable.annotations["toggle"].as<bool>())
-					{
-						bool current = false;
-						get_uniform_value(variable, &current, 1);
-
-						if (_input->is_mouse_button_pressed(index))
-						{
-							current = !current;
-
-							set_uniform_value(variable, &current, 1);
-						}
-					}
-					else
-					{
-						const bool state = _input->is_mouse_button_down(index);
+					save_effect_index();
+				}
 
-						set_uniform_value(variable, &state, 1);
-					}
+				if (_effect_filter_buffer[0] != '\0' && strcmp(_effect_filter_buffer, "Search") != 0)
+				{
+					filter_techniques(_effect_filter_buffer);
 				}
 			}
-			else if (source == "random")
-			{
-				const int min = variable.annotations["min"].as<int>(), max = variable.annotations["max"].as<int>();
-				const int value = min + (std::rand() % (max - min + 1));
+		}
 
-				set_uniform_value(variable, &value, 1);
-			}
+		_drawcalls = _vertices = 0;
+	}
+	void runtime::on_present_effect()
+	{
+		if (_input->is_key_pressed(_effects_key_data[0], _effects_key_data[1] != 0, _effects_key_data[2] != 0, false))
+		{
+			_effects_enabled = !_effects_enabled;
 		}
 
-		// Render all enabled techniques
-		for (auto &technique : _techniques)
+		if (!_effects_enabled)
 		{
+			return;
+		}
+
+		// Update all uniform variables
+		update_uniform_bindings();
+
+		std::vector<size_t> techniques_to_render;
+		std::vector<filesystem::path> effects_to_compile;
+
+		for (size_t technique_index = 0; technique_index < _techniques.size(); technique_index++)
+		{
+			auto &technique = _techniques[technique_index];
+
 			if (technique.timeleft > 0)
 			{
 				technique.timeleft -= static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(_last_frame_duration).count());
@@ -429,6 +432,44 @@ namespace reshade
 				continue;
 			}
 
+			// The technique was just enabled, but its effect was not compiled yet, so do that now and render it once it is done
+			if (const auto deferred = _deferred_effects.find(technique.effect_filename); deferred != _deferred_effects.end())
+			{
+				if (std::find(effects_to_compile.begin(), effects_to_compile.end(), deferred->second) == effects_to_compile.end())
+				{
+					effects_to_compile.push_back(deferred->second);
+				}
+
+				if (std::find(_techniques_enabled_on_demand.begin(), _techniques_enabled_on_demand.end(), technique.name) == _techniques_enabled_on_demand.end())
+				{
+					_techniques_enabled_on_demand.push_back(technique.name);
+				}
+
+				continue;
+			}
+
+			techniques_to_render.push_back(technique_index);
+		}
+
+		// Which passes are needed and the order they are rendered in depends on all techniques rendered together, so schedule them again whenever that set changes
+		if (_is_pass_graph_outdated || techniques_to_render != _pass_graph_techniques)
+		{
+			update_pass_graph(techniques_to_render);
+		}
+
+		// Render all enabled techniques
+		for (const size_t technique_index : techniques_to_render)
+		{
+			auto &technique = _techniques[technique_index];
+
+			// None of the passes of this technique contribute to the image
+			if (technique.schedule.empty())
+			{
+				technique.average_cpu_duration.clear();
+				technique.average_gpu_duration.clear();
+				continue;
+			}
+
 			const auto time_technique_started = std::chrono::high_resolution_clock::now();
 
 			render_technique(technique);
@@ -437,11 +478,27 @@ namespace reshade
 
 			technique.average_cpu_duration.append(std::chrono::duration_cast<std::chrono::nanoseconds>(time_technique_finished - time_technique_started).count());
 		}
+
+		if (!effects_to_compile.empty())
+		{
+			for (const auto &path : effects_to_compile)
+			{
+				_effects_compiled_on_demand.insert(path.string());
+			}
+
+			// Wait for a reload that is already in progress to finish, the techniques stay enabled and request their effects again afterwards
+			if (_reload_remaining_effects == 0)
+			{
+				LOG(INFO) << "Compiling " << effects_to_compile.size() << " effect(s) on demand ...";
+
+				reload_effects(effects_to_compile);
+			}
+		}
 	}
 
-	void runtime::reload()
+	void runtime::reload(bool in_background)
 	{
-		on_reset_effect();
+		begin_reload(in_background);
 
 		_effect_files.clear();
 
@@ -490,152 +547,740 @@ namespace reshade
 			}
 		}
 
-		_reload_remaining_effects = _effect_files.size();
+		// Watch all effect search paths for modifications, so that effects can be compiled again as soon as their source code changes
+		_effect_watchers.clear();
+
+		for (const auto &search_path : _effect_search_paths)
+		{
+			if (search_path.empty() || !filesystem::exists(search_path))
+			{
+				continue;
+			}
+
+			_effect_watchers.push_back(std::make_unique<filesystem::directory_watcher>(search_path));
+		}
+
+		// Everything is parsed again, so rebuild the dependency graph from scratch too
+		_effect_dependencies.clear();
+
+		// Effects are only compiled on demand until the next full reload, after which the preset decides again
+		_effects_compiled_on_demand.clear();
+
+		if (_compile_on_demand && _effect_index.empty())
+		{
+			load_effect_index();
+		}
+
+		parse_effects(_effect_files);
+	}
+	void runtime::reload_effects(const std::vector<filesystem::path> &outdated)
+	{
+		begin_reload(true);
+
+		parse_effects(outdated);
+	}
+	void runtime::begin_reload(bool in_background)
+	{
+		cancel_background_reload();
+
+		// Keep rendering the current effects while the new ones are loaded, unless there are none to begin with
+		_is_reloading_in_background = in_background && _technique_count != 0;
+
+		if (_is_reloading_in_background)
+		{
+			LOG(INFO) << "Reloading effects in the background ...";
+
+			// Start from a clean inactive set, with everything a backend sets up for new effects
+			swap_effects();
+			on_reset_effect();
+			swap_effects();
+		}
+		else
+		{
+			on_reset_effect();
+		}
+	}
+	void runtime::parse_effects(const std::vector<filesystem::path> &outdated)
+	{
+		_reload_remaining_effects = _effect_files.size();
+
+		// Pre-processing and parsing do not touch any runtime state, so they run for all effects at once on the worker threads, while the render thread only creates the objects for each effect once it is ready
+		// Everything the workers need is copied here, so that changes made in the meantime (e.g. through the settings menu) do not race with them
+		std::shared_ptr<const ini_file> preset;
+
+		if (_performance_mode && _current_preset >= 0)
+		{
+			preset = std::make_shared<const ini_file>(_preset_files[_current_preset]);
+		}
+
+		// Performance mode only loads the effects used by the preset already, so compiling on demand is only of use outside of it
+		const bool compile_on_demand = _compile_on_demand && !_performance_mode;
+		const auto enabled_techniques = std::make_shared<std::vector<std::string>>();
+
+		if (compile_on_demand && _current_preset >= 0)
+		{
+			ini_file(_preset_files[_current_preset]).get("", "Techniques", *enabled_techniques);
+		}
+
+		_parsed_effects.clear();
+
+		for (const auto &path : _effect_files)
+		{
+			// Effects that did not change are created from the syntax tree of their last successful compilation, which is the same as parsing them again would produce
+			// This does not apply to effects whose last attempt failed, so that their errors are reported again
+			if (const auto previous = _last_compiled_effects.find(path.string());
+				previous != _last_compiled_effects.end() && std::find(outdated.begin(), outdated.end(), path) == outdated.end() &&
+				_effect_dependencies.is_built_from(path, previous->second.dependencies))
+			{
+				std::promise<parsed_effect> unchanged_effect;
+				unchanged_effect.set_value(previous->second);
+
+				_parsed_effects.push_back(unchanged_effect.get_future());
+				continue;
+			}
+
+			const auto pp = std::make_shared<reshadefx::preprocessor>();
+			pp->add_include_path(path.parent_path());
+
+			for (const auto &include_path : _effect_search_paths)
+			{
+				if (include_path.empty())
+				{
+					continue;
+				}
+
+				pp->add_include_path(include_path);
+			}
+
+			// Nearly every effect starts by including this header, so share its pre-processed state between them
+			pp->set_precompiled_header("ReShade.fxh");
+
+			pp->add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+			pp->add_macro_definition("__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0");
+			pp->add_macro_definition("__VENDOR__", std::to_string(_vendor_id));
+			pp->add_macro_definition("__DEVICE__", std::to_string(_device_id));
+			pp->add_macro_definition("__RENDERER__", std::to_string(_renderer_id));
+			pp->add_macro_definition("__APPLICATION__", std::to_string(std::hash<std::string>()(s_target_executable_path.filename_without_extension().string())));
+			pp->add_macro_definition("BUFFER_WIDTH", std::to_string(_width));
+			pp->add_macro_definition("BUFFER_HEIGHT", std::to_string(_height));
+			pp->add_macro_definition("BUFFER_RCP_WIDTH", std::to_string(1.0f / static_cast<float>(_width)));
+			pp->add_macro_definition("BUFFER_RCP_HEIGHT", std::to_string(1.0f / static_cast<float>(_height)));
+
+			for (const auto &definition : _preprocessor_definitions)
+			{
+				if (definition.empty())
+				{
+					continue;
+				}
+
+				const size_t equals_index = definition.find_first_of('=');
+
+				if (equals_index != std::string::npos)
+				{
+					pp->add_macro_definition(definition.substr(0, equals_index), definition.substr(equals_index + 1));
+				}
+				else
+				{
+					pp->add_macro_definition(definition);
+				}
+			}
+
+			std::shared_ptr<const indexed_effect> index;
+
+			if (compile_on_demand && _effects_compiled_on_demand.count(path.string()) == 0)
+			{
+				const auto it = _effect_index.find(path.string());
+
+				index = it != _effect_index.end() ? it->second : std::make_shared<const indexed_effect>();
+			}
+
+			_parsed_effects.push_back(_worker_pool.enqueue([path, pp, preset, index, enabled_techniques]() {
+				if (index == nullptr)
+				{
+					return parse_effect(path, *pp, preset.get());
+				}
+
+				const auto is_any_technique_enabled = [&enabled_techniques](const indexed_effect &effect) {
+					return std::any_of(effect.techniques.begin(), effect.techniques.end(), [&enabled_techniques](const indexed_technique &technique) {
+						const auto enabled = technique.annotations.find("enabled");
+						return (enabled != technique.annotations.end() && enabled->second.as<bool>()) ||
+							std::find(enabled_techniques->begin(), enabled_techniques->end(), technique.name) != enabled_techniques->end();
+					});
+				};
+
+				// An up-to-date index entry is enough to list the techniques of an effect, so it does not even have to be parsed
+				if (!index->techniques.empty() && !is_any_technique_enabled(*index) && is_up_to_date(index->dependencies))
+				{
+					parsed_effect effect;
+					effect.path = path;
+					effect.dependencies = index->dependencies;
+					effect.deferred = index;
+
+					return effect;
+				}
+
+				parsed_effect effect = parse_effect(path, *pp, preset.get());
+
+				if (effect.ast != nullptr)
+				{
+					const auto new_index = std::make_shared<indexed_effect>();
+					new_index->dependencies = effect.dependencies;
+
+					for (const auto technique : effect.ast->techniques)
+					{
+						new_index->techniques.push_back({ technique->name, technique->annotation_list });
+					}
+
+					if (!new_index->techniques.empty() && !is_any_technique_enabled(*new_index))
+					{
+						effect.ast.reset();
+						effect.deferred = std::move(new_index);
+					}
+				}
+
+				return effect;
+			}));
+		}
+	}
+	runtime::parsed_effect runtime::parse_effect(const filesystem::path &path, reshadefx::preprocessor &pp, const ini_file *preset)
+	{
+		parsed_effect effect;
+		effect.path = path;
+		effect.dependencies.push_back({ path, hash_source_file(path) });
+
+		if (!pp.begin_stream(path))
+		{
+			effect.errors = pp.errors();
+			return effect;
+		}
+
+		const auto ast = std::make_shared<reshadefx::syntax_tree>();
+		reshadefx::parser parser(*ast);
+
+		// The parser pulls tokens straight from the pre-processor, so pre-processor errors are only known after it is done
+		const bool parse_success = parser.run(pp);
+
+		std::vector<filesystem::path> included_files;
+		const bool preprocess_success = pp.end_stream(included_files);
+
+		for (const auto &include_path : included_files)
+		{
+			effect.dependencies.push_back({ include_path, hash_source_file(include_path) });
+		}
+
+		// Keep a stable order, so that dependency lists of different runs can be compared directly
+		std::sort(effect.dependencies.begin(), effect.dependencies.end(),
+			[](const auto &lhs, const auto &rhs) { return lhs.path.string() < rhs.path.string(); });
+
+		if (!preprocess_success)
+		{
+			effect.errors = pp.errors();
+			return effect;
+		}
+
+		effect.errors = parser.errors();
+
+		if (!parse_success)
+		{
+			return effect;
+		}
+
+		if (preset != nullptr)
+		{
+			for (auto variable : ast->variables)
+			{
+				if (!variable->type.has_qualifier(reshadefx::nodes::type_node::qualifier_uniform) ||
+					variable->initializer_expression == nullptr ||
+					variable->initializer_expression->id != reshadefx::nodeid::literal_expression ||
+					variable->annotation_list.count("source"))
+				{
+					continue;
+				}
+
+				const auto initializer = static_cast<reshadefx::nodes::literal_expression_node *>(variable->initializer_expression);
+
+				switch (initializer->type.basetype)
+				{
+					case reshadefx::nodes::type_node::datatype_int:
+						preset->get(path.filename().string(), variable->name, initializer->value_int(), initializer->type.rows * initializer->type.cols);
+						break;
+					case reshadefx::nodes::type_node::datatype_bool:
+					case reshadefx::nodes::type_node::datatype_uint:
+						preset->get(path.filename().string(), variable->name, initializer->value_uint(), initializer->type.rows * initializer->type.cols);
+						break;
+					case reshadefx::nodes::type_node::datatype_float:
+						preset->get(path.filename().string(), variable->name, initializer->value_float(), initializer->type.rows * initializer->type.cols);
+						break;
+				}
+
+				variable->type.qualifiers ^= reshadefx::nodes::type_node::qualifier_uniform;
+				variable->type.qualifiers |= reshadefx::nodes::type_node::qualifier_static | reshadefx::nodes::type_node::qualifier_const;
+			}
+		}
+
+		// Run after the preset values were baked in above, so that branches on those constants are removed too
+		reshadefx::optimizer(*ast).run();
+
+		effect.ast = ast;
+
+		return effect;
+	}
+	void runtime::load_effect(const parsed_effect &effect)
+	{
+		const filesystem::path &path = effect.path;
+
+		LOG(INFO) << "Compiling " << path << " ...";
+
+		// Record the inputs even if this version fails, so that fixing any of them triggers another attempt
+		_effect_dependencies.update(path, std::vector<dependency_graph::input>(effect.dependencies));
+
+		std::string errors = effect.errors;
+		const size_t uniform_storage_offset = _uniform_data_storage.size();
+
+		if (effect.deferred != nullptr)
+		{
+			LOG(INFO) << "> Deferred until one of its techniques is enabled.";
+
+			// Add the techniques without any passes, so that they can be listed and enabled like any other
+			for (const auto &indexed : effect.deferred->techniques)
+			{
+				technique obj;
+				obj.name = indexed.name;
+				obj.annotations = indexed.annotations;
+
+				add_technique(std::move(obj));
+			}
+
+			_deferred_effects[path.filename().string()] = path;
+			_last_compiled_effects.erase(path.string());
+
+			if (auto &index = _effect_index[path.string()]; index != effect.deferred)
+			{
+				index = effect.deferred;
+				_effect_index_modified = true;
+			}
+		}
+		else if (effect.ast == nullptr || !load_effect(*effect.ast, errors))
+		{
+			LOG(ERROR) << "Failed to compile " << path << ":\n" << errors;
+			_errors += path.string() + ":\n" + errors;
+			_textures.erase(_textures.begin() + _texture_count, _textures.end());
+			_uniforms.erase(_uniforms.begin() + _uniform_count, _uniforms.end());
+			_techniques.erase(_techniques.begin() + _technique_count, _techniques.end());
+
+			// Fall back to the last version of this effect that compiled, so that a mistake while editing a shader does not make it disappear
+			const auto previous = _last_compiled_effects.find(path.string());
+
+			if (!_is_reloading_in_background || previous == _last_compiled_effects.end())
+			{
+				return;
+			}
+
+			errors.clear();
+
+			if (!load_effect(*previous->second.ast, errors))
+			{
+				_textures.erase(_textures.begin() + _texture_count, _textures.end());
+				_uniforms.erase(_uniforms.begin() + _uniform_count, _uniforms.end());
+				_techniques.erase(_techniques.begin() + _technique_count, _techniques.end());
+				return;
+			}
+
+			LOG(WARNING) << "> Keeping previous version of " << path << ".";
+		}
+		else
+		{
+			// Keep the syntax tree around, so it can be compiled again in case a later version of this effect fails
+			_last_compiled_effects[path.string()] = effect;
+
+			if (_compile_on_demand)
+			{
+				auto &index = _effect_index[path.string()];
+
+				if (index == nullptr || !is_same_version(index->dependencies, effect.dependencies))
+				{
+					const auto new_index = std::make_shared<indexed_effect>();
+					new_index->dependencies = effect.dependencies;
+
+					for (size_t i = _technique_count; i < _techniques.size(); i++)
+					{
+						new_index->techniques.push_back({ _techniques[i].name, _techniques[i].annotations });
+					}
+
+					index = std::move(new_index);
+					_effect_index_modified = true;
+				}
+			}
+
+			if (errors.empty())
+			{
+				LOG(INFO) << "> Successfully compiled.";
+			}
+			else
+			{
+				LOG(WARNING) << "> Successfully compiled with warnings:\n" << errors;
+				_errors += path.string() + ":\n" + errors;
+			}
+		}
+
+		// Upload the constants of the new effect with its first technique, regardless of what the implementation initialized its buffers with
+		if (_uniform_data_storage.size() > uniform_storage_offset)
+		{
+			mark_uniform_storage_modified(uniform_storage_offset, _uniform_data_storage.size() - uniform_storage_offset);
+		}
+
+		for (size_t i = _uniform_count, max = _uniform_count = _uniforms.size(); i < max; i++)
+		{
+			auto &variable = _uniforms[i];
+			variable.effect_filename = path.filename().string();
+			variable.hidden = variable.annotations["hidden"].as<bool>();
+
+			add_uniform_binding(variable);
+		}
+		for (size_t i = _texture_count, max = _texture_count = _textures.size(); i < max; i++)
+		{
+			auto &texture = _textures[i];
+			texture.effect_filename = path.filename().string();
+		}
+		for (size_t i = _technique_count, max = _technique_count = _techniques.size(); i < max; i++)
+		{
+			auto &technique = _techniques[i];
+			technique.effect_filename = path.filename().string();
+			technique.enabled = technique.annotations["enabled"].as<bool>();
+			technique.hidden = technique.annotations["hidden"].as<bool>();
+			technique.timeleft = technique.timeout = technique.annotations["timeout"].as<int>();
+			technique.toggle_key_data[0] = technique.annotations["toggle"].as<unsigned int>();
+			technique.toggle_key_data[1] = technique.annotations["togglectrl"].as<bool>() ? 1 : 0;
+			technique.toggle_key_data[2] = technique.annotations["toggleshift"].as<bool>() ? 1 : 0;
+			technique.toggle_key_data[3] = technique.annotations["togglealt"].as<bool>() ? 1 : 0;
+
+			schedule_in_declaration_order(technique);
+		}
+	}
+	void runtime::cancel_background_reload()
+	{
+		if (!_is_reloading_in_background)
+		{
+			return;
+		}
+
+		_is_reloading_in_background = false;
+		_reload_remaining_effects = 0;
+		_parsed_effects.clear();
+
+		// Throw away what was loaded so far, the current effects were not touched
+		swap_effects();
+		on_reset_effect();
+		swap_effects();
 	}
-	void runtime::load_effect(const filesystem::path &path)
+	void runtime::add_uniform_binding(uniform &variable)
 	{
-		LOG(INFO) << "Compiling " << path << " ...";
+		const auto source_annotation = variable.annotations.find("source");
 
-		reshadefx::preprocessor pp;
-		pp.add_include_path(path.parent_path());
-
-		for (const auto &include_path : _effect_search_paths)
+		if (source_annotation == variable.annotations.end())
 		{
-			if (include_path.empty())
-			{
-				continue;
-			}
-
-			pp.add_include_path(include_path);
+			return;
 		}
 
-		pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-		pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0");
-		pp.add_macro_definition("__VENDOR__", std::to_string(_vendor_id));
-		pp.add_macro_definition("__DEVICE__", std::to_string(_device_id));
-		pp.add_macro_definition("__RENDERER__", std::to_string(_renderer_id));
-		pp.add_macro_definition("__APPLICATION__", std::to_string(std::hash<std::string>()(s_target_executable_path.filename_without_extension().string())));
-		pp.add_macro_definition("BUFFER_WIDTH", std::to_string(_width));
-		pp.add_macro_definition("BUFFER_HEIGHT", std::to_string(_height));
-		pp.add_macro_definition("BUFFER_RCP_WIDTH", std::to_string(1.0f / static_cast<float>(_width)));
-		pp.add_macro_definition("BUFFER_RCP_HEIGHT", std::to_string(1.0f / static_cast<float>(_height)));
+		const std::string source = source_annotation->second.as<std::string>();
 
-		for (const auto &definition : _preprocessor_definitions)
+		uniform_binding binding = { };
+		binding.basetype = variable.basetype;
+		binding.storage_offset = variable.storage_offset;
+		binding.storage_size = variable.storage_size;
+
+		if (source == "frametime")
+		{
+			binding.type = uniform_binding::source_type::frametime;
+		}
+		else if (source == "framecount")
+		{
+			binding.type = uniform_binding::source_type::framecount;
+		}
+		else if (source == "pingpong")
+		{
+			binding.type = uniform_binding::source_type::pingpong;
+			binding.min = variable.annotations["min"].as<float>();
+			binding.max = variable.annotations["max"].as<float>();
+			binding.step_min = variable.annotations["step"].as<float>(0);
+			binding.step_max = variable.annotations["step"].as<float>(1);
+			binding.smoothing = variable.annotations["smoothing"].as<float>();
+		}
+		else if (source == "date")
+		{
+			binding.type = uniform_binding::source_type::date;
+		}
+		else if (source == "timer")
+		{
+			binding.type = uniform_binding::source_type::timer;
+		}
+		else if (source == "key")
 		{
-			if (definition.empty())
+			const int key = variable.annotations["keycode"].as<int>();
+
+			if (key <= 7 || key >= 256)
 			{
-				continue;
+				return;
 			}
 
-			const size_t equals_index = definition.find_first_of('=');
+			const std::string mode = variable.annotations["mode"].as<std::string>();
 
-			if (equals_index != std::string::npos)
+			if (mode == "toggle" || variable.annotations["toggle"].as<bool>())
+			{
+				binding.type = uniform_binding::source_type::key_toggle;
+			}
+			else if (mode == "press")
 			{
-				pp.add_macro_definition(definition.substr(0, equals_index), definition.substr(equals_index + 1));
+				binding.type = uniform_binding::source_type::key_press;
 			}
 			else
 			{
-				pp.add_macro_definition(definition);
+				binding.type = uniform_binding::source_type::key_down;
 			}
-		}
 
-		if (!pp.run(path))
+			binding.keycode = key;
+		}
+		else if (source == "mousepoint")
 		{
-			LOG(ERROR) << "Failed to preprocess " << path << ":\n" << pp.errors();
-			_errors += path.string() + ":\n" + pp.errors();
-			return;
+			binding.type = uniform_binding::source_type::mousepoint;
 		}
+		else if (source == "mousedelta")
+		{
+			binding.type = uniform_binding::source_type::mousedelta;
+		}
+		else if (source == "mousebutton")
+		{
+			const int index = variable.annotations["keycode"].as<int>();
 
-		reshadefx::syntax_tree ast;
-		reshadefx::parser parser(ast);
+			if (index < 0 || index >= 5)
+			{
+				return;
+			}
 
-		if (!parser.run(pp.current_output()))
+			binding.type = variable.annotations["toggle"].as<bool>() ? uniform_binding::source_type::mousebutton_toggle : uniform_binding::source_type::mousebutton_down;
+			binding.keycode = index;
+		}
+		else if (source == "random")
+		{
+			binding.type = uniform_binding::source_type::random;
+			binding.random_min = variable.annotations["min"].as<int>();
+			binding.random_max = variable.annotations["max"].as<int>();
+		}
+		else
 		{
-			LOG(ERROR) << "Failed to compile " << path << ":\n" << parser.errors();
-			_errors += path.string() + ":\n" + parser.errors();
 			return;
 		}
 
-		if (_performance_mode && _current_preset >= 0)
+		_uniform_bindings.push_back(binding);
+	}
+	void runtime::update_uniform_bindings()
+	{
+		// Compute values shared by all variables bound to the same source only once
+		const float frametime = _last_frame_duration.count() * 1e-6f;
+		const bool framecount_even = (_framecount % 2) == 0;
+		const unsigned int framecount_int = static_cast<unsigned int>(_framecount % UINT_MAX);
+		const float framecount_float = static_cast<float>(_framecount % 16777216);
+		const unsigned long long timer = std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count();
+		const bool timer_even = (timer % 2) == 0;
+		const unsigned int timer_int = static_cast<unsigned int>(timer % UINT_MAX);
+		const float timer_float = std::fmod(static_cast<float>(timer * 1e-6f), 16777216.0f);
+		const float mouse_point[2] = { static_cast<float>(_input->mouse_position_x()), static_cast<float>(_input->mouse_position_y()) };
+		const float mouse_delta[2] = { static_cast<float>(_input->mouse_movement_delta_x()), static_cast<float>(_input->mouse_movement_delta_y()) };
+
+		for (const auto &binding : _uniform_bindings)
 		{
-			ini_file preset(_preset_files[_current_preset]);
+			assert(binding.storage_offset + binding.storage_size <= _uniform_data_storage.size());
+
+			unsigned char *const data = _uniform_data_storage.data() + binding.storage_offset;
 
-			for (auto variable : ast.variables)
+			// Keep the previous value to compare against, so that variables which did not change (like most key and mouse button states) do not cause their constant buffer to be uploaded again
+			unsigned char previous_value[64];
+			const size_t compare_size = std::min(binding.storage_size, sizeof(previous_value));
+			std::memcpy(previous_value, data, compare_size);
+
+			switch (binding.type)
 			{
-				if (!variable->type.has_qualifier(reshadefx::nodes::type_node::qualifier_uniform) ||
-					variable->initializer_expression == nullptr ||
-					variable->initializer_expression->id != reshadefx::nodeid::literal_expression ||
-					variable->annotation_list.count("source"))
+				case uniform_binding::source_type::frametime:
 				{
-					continue;
+					store_uniform_value(data, binding.storage_size, binding.basetype, &frametime, 1);
+					break;
+				}
+				case uniform_binding::source_type::framecount:
+				{
+					if (binding.basetype == uniform_datatype::boolean)
+						store_uniform_value(data, binding.storage_size, binding.basetype, &framecount_even, 1);
+					else if (binding.basetype == uniform_datatype::floating_point)
+						store_uniform_value(data, binding.storage_size, binding.basetype, &framecount_float, 1);
+					else
+						store_uniform_value(data, binding.storage_size, binding.basetype, &framecount_int, 1);
+					break;
 				}
+				case uniform_binding::source_type::pingpong:
+				{
+					float value[2] = { 0, 0 };
+					load_uniform_value(data, binding.storage_size, binding.basetype, value, 2);
 
-				const auto initializer = static_cast<reshadefx::nodes::literal_expression_node *>(variable->initializer_expression);
+					float increment = binding.step_max == 0 ? binding.step_min : (binding.step_min + std::fmodf(static_cast<float>(std::rand()), binding.step_max - binding.step_min + 1));
 
-				switch (initializer->type.basetype)
+					if (value[1] >= 0)
+					{
+						increment = std::max(increment - std::max(0.0f, binding.smoothing - (binding.max - value[0])), 0.05f);
+						increment *= _last_frame_duration.count() * 1e-9f;
+
+						if ((value[0] += increment) >= binding.max)
+						{
+							value[0] = binding.max;
+							value[1] = -1;
+						}
+					}
+					else
+					{
+						increment = std::max(increment - std::max(0.0f, binding.smoothing - (value[0] - binding.min)), 0.05f);
+						increment *= _last_frame_duration.count() * 1e-9f;
+
+						if ((value[0] -= increment) <= binding.min)
+						{
+							value[0] = binding.min;
+							value[1] = +1;
+						}
+					}
+
+					store_uniform_value(data, binding.storage_size, binding.basetype, value, 2);
+					break;
+				}
+				case uniform_binding::source_type::date:
 				{
-					case reshadefx::nodes::type_node::datatype_int:
-						preset.get(path.filename().string(), variable->name, initializer->value_int);
-						break;
-					case reshadefx::nodes::type_node::datatype_bool:
-					case reshadefx::nodes::type_node::datatype_uint:
-						preset.get(path.filename().string(), variable->name, initializer->value_uint);
-						break;
-					case reshadefx::nodes::type_node::datatype_float:
-						preset.get(path.filename().string(), variable->name, initializer->value_float);
-						break;
+					store_uniform_value(data, binding.storage_size, binding.basetype, _date, 4);
+					break;
+				}
+				case uniform_binding::source_type::timer:
+				{
+					if (binding.basetype == uniform_datatype::boolean)
+						store_uniform_value(data, binding.storage_size, binding.basetype, &timer_even, 1);
+					else if (binding.basetype == uniform_datatype::floating_point)
+						store_uniform_value(data, binding.storage_size, binding.basetype, &timer_float, 1);
+					else
+						store_uniform_value(data, binding.storage_size, binding.basetype, &timer_int, 1);
+					break;
+				}
+				case uniform_binding::source_type::key_down:
+				{
+					const bool state = _input->is_key_down(binding.keycode);
+					store_uniform_value(data, binding.storage_size, binding.basetype, &state, 1);
+					break;
+				}
+				case uniform_binding::source_type::key_press:
+				{
+					const bool state = _input->is_key_pressed(binding.keycode);
+					store_uniform_value(data, binding.storage_size, binding.basetype, &state, 1);
+					break;
+				}
+				case uniform_binding::source_type::key_toggle:
+				{
+					if (_input->is_key_pressed(binding.keycode))
+					{
+						const bool current = *reinterpret_cast<const unsigned int *>(data) == 0;
+						store_uniform_value(data, binding.storage_size, binding.basetype, &current, 1);
+					}
+					break;
+				}
+				case uniform_binding::source_type::mousepoint:
+				{
+					store_uniform_value(data, binding.storage_size, binding.basetype, mouse_point, 2);
+					break;
 				}
+				case uniform_binding::source_type::mousedelta:
+				{
+					store_uniform_value(data, binding.storage_size, binding.basetype, mouse_delta, 2);
+					break;
+				}
+				case uniform_binding::source_type::mousebutton_down:
+				{
+					const bool state = _input->is_mouse_button_down(binding.keycode);
+					store_uniform_value(data, binding.storage_size, binding.basetype, &state, 1);
+					break;
+				}
+				case uniform_binding::source_type::mousebutton_toggle:
+				{
+					if (_input->is_mouse_button_pressed(binding.keycode))
+					{
+						const bool current = *reinterpret_cast<const unsigned int *>(data) == 0;
+						store_uniform_value(data, binding.storage_size, binding.basetype, &current, 1);
+					}
+					break;
+				}
+				case uniform_binding::source_type::random:
+				{
+					const int value = binding.random_min + (std::rand() % (binding.random_max - binding.random_min + 1));
+					store_uniform_value(data, binding.storage_size, binding.basetype, &value, 1);
+					break;
+				}
+			}
 
-				variable->type.qualifiers ^= reshadefx::nodes::type_node::qualifier_uniform;
-				variable->type.qualifiers |= reshadefx::nodes::type_node::qualifier_static | reshadefx::nodes::type_node::qualifier_const;
+			if (binding.storage_size > compare_size || std::memcmp(previous_value, data, compare_size) != 0)
+			{
+				mark_uniform_storage_modified(binding.storage_offset, binding.storage_size);
 			}
 		}
+	}
+	void runtime::update_pass_graph(const std::vector<size_t> &technique_indices)
+	{
+		_pass_graph.clear();
+		_pass_graph_techniques = technique_indices;
 
-		std::string errors = parser.errors();
+		// The retained syntax trees belong to the effects being loaded while a reload is in progress, so they may not match the techniques rendered right now
+		bool is_graph_complete = _reload_remaining_effects == 0;
 
-		if (!load_effect(ast, errors))
-		{
-			LOG(ERROR) << "Failed to compile " << path << ":\n" << errors;
-			_errors += path.string() + ":\n" + errors;
-			_textures.erase(_textures.begin() + _texture_count, _textures.end());
-			_uniforms.erase(_uniforms.begin() + _uniform_count, _uniforms.end());
-			_techniques.erase(_techniques.begin() + _technique_count, _techniques.end());
-			return;
-		}
-		else if (errors.empty())
-		{
-			LOG(INFO) << "> Successfully compiled.";
-		}
-		else
+		std::unordered_map<std::string, const reshadefx::syntax_tree *> effect_trees;
+
+		for (const auto &effect : _last_compiled_effects)
 		{
-			LOG(WARNING) << "> Successfully compiled with warnings:\n" << errors;
-			_errors += path.string() + ":\n" + errors;
+			effect_trees[effect.second.path.filename().string()] = effect.second.ast.get();
 		}
 
-		for (size_t i = _uniform_count, max = _uniform_count = _uniforms.size(); i < max; i++)
+		for (size_t i = 0; i < technique_indices.size() && is_graph_complete; i++)
 		{
-			auto &variable = _uniforms[i];
-			variable.effect_filename = path.filename().string();
-			variable.hidden = variable.annotations["hidden"].as<bool>();
+			const auto &technique = _techniques[technique_indices[i]];
+			const auto tree = effect_trees.find(technique.effect_filename);
+
+			if (tree == effect_trees.end() || tree->second == nullptr)
+			{
+				is_graph_complete = false;
+				break;
+			}
+
+			const auto node = std::find_if(tree->second->techniques.begin(), tree->second->techniques.end(),
+				[&technique](const reshadefx::nodes::technique_declaration_node *node) { return node->name == technique.name; });
+
+			if (node == tree->second->techniques.end() || (*node)->pass_list.size() != technique.passes.size())
+			{
+				is_graph_complete = false;
+				break;
+			}
+
+			_pass_graph.add_technique(technique_indices[i], *node);
 		}
-		for (size_t i = _texture_count, max = _texture_count = _textures.size(); i < max; i++)
+
+		if (is_graph_complete)
 		{
-			auto &texture = _textures[i];
-			texture.effect_filename = path.filename().string();
+			_pass_graph.build();
+			_pass_graph.apply(_techniques);
 		}
-		for (size_t i = _technique_count, max = _technique_count = _techniques.size(); i < max; i++)
+		else
 		{
-			auto &technique = _techniques[i];
-			technique.effect_filename = path.filename().string();
-			technique.enabled = technique.annotations["enabled"].as<bool>();
-			technique.hidden = technique.annotations["hidden"].as<bool>();
-			technique.timeleft = technique.timeout = technique.annotations["timeout"].as<int>();
-			technique.toggle_key_data[0] = technique.annotations["toggle"].as<unsigned int>();
-			technique.toggle_key_data[1] = technique.annotations["togglectrl"].as<bool>() ? 1 : 0;
-			technique.toggle_key_data[2] = technique.annotations["toggleshift"].as<bool>() ? 1 : 0;
-			technique.toggle_key_data[3] = technique.annotations["togglealt"].as<bool>() ? 1 : 0;
+			// Render every pass in declaration order until the graph can be built, since a schedule built along with other techniques may have culled passes these need
+			_pass_graph.clear();
+
+			for (const size_t technique_index : technique_indices)
+			{
+				schedule_in_declaration_order(_techniques[technique_index]);
+			}
 		}
+
+		// Try again once the reload finished, there is no point in doing so every frame otherwise
+		_is_pass_graph_outdated = _reload_remaining_effects != 0;
 	}
+
 	void runtime::load_textures()
 	{
 		LOG(INFO) << "Loading image files for textures ...";
@@ -712,6 +1357,119 @@ namespace reshade
 		}
 	}
 
+	void runtime::load_effect_index()
+	{
+		const ini_file index(s_reshade_dll_path.parent_path() / "ReShade-EffectIndex.ini");
+
+		for (const auto &effect_path : _effect_files)
+		{
+			const std::string &section = effect_path.string();
+
+			std::vector<filesystem::path> dependencies;
+			index.get(section, "Dependencies", dependencies);
+			std::vector<std::string> dependency_hashes;
+			index.get(section, "DependencyHashes", dependency_hashes);
+			std::vector<std::string> technique_names;
+			index.get(section, "Techniques", technique_names);
+
+			if (dependencies.empty() || dependencies.size() != dependency_hashes.size())
+			{
+				continue;
+			}
+
+			const auto effect = std::make_shared<indexed_effect>();
+
+			for (size_t i = 0; i < dependencies.size(); i++)
+			{
+				effect->dependencies.push_back({ dependencies[i], std::strtoull(dependency_hashes[i].c_str(), nullptr, 16) });
+			}
+
+			for (const auto &name : technique_names)
+			{
+				indexed_technique technique;
+				technique.name = name;
+
+				std::vector<std::string> annotation_names;
+				index.get(section, "Technique." + name, annotation_names);
+
+				for (const auto &annotation_name : annotation_names)
+				{
+					std::vector<std::string> values;
+					index.get(section, "Technique." + name + '.' + annotation_name, values);
+
+					technique.annotations[annotation_name] = values;
+				}
+
+				effect->techniques.push_back(std::move(technique));
+			}
+
+			_effect_index[section] = effect;
+		}
+	}
+	void runtime::save_effect_index()
+	{
+		const filesystem::path index_path = s_reshade_dll_path.parent_path() / "ReShade-EffectIndex.ini";
+
+		// Start from an empty file, so that effects which were removed in the meantime do not stay in the index forever
+		std::ofstream(index_path.wstring(), std::ios::trunc).close();
+
+		ini_file index(index_path);
+
+		for (const auto &entry : _effect_index)
+		{
+			if (entry.second == nullptr || !filesystem::exists(entry.first))
+			{
+				continue;
+			}
+
+			const std::string &section = entry.first;
+
+			std::vector<filesystem::path> dependencies;
+			std::vector<std::string> dependency_hashes;
+
+			for (const auto &input : entry.second->dependencies)
+			{
+				char hash_string[17];
+				sprintf_s(hash_string, "%016llx", static_cast<unsigned long long>(input.hash));
+
+				dependencies.push_back(input.path);
+				dependency_hashes.push_back(hash_string);
+			}
+
+			index.set(section, "Dependencies", dependencies);
+			index.set(section, "DependencyHashes", dependency_hashes);
+
+			std::vector<std::string> technique_names;
+
+			for (const auto &technique : entry.second->techniques)
+			{
+				std::vector<std::string> annotation_names;
+
+				for (const auto &annotation : technique.annotations)
+				{
+					// The index is line based, so leave out anything that spans multiple lines (e.g. long descriptions), it is only a preview until the effect is compiled anyway
+					if (std::any_of(annotation.second.data().begin(), annotation.second.data().end(),
+						[](const std::string &value) { return value.find_first_of("\r\n") != std::string::npos; }))
+					{
+						continue;
+					}
+
+					annotation_names.push_back(annotation.first);
+
+					index.set(section, "Technique." + technique.name + '.' + annotation.first, annotation.second);
+				}
+
+				technique_names.push_back(technique.name);
+
+				index.set(section, "Technique." + technique.name, annotation_names);
+			}
+
+			index.set(section, "Techniques", technique_names);
+		}
+
+		_effect_index_modified = false;
+	}
+
 	void runtime::load_configuration()
 	{
 		const ini_file config(_configuration_path);
@@ -722,6 +1480,7 @@ namespace reshade
 		config.get("INPUT", "InputProcessing", _input_processing_mode);
 
 		config.get("GENERAL", "PerformanceMode", _performance_mode);
+		config.get("GENERAL", "CompileEffectsOnDemand", _compile_on_demand);
 		config.get("GENERAL", "EffectSearchPaths", _effect_search_paths);
 		config.get("GENERAL", "TextureSearchPaths", _texture_search_paths);
 		config.get("GENERAL", "PreprocessorDefinitions", _preprocessor_definitions);
@@ -734,6 +1493,7 @@ namespace reshade
 		config.get("GENERAL", "ShowFPS", _show_framerate);
 		config.get("GENERAL", "FontGlobalScale", _imgui_context->IO.FontGlobalScale);
 		config.get("GENERAL", "NoReloadOnInit", _no_reload_on_init);
+		config.get("GENERAL", "ShaderCacheSize", _shader_cache_size);
 
 		config.get("STYLE", "Alpha", _imgui_context->Style.Alpha);
 		config.get("STYLE", "ColBackground", _imgui_col_background);
@@ -742,6 +1502,9 @@ namespace reshade
 		config.get("STYLE", "ColText", _imgui_col_text);
 		config.get("STYLE", "ColFPSText", _imgui_col_text_fps);
 
+		// The cache size is configured in megabytes, a size of zero disables it
+		shader_cache::global().open(s_reshade_dll_path.parent_path() / "ReShade-ShaderCache", static_cast<uint64_t>(_shader_cache_size) * 1024 * 1024);
+
 		_imgui_context->Style.Colors[ImGuiCol_Text] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 1.00f);
 		_imgui_context->Style.Colors[ImGuiCol_TextDisabled] = ImVec4(_imgui_col_text[0], _imgui_col_text[1], _imgui_col_text[2], 0.58f);
 		_imgui_context->Style.Colors[ImGuiCol_WindowBg] = ImVec4(_imgui_col_background[0], _imgui_col_background[1], _imgui_col_background[2], 1.00f);
@@ -826,6 +1589,7 @@ namespace reshade
 		config.set("INPUT", "InputProcessing", _input_processing_mode);
 
 		config.set("GENERAL", "PerformanceMode", _performance_mode);
+		config.set("GENERAL", "CompileEffectsOnDemand", _compile_on_demand);
 		config.set("GENERAL", "EffectSearchPaths", _effect_search_paths);
 		config.set("GENERAL", "TextureSearchPaths", _texture_search_paths);
 		config.set("GENERAL", "PreprocessorDefinitions", _preprocessor_definitions);
@@ -838,6 +1602,7 @@ namespace reshade
 		config.set("GENERAL", "ShowFPS", _show_framerate);
 		config.set("GENERAL", "FontGlobalScale", _imgui_context->IO.FontGlobalScale);
 		config.set("GENERAL", "NoReloadOnInit", _no_reload_on_init);
+		config.set("GENERAL", "ShaderCacheSize", _shader_cache_size);
 
 		config.set("STYLE", "Alpha", _imgui_context->Style.Alpha);
 		config.set("STYLE", "ColBackground", _imgui_col_background);
@@ -894,6 +1659,9 @@ namespace reshade
 					(std::find(technique_sorting_list.begin(), technique_sorting_list.end(), rhs.name) - technique_sorting_list.begin());
 			});
 
+		// The pass graph refers to techniques by index
+		_is_pass_graph_outdated = true;
+
 		for (auto &technique : _techniques)
 		{
 			// Ignore preset if "enabled" annotation is set
@@ -1137,7 +1905,13 @@ namespace reshade
 
 			ImGui::Spacing();
 
-			if (_reload_remaining_effects != 0)
+			if (_is_reloading_in_background)
+			{
+				ImGui::Text(
+					"Reloading in the background (%u effects remaining) ...",
+					static_cast<unsigned int>(_reload_remaining_effects));
+			}
+			else if (_reload_remaining_effects != 0)
 			{
 				ImGui::Text(
 					"Loading (%u effects remaining) ... "
@@ -1168,7 +1942,7 @@ namespace reshade
 			ImGui::End();
 		}
 
-		if (_reload_remaining_effects == 0)
+		if (_reload_remaining_effects == 0 || _is_reloading_in_background)
 		{
 			if (!show_splash)
 			{
@@ -1531,7 +2305,7 @@ namespace reshade
 
 			if (ImGui::Button("Reload", ImVec2(ImGui::GetWindowContentRegionWidth() * 0.5f - 5, 0)))
 			{
-				reload();
+				reload(true);
 			}
 
 			ImGui::SameLine();
@@ -1653,6 +2427,17 @@ namespace reshade
 				reload();
 			}
 
+			if (ImGui::Checkbox("Compile Effects On Demand", &_compile_on_demand))
+			{
+				save_configuration();
+				reload();
+			}
+
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::SetTooltip("Only compile effects once one of their techniques is enabled, instead of all of them on startup.\nThis has no effect in performance mode, which only loads the effects used by the current preset anyway.");
+			}
+
 			if (ImGui::Combo("Input Processing", &_input_processing_mode, "Pass on all input\0Block input when cursor is on overlay\0Block all input when overlay is visible\0"))
 			{
 				save_configuration();
@@ -1792,6 +2577,8 @@ namespace reshade
 			ImGui::Text("Frame %llu:", _framecount + 1);
 			ImGui::TextUnformatted("Timer:");
 			ImGui::TextUnformatted("Network:");
+			ImGui::TextUnformatted("Include Cache:");
+			ImGui::TextUnformatted("Shader Cache:");
 			ImGui::EndGroup();
 
 			ImGui::SameLine(ImGui::GetWindowWidth() * 0.333f);
@@ -1806,6 +2593,8 @@ namespace reshade
 			ImGui::Text("%f ms", _last_frame_duration.count() * 1e-6f);
 			ImGui::Text("%f ms", std::fmod(std::chrono::duration_cast<std::chrono::nanoseconds>(_last_present_time - _start_time).count() * 1e-6f, 16777216.0f));
 			ImGui::Text("%u B", g_network_traffic);
+			ImGui::Text("%u hits, %u misses", static_cast<unsigned int>(reshadefx::include_cache::global().hits()), static_cast<unsigned int>(reshadefx::include_cache::global().misses()));
+			ImGui::Text("%u hits, %u misses", static_cast<unsigned int>(shader_cache::global().hits()), static_cast<unsigned int>(shader_cache::global().misses()));
 			ImGui::EndGroup();
 
 			ImGui::SameLine(ImGui::GetWindowWidth() * 0.666f);
@@ -1919,6 +2708,37 @@ namespace reshade
 
 			ImGui::EndGroup();
 		}
+
+		if (ImGui::CollapsingHeader("Passes"))
+		{
+			const auto &nodes = _pass_graph.nodes();
+
+			if (nodes.empty())
+			{
+				ImGui::TextDisabled("All passes are rendered in the order they were declared in.");
+			}
+			else
+			{
+				for (const size_t index : _pass_graph.schedule())
+				{
+					ImGui::Text(nodes[index].shares_state_with_previous ? "%s (shares state with previous)" : "%s", nodes[index].name.c_str());
+				}
+
+				for (const auto &node : nodes)
+				{
+					if (node.culled)
+					{
+						ImGui::TextDisabled("%s (culled)", node.name.c_str());
+					}
+				}
+
+				// The clipboard is not hooked up to the overlay, so write the graph to a file instead
+				if (ImGui::Button("Save graph", ImVec2(-1, 0)))
+				{
+					std::ofstream((s_reshade_dll_path.parent_path() / "ReShade-PassGraph.dot").wstring(), std::ios::trunc) << _pass_graph.to_dot();
+				}
+			}
+		}
 	}
 	void runtime::draw_overlay_menu_about()
 	{
@@ -2259,6 +3079,7 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 			{
 				std::swap(_techniques[hovered_technique_index], _techniques[_selected_technique]);
 				_selected_technique = hovered_technique_index;
+				_is_pass_graph_outdated = true;
 
 				save_current_preset();
 			}
@@ -6,7 +6,12 @@
 #pragma once
 
 #include <chrono>
+#include <unordered_map>
+#include <unordered_set>
 #include "filesystem.hpp"
+#include "pass_graph.hpp"
+#include "thread_pool.hpp"
+#include "dependency_graph.hpp"
 #include "runtime_objects.hpp"
 
 #pragma region Forward Declarations
@@ -17,10 +22,17 @@ struct ImGuiContext;
 namespace reshade
 {
 	class input;
+	class ini_file;
+
+	namespace filesystem
+	{
+		class directory_watcher;
+	}
 }
 namespace reshadefx
 {
 	class syntax_tree;
+	class preprocessor;
 }
 
 extern volatile long g_network_traffic;
@@ -68,7 +80,7 @@ namespace reshade
 		/// <summary>
 		/// Returns a boolean indicating whether any effects were loaded.
 		/// </summary>
-		bool is_effect_loaded() const { return _technique_count > 0 && _reload_remaining_effects == 0; }
+		bool is_effect_loaded() const { return _technique_count > 0 && (_reload_remaining_effects == 0 || _is_reloading_in_background); }
 
 		/// <summary>
 		/// Add a new texture.
@@ -91,6 +103,11 @@ namespace reshade
 		/// <param name="unique_name">The name of the texture.</param>
 		texture *find_texture(const std::string &unique_name);
 
+		/// <summary>
+		/// Returns the worker threads effects are compiled on.
+		/// </summary>
+		thread_pool &worker_pool() { return _worker_pool; }
+
 		/// <summary>
 		/// Return a reference to the internal uniform storage buffer.
 		/// </summary>
@@ -133,6 +150,11 @@ namespace reshade
 		/// </summary>
 		virtual void on_reset_effect();
 		/// <summary>
+		/// Exchange all effect objects with the inactive set, which is where effects reloaded in the background are created until they replace the current ones.
+		/// Implementations have to swap all state they keep per set of effects and call the base implementation.
+		/// </summary>
+		virtual void swap_effects();
+		/// <summary>
 		/// Callback function called every frame.
 		/// </summary>
 		void on_present();
@@ -141,11 +163,6 @@ namespace reshade
 		/// </summary>
 		void on_present_effect();
 
-		/// <summary>
-		/// Compile effect from the specified source file and initialize textures, constants and techniques.
-		/// </summary>
-		/// <param name="path">The path to an effect source code file.</param>
-		void load_effect(const filesystem::path &path);
 		/// <summary>
 		/// Compile effect from the specified abstract syntax tree and initialize textures, constants and techniques.
 		/// </summary>
@@ -165,6 +182,21 @@ namespace reshade
 		/// <param name="data">The 32bpp RGBA image data to update the texture to.</param>
 		virtual bool update_texture(texture &texture, const uint8_t *data) = 0;
 
+		/// <summary>
+		/// Mark a range in the uniform storage as modified, so that it is uploaded again on the next use.
+		/// </summary>
+		/// <param name="offset">The offset of the range in bytes.</param>
+		/// <param name="size">The size of the range in bytes.</param>
+		void mark_uniform_storage_modified(size_t offset, size_t size);
+		/// <summary>
+		/// Find the part of a range in the uniform storage that was modified since it was last retrieved with this function, and mark it as up to date again.
+		/// Implementations call this before uploading a constant buffer, so that buffers whose values did not change since the last frame are not uploaded again.
+		/// </summary>
+		/// <param name="offset">The offset of the range in bytes. Receives the offset of the first modified byte.</param>
+		/// <param name="size">The size of the range in bytes. Receives the size of the part spanning all modified bytes.</param>
+		/// <returns>A boolean value indicating whether anything in the range was modified.</returns>
+		bool consume_modified_uniform_range(size_t &offset, size_t &size);
+
 		/// <summary>
 		/// Render all passes in a technique.
 		/// </summary>
@@ -189,7 +221,102 @@ namespace reshade
 		std::vector<technique> _techniques;
 
 	private:
-		void reload();
+		struct indexed_technique
+		{
+			std::string name;
+			std::unordered_map<std::string, variant> annotations;
+		};
+		/// <summary>
+		/// The techniques declared in an effect file, as recorded in the effect index. This is all that is needed to list the techniques of an effect that was not compiled yet.
+		/// </summary>
+		struct indexed_effect
+		{
+			std::vector<dependency_graph::input> dependencies;
+			std::vector<indexed_technique> techniques;
+		};
+		/// <summary>
+		/// A uniform variable whose value the runtime updates every frame (as requested through its "source" annotation), with all annotations the update depends on parsed in advance.
+		/// </summary>
+		struct uniform_binding
+		{
+			enum class source_type
+			{
+				frametime,
+				framecount,
+				pingpong,
+				date,
+				timer,
+				key_down,
+				key_press,
+				key_toggle,
+				mousepoint,
+				mousedelta,
+				mousebutton_down,
+				mousebutton_toggle,
+				random,
+			};
+
+			source_type type;
+			uniform_datatype basetype;
+			size_t storage_offset, storage_size;
+			unsigned int keycode; // Virtual key code or mouse button index
+			float min, max, step_min, step_max, smoothing; // Range of "pingpong" values
+			int random_min, random_max;
+		};
+		/// <summary>
+		/// An effect that was pre-processed and parsed on a worker thread and is waiting for the render thread to compile it.
+		/// </summary>
+		struct parsed_effect
+		{
+			filesystem::path path;
+			std::shared_ptr<reshadefx::syntax_tree> ast; // Empty if pre-processing or parsing failed
+			std::string errors;
+			std::vector<dependency_graph::input> dependencies;
+			std::shared_ptr<const indexed_effect> deferred; // Set instead of the syntax tree if compilation is deferred until one of the techniques is enabled
+		};
+
+		/// <summary>
+		/// Pre-process and parse the specified effect file. This does not access the runtime, so it is safe to call from any thread.
+		/// </summary>
+		/// <param name="path">The path to an effect source code file.</param>
+		/// <param name="pp">The pre-processor to use, with all include paths and macros already set up.</param>
+		/// <param name="preset">The preset to bake uniform values from in performance mode, or "nullptr" to keep all uniforms.</param>
+		static parsed_effect parse_effect(const filesystem::path &path, reshadefx::preprocessor &pp, const ini_file *preset);
+		/// <summary>
+		/// Compile a parsed effect and initialize textures, constants and techniques.
+		/// </summary>
+		/// <param name="effect">The effect to compile.</param>
+		void load_effect(const parsed_effect &effect);
+		/// <summary>
+		/// Add the uniform variable to the list of those updated every frame if it has a "source" annotation the runtime knows about.
+		/// </summary>
+		/// <param name="variable">The variable to bind.</param>
+		void add_uniform_binding(uniform &variable);
+		/// <summary>
+		/// Write the current value of every bound uniform variable to the uniform storage.
+		/// </summary>
+		void update_uniform_bindings();
+		/// <summary>
+		/// Build the pass graph of the specified techniques again and update their pass schedules from it.
+		/// </summary>
+		/// <param name="technique_indices">The indices of the techniques rendered this frame, in the order they are rendered in.</param>
+		void update_pass_graph(const std::vector<size_t> &technique_indices);
+
+		/// <summary>
+		/// Find all effect files and start loading them.
+		/// </summary>
+		/// <param name="in_background">Set to true to keep rendering the current effects until all new ones are loaded, and keep the previous version of those that fail to compile.</param>
+		void reload(bool in_background = false);
+		/// <summary>
+		/// Compile the specified effects again in the background. All other effects are created from their retained syntax trees, so they are neither pre-processed nor parsed again.
+		/// </summary>
+		/// <param name="outdated">The paths to the effect files that changed.</param>
+		void reload_effects(const std::vector<filesystem::path> &outdated);
+		void begin_reload(bool in_background);
+		void parse_effects(const std::vector<filesystem::path> &outdated);
+		void cancel_background_reload();
+		void load_effect_index();
+		void save_effect_index();
 		void load_configuration();
 		void save_configuration() const;
 		void load_preset(const filesystem::path &path);
@@ -212,6 +339,27 @@ namespace reshade
 		const unsigned int _renderer_id;
 		bool _is_initialized = false;
 		std::vector<filesystem::path> _effect_files;
+		std::vector<std::future<parsed_effect>> _parsed_effects;
+		std::unordered_map<std::string, parsed_effect> _last_compiled_effects;
+		dependency_graph _effect_dependencies;
+		std::vector<std::unique_ptr<filesystem::directory_watcher>> _effect_watchers;
+		std::unordered_map<std::string, std::shared_ptr<const indexed_effect>> _effect_index;
+		std::unordered_map<std::string, filesystem::path> _deferred_effects;
+		std::unordered_set<std::string> _effects_compiled_on_demand;
+		std::vector<std::string> _techniques_enabled_on_demand;
+		struct
+		{
+			std::vector<texture> textures;
+			std::vector<uniform> uniforms;
+			std::vector<technique> techniques;
+			std::vector<unsigned char> uniform_data_storage;
+			std::vector<bool> uniform_storage_modified;
+			std::vector<uniform_binding> uniform_bindings;
+			std::unordered_map<std::string, filesystem::path> deferred_effects;
+			std::string errors;
+			size_t texture_count = 0, uniform_count = 0, technique_count = 0;
+		} _inactive_effects;
+		thread_pool _worker_pool;
 		std::vector<filesystem::path> _preset_files;
 		std::vector<filesystem::path> _effect_search_paths;
 		std::vector<filesystem::path> _texture_search_paths;
@@ -220,6 +368,10 @@ namespace reshade
 		std::chrono::high_resolution_clock::time_point _last_present_time;
 		std::chrono::high_resolution_clock::duration _last_frame_duration;
 		std::vector<unsigned char> _uniform_data_storage;
+		std::vector<bool> _uniform_storage_modified; // One flag per four bytes of the uniform storage, which is the size of every scalar a uniform consists of
+		std::vector<uniform_binding> _uniform_bindings;
+		pass_graph _pass_graph;
+		std::vector<size_t> _pass_graph_techniques; // The techniques the pass graph was last built from
 		int _date[4] = { };
 		std::string _errors;
 		std::vector<std::string> _preprocessor_definitions;
@@ -240,8 +392,12 @@ namespace reshade
 		bool _show_framerate = false;
 		bool _effects_enabled = true;
 		bool _is_fast_loading = false;
+		bool _is_reloading_in_background = false;
 		bool _no_reload_on_init = false;
 		bool _performance_mode = false;
+		bool _compile_on_demand = false;
+		bool _effect_index_modified = false;
+		bool _is_pass_graph_outdated = true;
 		bool _overlay_key_setting_active = false;
 		bool _screenshot_key_setting_active = false;
 		bool _toggle_key_setting_active = false;
@@ -252,6 +408,7 @@ namespace reshade
 		float _imgui_col_text_fps[3] = { 1.0f, 1.0f, 0.0f };
 		float _variable_editor_height = 0.0f;
 		unsigned int _tutorial_index = 0;
+		unsigned int _shader_cache_size = 128;
 		unsigned int _effects_expanded_state = 2;
 		char _effect_filter_buffer[64] = { };
 		size_t _reload_remaining_effects = 0;
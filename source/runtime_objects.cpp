@@ -134,7 +134,14 @@ namespace reshade
 
 		assert(variable.storage_offset + size <= _uniform_data_storage.size());
 
+		if (std::memcmp(&_uniform_data_storage[variable.storage_offset], data, size) == 0)
+		{
+			return;
+		}
+
 		std::memcpy(&_uniform_data_storage[variable.storage_offset], data, size);
+
+		mark_uniform_storage_modified(variable.storage_offset, size);
 	}
 	void runtime::set_uniform_value(uniform &variable, const bool *values, size_t count)
 	{
@@ -242,4 +249,42 @@ namespace reshade
 			}
 		}
 	}
+	void runtime::mark_uniform_storage_modified(size_t offset, size_t size)
+	{
+		const size_t first = offset / 4, last = (offset + size + 3) / 4;
+
+		if (_uniform_storage_modified.size() < last)
+		{
+			_uniform_storage_modified.resize(last, false);
+		}
+
+		std::fill(_uniform_storage_modified.begin() + first, _uniform_storage_modified.begin() + last, true);
+	}
+	bool runtime::consume_modified_uniform_range(size_t &offset, size_t &size)
+	{
+		const size_t end = offset + size;
+		size_t first = offset / 4, last = std::min((end + 3) / 4, _uniform_storage_modified.size());
+
+		while (first < last && !_uniform_storage_modified[first])
+		{
+			first++;
+		}
+
+		if (first >= last)
+		{
+			return false;
+		}
+
+		while (!_uniform_storage_modified[last - 1])
+		{
+			last--;
+		}
+
+		std::fill(_uniform_storage_modified.begin() + first, _uniform_storage_modified.begin() + last, false);
+
+		offset = std::max(offset, first * 4);
+		size = std::min(end, last * 4) - offset;
+
+		return true;
+	}
 }
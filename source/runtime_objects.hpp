@@ -116,6 +116,11 @@ namespace reshade
 		std::unordered_map<std::string, variant> annotations;
 		bool hidden = false;
 	};
+	struct scheduled_pass
+	{
+		size_t index = 0;
+		bool shares_state_with_previous = false; // The pass renders to the same targets with the same states as the one before it, so they do not have to be set up again
+	};
 	struct technique final
 	{
 		#pragma region Constructors and Assignment Operators
@@ -129,6 +134,7 @@ namespace reshade
 
 		std::string name, effect_filename;
 		std::vector<std::unique_ptr<base_object>> passes;
+		std::vector<scheduled_pass> schedule; // The passes to render in the order to render them in, which may omit passes and differ from the order they were declared in
 		std::unordered_map<std::string, variant> annotations;
 		bool hidden = false;
 		bool enabled = false;
@@ -138,6 +144,7 @@ namespace reshade
 		moving_average<uint64_t, 60> average_cpu_duration;
 		moving_average<uint64_t, 60> average_gpu_duration;
 		ptrdiff_t uniform_storage_offset = 0, uniform_storage_index = -1;
+		ptrdiff_t dynamic_uniform_storage_offset = 0, dynamic_uniform_storage_index = -1; // Separate storage for uniforms updated every frame, if the implementation supports it
 		std::unique_ptr<base_object> impl;
 	};
 }
@@ -0,0 +1,350 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "log.hpp"
+#include "shader_cache.hpp"
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <Windows.h>
+
+namespace reshade
+{
+	struct entry_header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint64_t size;
+		uint64_t checksum;
+	};
+
+	static const uint32_t entry_magic = 0x43534852; // "RHSC"
+	static const uint32_t entry_version = 1;
+
+	static uint64_t hash_bytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ static_cast<const uint8_t *>(data)[i]) * 1099511628211ull;
+		}
+
+		return hash;
+	}
+	static uint64_t hash_string(const std::string &str, uint64_t hash)
+	{
+		// Include the terminator, so that moving characters from one field to the next changes the key
+		return hash_bytes(str.c_str(), str.size() + 1, hash);
+	}
+
+	shader_cache &shader_cache::global()
+	{
+		static shader_cache s_cache;
+
+		return s_cache;
+	}
+
+	uint64_t shader_cache::make_key(const std::string &source, const std::string &entry_point, const std::string &profile, unsigned int flags, const std::string &compiler)
+	{
+		uint64_t hash = hash_bytes(&entry_version, sizeof(entry_version));
+		hash = hash_string(source, hash);
+		hash = hash_string(entry_point, hash);
+		hash = hash_string(profile, hash);
+		hash = hash_bytes(&flags, sizeof(flags), hash);
+		hash = hash_string(compiler, hash);
+
+		return hash;
+	}
+
+	static bool is_abandoned_temp_file(const filesystem::path &path)
+	{
+		// Temporary files are named "<entry>.bin.<pid>.<tid>.tmp" (see "shader_cache::store")
+		const std::string name = path.filename().string();
+		const size_t pid_begin = name.find(".bin.");
+		const DWORD pid = pid_begin != std::string::npos ? std::strtoul(name.c_str() + pid_begin + 5, nullptr, 10) : 0;
+
+		if (pid != 0)
+		{
+			const HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+
+			if (process == nullptr)
+			{
+				return true;
+			}
+
+			DWORD exit_code = 0;
+			const bool is_alive = GetExitCodeProcess(process, &exit_code) && exit_code == STILL_ACTIVE;
+
+			CloseHandle(process);
+
+			if (!is_alive)
+			{
+				return true;
+			}
+		}
+
+		// The process ID may have been reused since, so also treat files that were not written to for a long time as abandoned, since an entry is written in one go
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+		if (!GetFileAttributesExW(path.wstring().c_str(), GetFileExInfoStandard, &attributes))
+		{
+			return false;
+		}
+
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+
+		const uint64_t modified_time = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+		const uint64_t current_time = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+
+		return current_time > modified_time && current_time - modified_time > 60ull * 60 * 10000000; // One hour in 100 nanosecond intervals
+	}
+
+	void shader_cache::open(const filesystem::path &directory, uint64_t max_size)
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		// Every runtime opens the cache when it loads its configuration, but only the first call or one that changes the settings has to scan the directory
+		if (_is_open && directory == _directory && max_size == _max_size)
+		{
+			return;
+		}
+
+		_is_open = true;
+		_directory = directory;
+		_max_size = max_size;
+		_size = 0;
+
+		if (_max_size == 0)
+		{
+			return;
+		}
+
+		CreateDirectoryW(_directory.wstring().c_str(), nullptr);
+
+		// Remove temporary files left behind by a process that exited while writing an entry, but not those other processes sharing the cache are still writing
+		for (const auto &path : filesystem::list_files(_directory, "*.tmp"))
+		{
+			if (is_abandoned_temp_file(path))
+			{
+				DeleteFileW(path.wstring().c_str());
+			}
+		}
+
+		evict();
+
+		LOG(INFO) << "Using shader cache in " << _directory << " with " << (_size / 1024) << " KB of " << (_max_size / 1024) << " KB in use.";
+	}
+
+	bool shader_cache::load(uint64_t key, std::vector<char> &data)
+	{
+		uint64_t max_size;
+		filesystem::path path;
+
+		{ const std::lock_guard<std::mutex> lock(_mutex);
+			if (_max_size == 0)
+			{
+				return false;
+			}
+
+			max_size = _max_size;
+			path = entry_path(key);
+		}
+
+		std::ifstream file(path.wstring(), std::ios::binary);
+
+		if (!file.is_open())
+		{
+			const std::lock_guard<std::mutex> lock(_mutex);
+
+			_misses++;
+
+			return false;
+		}
+
+		entry_header header;
+		bool valid =
+			file.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+			header.magic == entry_magic && header.version == entry_version && header.key == key && header.size <= max_size;
+
+		if (valid)
+		{
+			data.resize(static_cast<size_t>(header.size));
+
+			valid = file.read(data.data(), data.size()) && hash_bytes(data.data(), data.size()) == header.checksum;
+		}
+
+		file.close();
+
+		if (!valid)
+		{
+			LOG(WARNING) << "Removing invalid shader cache entry " << path << " ...";
+
+			DeleteFileW(path.wstring().c_str());
+			data.clear();
+
+			const std::lock_guard<std::mutex> lock(_mutex);
+
+			_misses++;
+
+			return false;
+		}
+
+		// Update the modification time, which is what the least recently used entries are evicted by
+		const HANDLE handle = CreateFileW(path.wstring().c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+
+		if (handle != INVALID_HANDLE_VALUE)
+		{
+			FILETIME now;
+			GetSystemTimeAsFileTime(&now);
+			SetFileTime(handle, nullptr, nullptr, &now);
+			CloseHandle(handle);
+		}
+
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		_hits++;
+
+		return true;
+	}
+	void shader_cache::store(uint64_t key, const std::vector<char> &data)
+	{
+		filesystem::path path;
+
+		{ const std::lock_guard<std::mutex> lock(_mutex);
+			if (_max_size == 0 || sizeof(entry_header) + data.size() > _max_size)
+			{
+				return;
+			}
+
+			path = entry_path(key);
+		}
+
+		// Write to a file only this thread uses and move it into place afterwards, so that readers never see a partially written entry
+		const filesystem::path temp_path = path + ('.' + std::to_string(GetCurrentProcessId()) + '.' + std::to_string(GetCurrentThreadId()) + ".tmp");
+
+		const entry_header header = { entry_magic, entry_version, key, data.size(), hash_bytes(data.data(), data.size()) };
+
+		bool success = false;
+
+		{ std::ofstream file(temp_path.wstring(), std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			file.write(data.data(), data.size());
+			file.flush();
+
+			success = file.good();
+		}
+
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		// Another thread or process may have stored the same entry in the meantime, which is replaced then and must not be counted twice
+		uint64_t replaced_size = 0;
+
+		if (WIN32_FILE_ATTRIBUTE_DATA attributes; GetFileAttributesExW(path.wstring().c_str(), GetFileExInfoStandard, &attributes))
+		{
+			replaced_size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		}
+
+		if (!success || !MoveFileExW(temp_path.wstring().c_str(), path.wstring().c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileW(temp_path.wstring().c_str());
+			return;
+		}
+
+		_size += sizeof(header) + data.size();
+		_size -= std::min(_size, replaced_size);
+
+		if (_size > _max_size)
+		{
+			evict();
+		}
+	}
+	bool shader_cache::load_or_compile(uint64_t key, std::vector<char> &data, const compile_callback &compile)
+	{
+		if (load(key, data))
+		{
+			return true;
+		}
+
+		if (!compile(data))
+		{
+			return false;
+		}
+
+		store(key, data);
+
+		return true;
+	}
+
+	filesystem::path shader_cache::entry_path(uint64_t key) const
+	{
+		char filename[32];
+		sprintf_s(filename, "%016llx.bin", static_cast<unsigned long long>(key));
+
+		return _directory / filename;
+	}
+	void shader_cache::evict()
+	{
+		struct entry
+		{
+			std::wstring path;
+			uint64_t size, last_used;
+		};
+
+		std::vector<entry> entries;
+		WIN32_FIND_DATAW ffd;
+
+		const HANDLE handle = FindFirstFileW((_directory / "*.bin").wstring().c_str(), &ffd);
+
+		if (handle != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				{
+					continue;
+				}
+
+				entries.push_back({
+					(_directory / utf16_to_utf8(ffd.cFileName)).wstring(),
+					(static_cast<uint64_t>(ffd.nFileSizeHigh) << 32) | ffd.nFileSizeLow,
+					(static_cast<uint64_t>(ffd.ftLastWriteTime.dwHighDateTime) << 32) | ffd.ftLastWriteTime.dwLowDateTime });
+			}
+			while (FindNextFileW(handle, &ffd));
+
+			FindClose(handle);
+		}
+
+		_size = 0;
+
+		for (const auto &entry : entries)
+		{
+			_size += entry.size;
+		}
+
+		if (_size <= _max_size)
+		{
+			return;
+		}
+
+		// Trim to below the limit, so that the directory does not have to be scanned again on the very next store
+		const uint64_t target_size = _max_size - _max_size / 4;
+
+		std::sort(entries.begin(), entries.end(), [](const entry &lhs, const entry &rhs) { return lhs.last_used < rhs.last_used; });
+
+		for (const auto &entry : entries)
+		{
+			if (_size <= target_size)
+			{
+				break;
+			}
+
+			if (DeleteFileW(entry.path.c_str()))
+			{
+				_size -= entry.size;
+			}
+		}
+	}
+}
@@ -0,0 +1,83 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <mutex>
+#include <functional>
+#include "filesystem.hpp"
+
+namespace reshade
+{
+	/// <summary>
+	/// A persistent cache of compiled shader code, which is shared between all runtimes in the process.
+	/// Each entry is stored in a file of its own and is keyed by everything that affects the compiler output. The cache does not know about any graphics API, the effect compilers only hand it the key and a callback that produces the code on a miss.
+	/// </summary>
+	class shader_cache
+	{
+	public:
+		/// <summary>
+		/// A function that compiles a shader and writes the resulting code to the provided buffer.
+		/// </summary>
+		using compile_callback = std::function<bool(std::vector<char> &data)>;
+
+		/// <summary>
+		/// Returns the process-wide cache instance used by all effect compilers.
+		/// </summary>
+		static shader_cache &global();
+
+		/// <summary>
+		/// Compute the cache key for a shader.
+		/// </summary>
+		/// <param name="source">The generated shader source code.</param>
+		/// <param name="entry_point">The name of the entry point function.</param>
+		/// <param name="profile">The shader profile or stage the source is compiled for.</param>
+		/// <param name="flags">The flags passed to the compiler.</param>
+		/// <param name="compiler">A string identifying the compiler and its version.</param>
+		static uint64_t make_key(const std::string &source, const std::string &entry_point, const std::string &profile, unsigned int flags, const std::string &compiler);
+
+		/// <summary>
+		/// Set the directory the cache is stored in and the maximum size of all entries, evicting the least recently used ones if it is already larger than that.
+		/// </summary>
+		/// <param name="directory">The directory to store the cache in. It is created on demand.</param>
+		/// <param name="max_size">The maximum size in bytes. A size of zero disables the cache.</param>
+		void open(const filesystem::path &directory, uint64_t max_size);
+
+		/// <summary>
+		/// Look up the code stored for the specified key. Entries that fail validation are deleted.
+		/// </summary>
+		/// <param name="key">The cache key (see "make_key").</param>
+		/// <param name="data">The buffer to write the cached code to.</param>
+		/// <returns>A boolean value indicating whether a valid entry was found.</returns>
+		bool load(uint64_t key, std::vector<char> &data);
+		/// <summary>
+		/// Store code for the specified key. The file is written under a temporary name first and then renamed, so an interrupted write never leaves a partial entry behind.
+		/// </summary>
+		/// <param name="key">The cache key (see "make_key").</param>
+		/// <param name="data">The code to store.</param>
+		void store(uint64_t key, const std::vector<char> &data);
+		/// <summary>
+		/// Look up the code for the specified key, or call the compiler if there is none and store its output if that succeeded.
+		/// </summary>
+		/// <param name="key">The cache key (see "make_key").</param>
+		/// <param name="data">The buffer to write the code to.</param>
+		/// <param name="compile">The function to call on a cache miss.</param>
+		/// <returns>A boolean value indicating whether code is available, either from the cache or the compiler.</returns>
+		bool load_or_compile(uint64_t key, std::vector<char> &data, const compile_callback &compile);
+
+		size_t hits() const { const std::lock_guard<std::mutex> lock(_mutex); return _hits; }
+		size_t misses() const { const std::lock_guard<std::mutex> lock(_mutex); return _misses; }
+
+	private:
+		filesystem::path entry_path(uint64_t key) const;
+		void evict();
+
+		mutable std::mutex _mutex;
+		bool _is_open = false;
+		filesystem::path _directory;
+		uint64_t _size = 0, _max_size = 0;
+		size_t _hits = 0, _misses = 0;
+	};
+}
@@ -5,7 +5,7 @@
 
 #pragma once
 
-#include <string>
+#include <string_view>
 
 namespace reshadefx
 {
@@ -13,9 +13,9 @@ namespace reshadefx
 	{
 		location() : line(1), column(1) { }
 		explicit location(unsigned int line, unsigned int column = 1) : line(line), column(column) { }
-		explicit location(const std::string &source, unsigned int line, unsigned int column = 1) : source(source), line(line), column(column) { }
+		explicit location(std::string_view source, unsigned int line, unsigned int column = 1) : source(source), line(line), column(column) { }
 
-		std::string source;
+		std::string_view source; // Name of the source file, which is interned (see "interner::intern_string") so that copying a location never allocates
 		unsigned int line, column;
 	};
 }
@@ -0,0 +1,124 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#include "thread_pool.hpp"
+#include <atomic>
+#include <algorithm>
+
+namespace reshade
+{
+	thread_pool::thread_pool(size_t num_threads)
+	{
+		if (num_threads == 0)
+		{
+			num_threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+
+		for (size_t i = 0; i < num_threads; i++)
+		{
+			_threads.emplace_back(&thread_pool::worker, this);
+		}
+	}
+	thread_pool::~thread_pool()
+	{
+		{ const std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+			_tasks.clear();
+		}
+
+		_condition.notify_all();
+
+		for (auto &thread : _threads)
+		{
+			thread.join();
+		}
+	}
+
+	void thread_pool::parallel_for(size_t count, const std::function<void(size_t)> &func)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		struct state
+		{
+			std::atomic<size_t> next_index = 0;
+			size_t num_completed = 0;
+			std::mutex mutex;
+			std::condition_variable condition;
+		};
+
+		// Helpers may still be queued after this call returned, so they only hold on to the shared state and never touch the function once all indices were claimed
+		const auto shared_state = std::make_shared<state>();
+		const auto work = [shared_state, count, &func]() {
+			size_t num_completed = 0;
+
+			for (size_t index; (index = shared_state->next_index++) < count; num_completed++)
+			{
+				func(index);
+			}
+
+			if (num_completed == 0)
+			{
+				return;
+			}
+
+			const std::lock_guard<std::mutex> lock(shared_state->mutex);
+
+			if ((shared_state->num_completed += num_completed) == count)
+			{
+				shared_state->condition.notify_all();
+			}
+		};
+
+		for (size_t i = 1, num_helpers = std::min(count, _threads.size() + 1); i < num_helpers; i++)
+		{
+			push(work, true);
+		}
+
+		work();
+
+		std::unique_lock<std::mutex> lock(shared_state->mutex);
+		shared_state->condition.wait(lock, [&shared_state, count]() { return shared_state->num_completed == count; });
+	}
+
+	void thread_pool::push(std::function<void()> &&task, bool front)
+	{
+		{ const std::lock_guard<std::mutex> lock(_mutex);
+			if (front)
+			{
+				_tasks.push_front(std::move(task));
+			}
+			else
+			{
+				_tasks.push_back(std::move(task));
+			}
+		}
+
+		_condition.notify_one();
+	}
+	void thread_pool::worker()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+
+			{ std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+
+				if (_stop)
+				{
+					return;
+				}
+
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+}
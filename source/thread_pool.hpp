@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2014 Patrick Mours. All rights reserved.
+ * License: https://github.com/crosire/reshade#license
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+namespace reshade
+{
+	/// <summary>
+	/// A fixed set of worker threads that execute tasks in the order they were queued.
+	/// </summary>
+	class thread_pool
+	{
+	public:
+		/// <summary>
+		/// Construct a new thread pool and start its worker threads.
+		/// </summary>
+		/// <param name="num_threads">The number of worker threads. Zero uses one thread less than there are cores, so the thread that queues tasks still has a core to itself.</param>
+		explicit thread_pool(size_t num_threads = 0);
+		thread_pool(const thread_pool &) = delete;
+		/// <summary>
+		/// Stop all worker threads. Tasks that have not started yet are discarded.
+		/// </summary>
+		~thread_pool();
+
+		thread_pool &operator=(const thread_pool &) = delete;
+
+		/// <summary>
+		/// Returns the number of worker threads.
+		/// </summary>
+		size_t size() const { return _threads.size(); }
+
+		/// <summary>
+		/// Queue a task to be executed on one of the worker threads.
+		/// </summary>
+		/// <param name="task">The function to execute.</param>
+		/// <returns>A future that receives the return value of the task once it finished.</returns>
+		template <typename F>
+		auto enqueue(F &&task) -> std::future<decltype(task())>
+		{
+			// Wrapped in a shared pointer because "std::function" requires copyable targets, which a packaged task is not
+			const auto packaged_task = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<F>(task));
+			auto future = packaged_task->get_future();
+
+			push([packaged_task]() { (*packaged_task)(); }, false);
+
+			return future;
+		}
+
+		/// <summary>
+		/// Call a function for every index in the range [0, count) and wait for all calls to finish.
+		/// The calling thread takes part in the work, and the worker threads pick it up before any other queued tasks, since the caller is blocked until it is done.
+		/// </summary>
+		/// <param name="count">The number of indices.</param>
+		/// <param name="func">The function to call with each index.</param>
+		void parallel_for(size_t count, const std::function<void(size_t)> &func);
+
+	private:
+		void push(std::function<void()> &&task, bool front);
+		void worker();
+
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		std::deque<std::function<void()>> _tasks;
+		std::vector<std::thread> _threads;
+		bool _stop = false;
+	};
+}